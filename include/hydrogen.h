@@ -85,6 +85,21 @@ HyError * hy_run_string(HyState *state, char *source);
 // Release all resources allocated by an interpreter state.
 void hy_free(HyState *state);
 
+// Enable or disable the tracing JIT compiler, which is enabled by default on
+// platforms that support it. Has no effect on other platforms.
+void hy_set_jit(HyState *state, bool enabled);
+
+// Print information about every trace the JIT compiles (or fails to compile)
+// to the standard error output.
+void hy_set_jit_info(HyState *state, bool show);
+
+// Set the maximum depth of the call stack, after which calling a function
+// triggers a stack overflow error.
+void hy_set_stack_limit(HyState *state, uint32_t depth);
+
+// Enable or disable the bytecode optimiser, which is enabled by default.
+void hy_set_optimiser(HyState *state, bool enabled);
+
 // Release resources allocated by an error object.
 void hy_err_free(HyError *err);
 
@@ -154,6 +169,8 @@ typedef enum {
 	HY_STRUCT,
 	HY_METHOD,
 	HY_ARRAY,
+	HY_FLOAT_ARRAY,
+	HY_MAP,
 	HY_FUNCTION,
 } HyType;
 
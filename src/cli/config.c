@@ -48,6 +48,9 @@ static bool config_opt(Config *config, char *opt) {
 	} else if (strcmp(opt, "--joff") == 0) {
 		// Disable JIT
 		config->enable_jit = false;
+	} else if (strcmp(opt, "--ooff") == 0) {
+		// Disable the bytecode optimiser
+		config->enable_optimiser = false;
 	} else if (strcmp(opt, "-b") == 0) {
 		// Show bytecode
 		config->show_bytecode = true;
@@ -77,6 +80,7 @@ Config config_new(int argc, char *argv[]) {
 	Config config;
 	config.enable_jit = true;
 	config.show_jit_info = false;
+	config.enable_optimiser = true;
 	config.show_bytecode = false;
 	config.type = EXEC_REPL;
 	config.input_type = INPUT_NONE;
@@ -36,6 +36,9 @@ typedef struct {
 	// execution or not
 	bool show_jit_info;
 
+	// Whether to optimise bytecode after it's been parsed or not
+	bool enable_optimiser;
+
 	// Whether to output bytecode or execute code
 	bool show_bytecode;
 
@@ -46,6 +46,7 @@ void print_help(void) {
 		"  --stdin        Read from the standard input rather than a file\n"
 		"  --joff         Disable JIT compilation\n"
 		"  --jinfo        Show information about JIT compiled loops\n"
+		"  --ooff         Disable bytecode optimisation\n"
 		"  --version, -v  Show Hydrogen's version number\n"
 		"  --help, -h     Show this help text\n"
 	);
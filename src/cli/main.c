@@ -24,6 +24,7 @@
 static int bytecode(Config *config) {
 	// Create a new interpreter state
 	HyState *state = hy_new();
+	hy_set_optimiser(state, config->enable_optimiser);
 
 	// Add the standard library
 	hy_add_libs(state);
@@ -61,6 +62,9 @@ static int bytecode(Config *config) {
 static int run(Config *config) {
 	// Create the interpreter state
 	HyState *state = hy_new();
+	hy_set_jit(state, config->enable_jit);
+	hy_set_jit_info(state, config->show_jit_info);
+	hy_set_optimiser(state, config->enable_optimiser);
 	hy_add_libs(state);
 
 	// Depending on the type of the input
@@ -408,6 +408,9 @@ void repl(Config *config) {
 
 	// Create interpreter state
 	HyState *state = hy_new();
+	hy_set_jit(state, config->enable_jit);
+	hy_set_jit_info(state, config->show_jit_info);
+	hy_set_optimiser(state, config->enable_optimiser);
 	hy_add_libs(state);
 	HyPackage pkg = hy_add_pkg(state, NULL);
 
@@ -45,6 +45,11 @@ typedef enum {
 	MOV_LF,
 	MOV_LV,
 
+	// Set an upvalue of the closure being executed.
+	//
+	// Arguments:
+	// * `upvalue`: index of the upvalue in the closure
+	// * `value`: value to set the upvalue to
 	MOV_UL,
 	MOV_UI,
 	MOV_UN,
@@ -53,7 +58,19 @@ typedef enum {
 	MOV_UF,
 	MOV_UV,
 
+	// Move an upvalue of the closure being executed into a local.
+	//
+	// Arguments:
+	// * `local`: stack slot to place the upvalue's value in
+	// * `upvalue`: index of the upvalue in the closure
 	MOV_LU,
+
+	// Close every open upvalue referring to a local at or above the given
+	// stack slot, moving the local's value into the upvalue. Emitted when
+	// locals captured by a closure go out of scope.
+	//
+	// Arguments:
+	// * `slot`: the lowest stack slot to close
 	UPVALUE_CLOSE,
 
 	// Arguments:
@@ -80,6 +97,19 @@ typedef enum {
 	// * `slot`: the stack slot to store the self argumen tin
 	MOV_SELF,
 
+	// Wide forms of MOV_LN, MOV_LS, MOV_LF, and MOV_LV, used when the index
+	// of the constant, string, or function doesn't fit in 16 bits. Any other
+	// instruction that needs such a value uses a local it's been moved into.
+	//
+	// Arguments:
+	// * `local`: stack slot to place the value in
+	// * `index_low`: the lower 16 bits of the index
+	// * `index_high`: the upper 16 bits of the index
+	MOV_LN_WIDE,
+	MOV_LS_WIDE,
+	MOV_LF_WIDE,
+	MOV_LV_WIDE,
+
 
 	//
 	//  Math
@@ -121,6 +151,21 @@ typedef enum {
 
 	NEG_L,
 
+	// Arithmetic on two locals, quickened by the interpreter once it has seen
+	// the instruction executed with two numbers. Must be in the same order as
+	// the arithmetic operators above.
+	ADD_LL_NUM,
+	SUB_LL_NUM,
+	MUL_LL_NUM,
+	DIV_LL_NUM,
+	MOD_LL_NUM,
+
+	// Remainders where both operands are 32 bit integers and the divisor is
+	// positive, quickened from MOD_LL and MOD_LI, which use integer division
+	// rather than `fmod`.
+	MOD_LL_INT,
+	MOD_LI_INT,
+
 
 	//
 	//  Comparison
@@ -164,6 +209,46 @@ typedef enum {
 	GE_LI,
 	GE_LN,
 
+	// Fused comparisons, which are identical to the comparisons above except
+	// that they store the offset to the target of the following JMP
+	// instruction in their third argument. When the JMP would be executed, we
+	// jump straight to its target instead. Must be in the same order as the
+	// comparisons above.
+	IS_TRUE_L_JMP,
+	IS_FALSE_L_JMP,
+
+	EQ_LL_JMP,
+	EQ_LI_JMP,
+	EQ_LN_JMP,
+	EQ_LS_JMP,
+	EQ_LP_JMP,
+	EQ_LF_JMP,
+	EQ_LV_JMP,
+
+	NEQ_LL_JMP,
+	NEQ_LI_JMP,
+	NEQ_LN_JMP,
+	NEQ_LS_JMP,
+	NEQ_LP_JMP,
+	NEQ_LF_JMP,
+	NEQ_LV_JMP,
+
+	LT_LL_JMP,
+	LT_LI_JMP,
+	LT_LN_JMP,
+
+	LE_LL_JMP,
+	LE_LI_JMP,
+	LE_LN_JMP,
+
+	GT_LL_JMP,
+	GT_LI_JMP,
+	GT_LN_JMP,
+
+	GE_LL_JMP,
+	GE_LI_JMP,
+	GE_LN_JMP,
+
 
 	//
 	//  Control flow
@@ -175,11 +260,58 @@ typedef enum {
 	// Jump backwards by `amount` instructions (used for loops).
 	LOOP,
 
+	// Numeric for loops keep their counter, limit, and loop variable in three
+	// consecutive stack slots starting at `base`. Both bounds are checked to be
+	// numbers once by FOR_PREP, so FOR_LOOP can increment and test the counter
+	// without any type checks.
+	//
+	// Arguments:
+	// * `base`: the stack slot of the loop's counter
+	// * `amount`: the number of instructions to jump by
+
+	// Ensure the counter and limit are numbers, then jump forwards by `amount`
+	// instructions (to the end of the loop) if the counter isn't less than the
+	// limit, or otherwise copy the counter into the loop variable.
+	FOR_PREP,
+
+	// Increment the counter, then jump backwards by `amount` instructions (to
+	// the start of the loop's body) if it's still less than the limit, copying
+	// it into the loop variable.
+	FOR_LOOP,
+
+	// For loops over arrays keep the array, the index of the current element,
+	// and the loop variable in three consecutive stack slots starting at
+	// `base`, with the same arguments as FOR_PREP and FOR_LOOP. The array's
+	// type is checked once by FOR_ARRAY_PREP. FOR_ARRAY_LOOP re-reads the
+	// array's length and contents on each iteration, since the loop's body can
+	// modify the array (or the garbage collector can move it).
+
+	// Ensure the value in `base` is an array, then jump forwards by `amount`
+	// instructions (to the end of the loop) if it's empty, or otherwise copy
+	// its first element into the loop variable.
+	FOR_ARRAY_PREP,
+
+	// Increment the index, then jump backwards by `amount` instructions (to
+	// the start of the loop's body) if it's still within the array, copying
+	// the element at the index into the loop variable.
+	FOR_ARRAY_LOOP,
+
 
 	//
 	//  Functions
 	//
 
+	// Create a closure for a function that captures upvalues. Upvalues
+	// captured from a local in the current function are shared with any other
+	// closure capturing the same local.
+	//
+	// Arguments:
+	// * `slot`: where to store the new closure on the stack
+	// * `fn_low`: the lower 16 bits of the index of the function to create a
+	//   closure for
+	// * `fn_high`: the upper 16 bits of the index
+	CLOSURE_NEW,
+
 	// The function to call must be in the slot specified by `base`. All
 	// arguments to the function are placed after this first slot (the number
 	// of arguments specified by `arity`). The return values of the function
@@ -194,6 +326,33 @@ typedef enum {
 	//   function
 	CALL,
 
+	// Call a method or function stored in a field on an object. Fuses a
+	// STRUCT_FIELD followed by a CALL, so methods don't have to be bound to
+	// the object before they're called. The object is replaced by the return
+	// value of the call.
+	//
+	// Arguments:
+	// * `base`: the stack slot containing the object to call the method on,
+	//   and the arguments to the method after it
+	// * `arity`: the number of arguments to pass to the method
+	// * `field_name`: the name of the method, as an index into the VM's struct
+	//   field name list
+	CALL_FIELD,
+
+	// Call a function in tail position, where the value it returns is
+	// immediately returned by the calling function. Hydrogen functions reuse
+	// the calling function's stack frame, so they return straight to its
+	// caller. Other functions are called as if by CALL. Always followed by a
+	// RET_L instruction returning `return_slot`.
+	//
+	// Arguments:
+	// * `base`: the stack slot containing the function to call and arguments to
+	//   the function after it
+	// * `arity`: the number of arguments to pass to the function
+	// * `return_slot`: the slot in which to store the return value of the
+	//   function, if the calling function's stack frame isn't reused
+	TAIL_CALL,
+
 	// Return nothing from a function.
 	RET0,
 
@@ -220,15 +379,18 @@ typedef enum {
 	//
 	// Arguments:
 	// * `slot`: where to store the new struct on the stack
-	// * `struct_index`: the index of the struct's definition in the VM's list
+	// * `struct_low`: the lower 16 bits of the index of the struct's
+	//   definition in the VM's list
+	// * `struct_high`: the upper 16 bits of the index
 	STRUCT_NEW,
 
 	// Create an instance of a native struct.
 	//
 	// Arguments:
 	// * `slot`: where to store the new instance
-	// * `index`: the index into the interpreter's native structs list
-	//   specifying which struct to instantiate
+	// * `index_low`: the lower 16 bits of the index into the interpreter's
+	//   native structs list specifying which struct to instantiate
+	// * `index_high`: the upper 16 bits of the index
 	NATIVE_STRUCT_NEW,
 
 	// Call the constructor function of a struct.
@@ -265,6 +427,28 @@ typedef enum {
 	STRUCT_SET_F,
 	STRUCT_SET_V,
 
+	// Get a field on the self argument in a method, where the field's position
+	// on the struct is known at compile time.
+	//
+	// Arguments:
+	// * `slot`: where to store the contents of the field
+	// * `field_index`: the index of the field in the struct's fields list
+	SELF_FIELD,
+
+	// Set a field on the self argument in a method, where the field's position
+	// on the struct is known at compile time.
+	//
+	// Arguments:
+	// * `field_index`: the index of the field in the struct's fields list
+	// * `value`: set the field to this value
+	SELF_SET_L,
+	SELF_SET_I,
+	SELF_SET_N,
+	SELF_SET_S,
+	SELF_SET_P,
+	SELF_SET_F,
+	SELF_SET_V,
+
 
 	//
 	//  Arrays
@@ -308,6 +492,57 @@ typedef enum {
 	ARRAY_L_SET_F,
 	ARRAY_L_SET_V,
 
+	// Create a slice of an array or string. Slices of arrays share their
+	// elements with the original until either is modified, while strings are
+	// copied.
+	//
+	// Arguments:
+	// * `slot`: the slot to store the slice in
+	// * `bounds`: the slot the start of the slice is in, with the (exclusive)
+	//   end in the slot after it. Either can be nil, for the start or end of
+	//   the array or string
+	// * `slot`: the slot the array or string is in
+	ARRAY_SLICE,
+
+
+	//
+	//  Maps
+	//
+
+	// Create a new, empty map in a stack slot.
+	//
+	// Arguments:
+	// * `slot`: the slot to store the new map in
+	// * `count`: the number of keys to allocate room for
+	MAP_NEW,
+
+	// Get the value stored against a key in a map, or nil if the key isn't in
+	// the map. The parser can't tell an array from a map, so indexing by a
+	// local or an integer emits the array instructions, which fall back to a
+	// map lookup when given a map. MAP_GET is emitted for other constant keys
+	// (like strings), which can only ever index a map.
+	//
+	// Arguments:
+	// * `slot`: the slot to store the value in
+	// * `key`: the slot the key is in
+	// * `slot`: the slot the map is in
+	MAP_GET,
+
+	// Set the value stored against a key in a map, inserting the key if it
+	// isn't already in the map.
+	//
+	// Arguments:
+	// * `key`: the slot the key is in
+	// * `value`: the value to set the key to
+	// * `slot`: the slot the map is in
+	MAP_SET_L,
+	MAP_SET_I,
+	MAP_SET_N,
+	MAP_SET_S,
+	MAP_SET_P,
+	MAP_SET_F,
+	MAP_SET_V,
+
 
 	//
 	//  No Operation
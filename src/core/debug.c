@@ -9,15 +9,18 @@
 #include "state.h"
 #include "pkg.h"
 #include "err.h"
+#include "jmp.h"
+#include "opt.h"
 
 
 // The name of each opcode, in the exact order they were defined in.
 static char *opcode_names[] = {
 	"MOV_LL", "MOV_LI", "MOV_LN", "MOV_LS", "MOV_LP", "MOV_LF", "MOV_LV",
 	"MOV_UL", "MOV_UI", "MOV_UN", "MOV_US", "MOV_UP", "MOV_UF", "MOV_UV",
-	"MOV_UL", "UPVALUE_CLOSE",
+	"MOV_LU", "UPVALUE_CLOSE",
 	"MOV_TL", "MOV_TI", "MOV_TN", "MOV_TS", "MOV_TP", "MOV_TF", "MOV_TV",
 	"MOV_LT", "MOV_SELF",
+	"MOV_LN_WIDE", "MOV_LS_WIDE", "MOV_LF_WIDE", "MOV_LV_WIDE",
 
 	"ADD_LL", "ADD_LI", "ADD_LN", "ADD_IL", "ADD_NL",
 	"SUB_LL", "SUB_LI", "SUB_LN", "SUB_IL", "SUB_NL",
@@ -26,6 +29,8 @@ static char *opcode_names[] = {
 	"MOD_LL", "MOD_LI", "MOD_LN", "MOD_IL", "MOD_NL",
 	"CONCAT_LL", "CONCAT_LS", "CONCAT_SL",
 	"NEG_L",
+	"ADD_LL_NUM", "SUB_LL_NUM", "MUL_LL_NUM", "DIV_LL_NUM", "MOD_LL_NUM",
+	"MOD_LL_INT", "MOD_LI_INT",
 
 	"IS_TRUE_L", "IS_FALSE_L",
 	"EQ_LL", "EQ_LI", "EQ_LN", "EQ_LS", "EQ_LP", "EQ_LF", "EQ_LV",
@@ -35,14 +40,27 @@ static char *opcode_names[] = {
 	"GT_LL", "GT_LI", "GT_LN",
 	"GE_LL", "GE_LI", "GE_LN",
 
-	"JMP", "LOOP",
-	"CALL", "RET0", "RET_L", "RET_I", "RET_N", "RET_S", "RET_P", "RET_F",
-	"RET_V",
+	"IS_TRUE_L_JMP", "IS_FALSE_L_JMP",
+	"EQ_LL_JMP", "EQ_LI_JMP", "EQ_LN_JMP", "EQ_LS_JMP", "EQ_LP_JMP",
+	"EQ_LF_JMP", "EQ_LV_JMP",
+	"NEQ_LL_JMP", "NEQ_LI_JMP", "NEQ_LN_JMP", "NEQ_LS_JMP", "NEQ_LP_JMP",
+	"NEQ_LF_JMP", "NEQ_LV_JMP",
+	"LT_LL_JMP", "LT_LI_JMP", "LT_LN_JMP",
+	"LE_LL_JMP", "LE_LI_JMP", "LE_LN_JMP",
+	"GT_LL_JMP", "GT_LI_JMP", "GT_LN_JMP",
+	"GE_LL_JMP", "GE_LI_JMP", "GE_LN_JMP",
+
+	"JMP", "LOOP", "FOR_PREP", "FOR_LOOP", "FOR_ARRAY_PREP", "FOR_ARRAY_LOOP",
+	"CLOSURE_NEW", "CALL", "CALL_FIELD", "TAIL_CALL",
+	"RET0", "RET_L", "RET_I", "RET_N", "RET_S", "RET_P", "RET_F", "RET_V",
 
 	"STRUCT_NEW", "NATIVE_STRUCT_NEW", "STRUCT_CALL_CONSTRUCTOR",
 	"STRUCT_FIELD",
 	"STRUCT_SET_L", "STRUCT_SET_I", "STRUCT_SET_N", "STRUCT_SET_S",
 	"STRUCT_SET_P", "STRUCT_SET_F", "STRUCT_SET_V",
+	"SELF_FIELD",
+	"SELF_SET_L", "SELF_SET_I", "SELF_SET_N", "SELF_SET_S", "SELF_SET_P",
+	"SELF_SET_F", "SELF_SET_V",
 
 	"ARRAY_NEW",
 	"ARRAY_GET_L", "ARRAY_GET_I",
@@ -50,6 +68,11 @@ static char *opcode_names[] = {
 	"ARRAY_I_SET_P", "ARRAY_I_SET_F", "ARRAY_I_SET_V",
 	"ARRAY_L_SET_L", "ARRAY_L_SET_I", "ARRAY_L_SET_N", "ARRAY_L_SET_S",
 	"ARRAY_L_SET_P", "ARRAY_L_SET_F", "ARRAY_L_SET_V",
+	"ARRAY_SLICE",
+
+	"MAP_NEW", "MAP_GET",
+	"MAP_SET_L", "MAP_SET_I", "MAP_SET_N", "MAP_SET_S", "MAP_SET_P",
+	"MAP_SET_F", "MAP_SET_V",
 
 	"NO_OP",
 };
@@ -68,6 +91,8 @@ static uint32_t argument_count[] = {
 	3, /* MOV_TL */ 3, /* MOV_TI */ 3, /* MOV_TN */ 3, /* MOV_TS */
 	3, /* MOV_TP */ 3, /* MOV_TF */ 3, /* MOV_TV */
 	3, /* MOV_LT */ 1, /* MOV_SELF */
+	3, /* MOV_LN_WIDE */ 3, /* MOV_LS_WIDE */ 3, /* MOV_LF_WIDE */
+	3, /* MOV_LV_WIDE */
 
 	3, /* ADD_LL */ 3, /* ADD_LI */ 3, /* ADD_LN */ 3, /* ADD_IL */
 	3, /* ADD_NL */
@@ -81,6 +106,9 @@ static uint32_t argument_count[] = {
 	3, /* MOD_NL */
 	3, /* CONCAT_LL */ 3, /* CONCAT_LS */ 3, /* CONCAT_SL */
 	2, /* NEG_L */
+	3, /* ADD_LL_NUM */ 3, /* SUB_LL_NUM */ 3, /* MUL_LL_NUM */
+	3, /* DIV_LL_NUM */ 3, /* MOD_LL_NUM */
+	3, /* MOD_LL_INT */ 3, /* MOD_LI_INT */
 
 	1, /* IS_TRUE_L */ 1, /* IS_FALSE_L */
 	2, /* EQ_LL */ 2, /* EQ_LI */ 2, /* EQ_LN */ 2, /* EQ_LS */ 2, /* EQ_LP */
@@ -92,15 +120,33 @@ static uint32_t argument_count[] = {
 	2, /* GT_LL */ 2, /* GT_LI */ 2, /* GT_LN */
 	2, /* GE_LL */ 2, /* GE_LI */ 2, /* GE_LN */
 
-	1, /* JMP */ 1, /* LOOP */
-	3, /* CALL */ 0, /* RET0 */ 2, /* RET_L */ 2, /* RET_I */ 2, /* RET_N */
+	3, /* IS_TRUE_L_JMP */ 3, /* IS_FALSE_L_JMP */
+	3, /* EQ_LL_JMP */ 3, /* EQ_LI_JMP */ 3, /* EQ_LN_JMP */
+	3, /* EQ_LS_JMP */ 3, /* EQ_LP_JMP */ 3, /* EQ_LF_JMP */
+	3, /* EQ_LV_JMP */
+	3, /* NEQ_LL_JMP */ 3, /* NEQ_LI_JMP */ 3, /* NEQ_LN_JMP */
+	3, /* NEQ_LS_JMP */ 3, /* NEQ_LP_JMP */ 3, /* NEQ_LF_JMP */
+	3, /* NEQ_LV_JMP */
+	3, /* LT_LL_JMP */ 3, /* LT_LI_JMP */ 3, /* LT_LN_JMP */
+	3, /* LE_LL_JMP */ 3, /* LE_LI_JMP */ 3, /* LE_LN_JMP */
+	3, /* GT_LL_JMP */ 3, /* GT_LI_JMP */ 3, /* GT_LN_JMP */
+	3, /* GE_LL_JMP */ 3, /* GE_LI_JMP */ 3, /* GE_LN_JMP */
+
+	1, /* JMP */ 1, /* LOOP */ 2, /* FOR_PREP */ 2, /* FOR_LOOP */
+	2, /* FOR_ARRAY_PREP */ 2, /* FOR_ARRAY_LOOP */
+	3, /* CLOSURE_NEW */ 3, /* CALL */ 3, /* CALL_FIELD */ 3, /* TAIL_CALL */
+	0, /* RET0 */ 2, /* RET_L */ 2, /* RET_I */ 2, /* RET_N */
 	2, /* RET_S */ 2, /* RET_P */ 2, /* RET_F */ 2, /* RET_V */
 
-	2, /* STRUCT_NEW */ 2, /* NATIVE_STRUCT_NEW */
+	3, /* STRUCT_NEW */ 3, /* NATIVE_STRUCT_NEW */
 	3, /* STRUCT_CALL_CONSTRUCTOR */ 3, /* STRUCT_FIELD */
 	3, /* STRUCT_SET_L */ 3, /* STRUCT_SET_I */ 3, /* STRUCT_SET_N */
 	3, /* STRUCT_SET_S */ 3, /* STRUCT_SET_P */ 3, /* STRUCT_SET_F */
 	3, /* STRUCT_SET_V */
+	2, /* SELF_FIELD */
+	2, /* SELF_SET_L */ 2, /* SELF_SET_I */ 2, /* SELF_SET_N */
+	2, /* SELF_SET_S */ 2, /* SELF_SET_P */ 2, /* SELF_SET_F */
+	2, /* SELF_SET_V */
 
 	2, /* ARRAY_NEW */
 	3, /* ARRAY_GET_L */ 3, /* ARRAY_GET_I */
@@ -110,6 +156,11 @@ static uint32_t argument_count[] = {
 	3, /* ARRAY_L_SET_L */ 3, /* ARRAY_L_SET_I */ 3, /* ARRAY_L_SET_N */
 	3, /* ARRAY_L_SET_S */ 3, /* ARRAY_L_SET_P */ 3, /* ARRAY_L_SET_F */
 	3, /* ARRAY_L_SET_V */
+	3, /* ARRAY_SLICE */
+
+	2, /* MAP_NEW */ 3, /* MAP_GET */
+	3, /* MAP_SET_L */ 3, /* MAP_SET_I */ 3, /* MAP_SET_N */ 3, /* MAP_SET_S */
+	3, /* MAP_SET_P */ 3, /* MAP_SET_F */ 3, /* MAP_SET_V */
 
 	0, /* NO_OP */
 };
@@ -129,6 +180,8 @@ static uint32_t integer_argument[] = {
 	0, /* MOV_TL */ 2, /* MOV_TI */ 0, /* MOV_TN */ 0, /* MOV_TS */
 	0, /* MOV_TP */ 0, /* MOV_TF */ 0, /* MOV_TV */
 	0, /* MOV_LT */ 0, /* MOV_SELF */
+	0, /* MOV_LN_WIDE */ 0, /* MOV_LS_WIDE */ 0, /* MOV_LF_WIDE */
+	0, /* MOV_LV_WIDE */
 
 	0, /* ADD_LL */ 3, /* ADD_LI */ 0, /* ADD_LN */ 2, /* ADD_IL */
 	0, /* ADD_NL */
@@ -142,25 +195,47 @@ static uint32_t integer_argument[] = {
 	0, /* MOD_NL */
 	0, /* CONCAT_LL */ 0, /* CONCAT_LS */ 0, /* CONCAT_SL */
 	0, /* NEG_L */
+	0, /* ADD_LL_NUM */ 0, /* SUB_LL_NUM */ 0, /* MUL_LL_NUM */
+	0, /* DIV_LL_NUM */ 0, /* MOD_LL_NUM */
+	0, /* MOD_LL_INT */ 3, /* MOD_LI_INT */
 
 	0, /* IS_TRUE_L */ 0, /* IS_FALSE_L */
 	0, /* EQ_LL */ 2, /* EQ_LI */ 0, /* EQ_LN */ 0, /* EQ_LS */ 0, /* EQ_LP */
-	0, /* EQ_LF */
+	0, /* EQ_LF */ 0, /* EQ_LV */
 	0, /* NEQ_LL */ 2, /* NEQ_LI */ 0, /* NEQ_LN */ 0, /* NEQ_LS */
-	0, /* NEQ_LP */ 0, /* NEQ_LF */
+	0, /* NEQ_LP */ 0, /* NEQ_LF */ 0, /* NEQ_LV */
 	0, /* LT_LL */ 2, /* LT_LI */ 0, /* LT_LN */
 	0, /* LE_LL */ 2, /* LE_LI */ 0, /* LE_LN */
 	0, /* GT_LL */ 2, /* GT_LI */ 0, /* GT_LN */
 	0, /* GE_LL */ 2, /* GE_LI */ 0, /* GE_LN */
 
-	0, /* JMP */ 0, /* LOOP */
-	0, /* CALL */ 0, /* RET0 */ 0, /* RET */
+	0, /* IS_TRUE_L_JMP */ 0, /* IS_FALSE_L_JMP */
+	0, /* EQ_LL_JMP */ 2, /* EQ_LI_JMP */ 0, /* EQ_LN_JMP */
+	0, /* EQ_LS_JMP */ 0, /* EQ_LP_JMP */ 0, /* EQ_LF_JMP */
+	0, /* EQ_LV_JMP */
+	0, /* NEQ_LL_JMP */ 2, /* NEQ_LI_JMP */ 0, /* NEQ_LN_JMP */
+	0, /* NEQ_LS_JMP */ 0, /* NEQ_LP_JMP */ 0, /* NEQ_LF_JMP */
+	0, /* NEQ_LV_JMP */
+	0, /* LT_LL_JMP */ 2, /* LT_LI_JMP */ 0, /* LT_LN_JMP */
+	0, /* LE_LL_JMP */ 2, /* LE_LI_JMP */ 0, /* LE_LN_JMP */
+	0, /* GT_LL_JMP */ 2, /* GT_LI_JMP */ 0, /* GT_LN_JMP */
+	0, /* GE_LL_JMP */ 2, /* GE_LI_JMP */ 0, /* GE_LN_JMP */
+
+	0, /* JMP */ 0, /* LOOP */ 0, /* FOR_PREP */ 0, /* FOR_LOOP */
+	0, /* FOR_ARRAY_PREP */ 0, /* FOR_ARRAY_LOOP */
+	0, /* CLOSURE_NEW */ 0, /* CALL */ 0, /* CALL_FIELD */ 0, /* TAIL_CALL */
+	0, /* RET0 */ 0, /* RET_L */ 2, /* RET_I */ 0, /* RET_N */
+	0, /* RET_S */ 0, /* RET_P */ 0, /* RET_F */ 0, /* RET_V */
 
 	0, /* STRUCT_NEW */ 0, /* NATIVE_STRUCT_NEW */
 	0, /* STRUCT_CALL_CONSTRUCTOR */ 0, /* STRUCT_FIELD */
 	0, /* STRUCT_SET_L */ 2, /* STRUCT_SET_I */ 0, /* STRUCT_SET_N */
 	0, /* STRUCT_SET_S */ 0, /* STRUCT_SET_P */ 0, /* STRUCT_SET_F */
 	0, /* STRUCT_SET_V */
+	0, /* SELF_FIELD */
+	0, /* SELF_SET_L */ 2, /* SELF_SET_I */ 0, /* SELF_SET_N */
+	0, /* SELF_SET_S */ 0, /* SELF_SET_P */ 0, /* SELF_SET_F */
+	0, /* SELF_SET_V */
 
 	0, /* ARRAY_NEW */
 	0, /* ARRAY_GET_L */ 0, /* ARRAY_GET_I */
@@ -170,6 +245,11 @@ static uint32_t integer_argument[] = {
 	0, /* ARRAY_L_SET_L */ 2, /* ARRAY_L_SET_I */ 0, /* ARRAY_L_SET_N */
 	0, /* ARRAY_L_SET_S */ 0, /* ARRAY_L_SET_P */ 0, /* ARRAY_L_SET_F */
 	0, /* ARRAY_L_SET_V */
+	0, /* ARRAY_SLICE */
+
+	0, /* MAP_NEW */ 0, /* MAP_GET */
+	0, /* MAP_SET_L */ 2, /* MAP_SET_I */ 0, /* MAP_SET_N */ 0, /* MAP_SET_S */
+	0, /* MAP_SET_P */ 0, /* MAP_SET_F */ 0, /* MAP_SET_V */
 
 	0, /* NO_OP */
 };
@@ -237,13 +317,21 @@ static void print_number(HyState *state, uint32_t index) {
 
 // Print a string, using an index into the interpreter state's strings list.
 static void print_string(HyState *state, uint32_t index) {
-	printf("    ; \"%s\"", vec_at(state->strings, index));
+	printf("    ; \"%s\"", vec_at(state->strings, index)->contents);
 }
 
 
 // Print useful information about the arguments to an instruction.
 static void print_info(HyState *state, Index ins_index, Instruction ins) {
 	BytecodeOpcode opcode = ins_arg(ins, 0);
+
+	// Fused comparisons have the same information as their unfused
+	// counterparts, followed by their jump destination
+	if (jmp_is_fused(opcode)) {
+		print_info(state, ins_index, ins_set(ins, 0, jmp_unfused(opcode)));
+		printf("    => %d", ins_index + ins_arg(ins, 3));
+		return;
+	}
 	switch (opcode) {
 		// Numbers (value we want is the second argument)
 	case MOV_LN:
@@ -261,6 +349,7 @@ static void print_info(HyState *state, Index ins_index, Instruction ins) {
 	case GT_LN:
 	case GE_LN:
 	case STRUCT_SET_N:
+	case SELF_SET_N:
 		print_number(state, ins_arg(ins, 2));
 		break;
 
@@ -281,6 +370,7 @@ static void print_info(HyState *state, Index ins_index, Instruction ins) {
 	case NEQ_LS:
 	case CONCAT_SL:
 	case STRUCT_SET_S:
+	case SELF_SET_S:
 		print_string(state, ins_arg(ins, 2));
 		break;
 
@@ -293,7 +383,8 @@ static void print_info(HyState *state, Index ins_index, Instruction ins) {
 	case MOV_LF:
 	case MOV_UF:
 	case MOV_TF:
-	case STRUCT_SET_F: {
+	case STRUCT_SET_F:
+	case SELF_SET_F: {
 		Function *fn = &vec_at(state->functions, ins_arg(ins, 2));
 		printf("    ; ");
 		print_location(state, fn->source, fn->line);
@@ -304,7 +395,8 @@ static void print_info(HyState *state, Index ins_index, Instruction ins) {
 	case MOV_LV:
 	case MOV_UV:
 	case MOV_TV:
-	case STRUCT_SET_V: {
+	case STRUCT_SET_V:
+	case SELF_SET_V: {
 		NativeFunction *native = &vec_at(state->native_fns, ins_arg(ins, 2));
 		Package *pkg = &vec_at(state->packages, native->package);
 		printf("    ; `%s.%s`", pkg->name, native->name);
@@ -345,6 +437,12 @@ static void print_info(HyState *state, Index ins_index, Instruction ins) {
 		printf("    ; <%d>.%.*s", ins_arg(ins, 1), field->length, field->name);
 		break;
 	}
+	case CALL_FIELD: {
+		Identifier *field = &vec_at(state->fields, ins_arg(ins, 3));
+		printf("    ; <%d>.%.*s()", ins_arg(ins, 1), field->length,
+			field->name);
+		break;
+	}
 
 	default:
 		break;
@@ -406,8 +504,11 @@ static HyError * parse_and_print_bytecode(HyState *state, Index index,
 		return err;
 	}
 
-	// Print new function definitions
+	// Print new function definitions, as they'd be executed
 	for (uint32_t i = functions_length; i < vec_len(state->functions); i++) {
+		if (state->optimise) {
+			opt_fn(&vec_at(state->functions, i));
+		}
 		debug_fn(state, &vec_at(state->functions, i));
 		if (i < vec_len(state->functions) - 1) {
 			printf("\n");
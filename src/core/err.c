@@ -265,3 +265,20 @@ void err_trigger(Error *err) {
 	// Jump back to the error guard
 	longjmp(state->error_jmp, 1);
 }
+
+
+// Report an error from inside a native function. The function should return
+// straight away, and execution stops once it does. Only the first error
+// reported by a function is kept.
+void err_native(HyState *state, char *fmt, ...) {
+	if (state->error != NULL) {
+		return;
+	}
+
+	Error err = err_new(state);
+	va_list args;
+	va_start(args, fmt);
+	err_print_va(&err, fmt, args);
+	va_end(args);
+	state->error = err_make(&err);
+}
@@ -55,4 +55,9 @@ HyError * err_make(Error *err);
 // any resources allocated during error construction.
 void err_trigger(Error *err);
 
+// Report an error from inside a native function. The function should return
+// straight away, and execution stops once it does. Only the first error
+// reported by a function is kept.
+void err_native(HyState *state, char *fmt, ...);
+
 #endif
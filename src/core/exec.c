@@ -7,21 +7,57 @@
 
 #include "exec.h"
 #include "debug.h"
+#include "jit.h"
+#include "err.h"
+#include "map.h"
 
 
-// Trigger the goto call for the next instruction.
-#define DISPATCH() goto *dispatch_table[INS(0)];
+// Trigger the goto call for the next instruction. Each instruction in a
+// function's threaded code stores the address of its handler directly.
+#define DISPATCH() goto *ip->handler;
 
 // Increment the instruction pointer and dispatches the next instruction.
 #define NEXT() ip++; DISPATCH();
 
 // Will evaluate to the `n`th argument of the current instruction.
-#define INS(n) (ins_arg(*ip, (n)))
+#define INS(n) (ip->args[(n)])
+
+// Will evaluate to the 32 bit index split across the `n`th (lower 16 bits) and
+// following (upper 16 bits) arguments of the current instruction.
+#define INS_WIDE(n) (INS(n) | ((uint32_t) INS((n) + 1) << 16))
 
 // Will evaluates to the value in the `n`th stack slot, relative to the current
 // function's stack start.
 #define STACK(n) stack[stack_start + (n)]
 
+// Will evaluate to a pointer to the inline cache for the current instruction.
+#define FIELD_CACHE() (&fn->caches[ip - fn->code])
+
+// Will evaluate to a pointer to the call cache for the current instruction.
+#define CALL_CACHE() (&fn->call_caches[ip - fn->code])
+
+// Quicken the current instruction in place into the instruction `opcode`.
+#define QUICKEN(opcode)     \
+	ip->args[0] = (opcode); \
+	ip->handler = dispatch_table[(opcode)];
+
+// Abort any trace still being recorded, and stop threading the function
+// containing its loop through the recorder.
+#define RECORD_STOP()                                                   \
+	if (state->jit.recording != NOT_FOUND) {                            \
+		JitLoop *loop = &vec_at(state->jit.loops, state->jit.recording); \
+		fn_thread(&functions[loop->fn], dispatch_table);                \
+		jit_record_abort(state, "execution finished");                  \
+	}
+
+// Trigger a garbage collection if enough memory has been allocated since the
+// last one. Only used at the start of instructions that allocate, where every
+// live value is guaranteed to be stored somewhere the collector can find it.
+#define GC_CHECK()                                           \
+	if (gc_should_collect(&state->gc)) {                     \
+		gc_collect(state, stack_start + fn->frame_size + 1); \
+	}
+
 
 // Ensure a value is a number, triggering an error if this is not the case.
 static inline double ensure_num(HyValue value) {
@@ -45,77 +81,325 @@ static inline String * ensure_str(HyValue value) {
 }
 
 
+// Return the length of an array or float array being iterated over by a for
+// loop.
+static inline uint32_t iterated_length(Object *array) {
+	if (array->type == OBJ_ARRAY) {
+		return ((Array *) array)->length;
+	}
+	return ((FloatArray *) array)->length;
+}
+
+
+// Return the element at `index` in an array or float array being iterated over
+// by a for loop.
+static inline HyValue iterated_element(Object *array, uint32_t index) {
+	if (array->type == OBJ_ARRAY) {
+		return ((Array *) array)->contents[index];
+	}
+	return num_to_val(((FloatArray *) array)->contents[index]);
+}
+
+
+// Returns true if a number is an integer that fits into 32 bits.
+static inline bool num_is_int(double number) {
+	return number >= INT32_MIN && number <= INT32_MAX &&
+		number == (double) (int32_t) number;
+}
+
+
+// Returns true if the remainder of two values can be calculated using integer
+// division (ie. both are integers, and the divisor is positive).
+static inline bool mod_is_int(HyValue left, HyValue right) {
+	return val_is_num(left) && val_is_num(right) &&
+		num_is_int(val_to_num(left)) && num_is_int(val_to_num(right)) &&
+		val_to_num(right) > 0;
+}
+
+
+// Calculate the remainder of two integers (see `mod_is_int`) using integer
+// division. Gives the same result as `fmod`, including the sign of a zero
+// result.
+static inline HyValue mod_int(HyValue left, HyValue right) {
+	double dividend = val_to_num(left);
+	int32_t remainder = (int32_t) dividend % (int32_t) val_to_num(right);
+	return num_to_val(copysign((double) remainder, dividend));
+}
+
+
+// Return the opcode a generic arithmetic instruction on two locals should be
+// quickened into, given its operands, or NO_OP if it can't be quickened.
+static inline BytecodeOpcode arith_quicken(BytecodeOpcode opcode,
+		HyValue left, HyValue right) {
+	if (opcode == MOD_LL && mod_is_int(left, right)) {
+		return MOD_LL_INT;
+	} else if (val_is_num(left) && val_is_num(right)) {
+		return (BytecodeOpcode) (ADD_LL_NUM + (opcode - ADD_LL) / 5);
+	}
+	return NO_OP;
+}
+
+
 // Create a new instance of a struct.
-static inline HyValue struct_instantiate(StructDefinition *structs,
-		uint16_t index) {
+static inline HyValue struct_instantiate(HyState *state,
+		StructDefinition *structs, Index index) {
 	StructDefinition *def = &structs[index];
 
 	// Create the instance
 	uint32_t fields_size = sizeof(HyValue) * vec_len(def->fields);
-	Struct *instance = malloc(sizeof(Struct) + fields_size);
-	instance->type = OBJ_STRUCT;
+	Struct *instance = gc_alloc(state, OBJ_STRUCT,
+		sizeof(Struct) + fields_size);
 	instance->definition = index;
 	instance->fields_count = vec_len(def->fields);
 
-	// Set the instance's fields
-	HyValue parent = ptr_to_val(instance);
-	for (uint32_t i = 0; i < vec_len(def->fields); i++) {
-		Index fn_index = vec_at(def->methods, i);
-
-		// Check if the field is a method on the struct
-		if (fn_index != NOT_FOUND) {
-			// Create the method
-			Method *method = malloc(sizeof(Method));
-			method->type = OBJ_METHOD;
-			method->parent = parent;
-			method->fn = fn_index;
-
-			// Set the field
-			instance->fields[i] = ptr_to_val(method);
+	// Methods aren't stored on the instance, so every field starts as nil
+	for (uint32_t i = 0; i < instance->fields_count; i++) {
+		instance->fields[i] = VALUE_NIL;
+	}
+
+	return ptr_to_val(instance);
+}
+
+
+// Create a method bound to the struct instance `parent`, which calls the
+// function at `fn_index`.
+static inline HyValue method_bind(HyState *state, HyValue parent,
+		Index fn_index) {
+	Method *method = gc_alloc(state, OBJ_METHOD, sizeof(Method));
+	method->parent = parent;
+	method->fn = fn_index;
+	return ptr_to_val(method);
+}
+
+
+// Return the open upvalue referring to the absolute stack position `slot`,
+// creating one if the local hasn't been captured yet.
+static HyValue upvalue_capture(HyState *state, uint32_t slot) {
+	// Open upvalues are sorted by slot, and the most recently defined locals
+	// are usually the ones being captured, so search from the end
+	uint32_t position = vec_len(state->upvalues);
+	while (position > 0) {
+		Upvalue *upvalue = val_to_ptr(vec_at(state->upvalues, position - 1));
+		if (upvalue->slot == slot) {
+			return ptr_to_val(upvalue);
+		} else if (upvalue->slot < slot) {
+			break;
+		}
+		position--;
+	}
+
+	// Create a new upvalue
+	Upvalue *upvalue = gc_alloc(state, OBJ_UPVALUE, sizeof(Upvalue));
+	upvalue->open = true;
+	upvalue->slot = slot;
+	upvalue->value = VALUE_NIL;
+
+	// Insert it into the list of open upvalues, keeping it sorted
+	vec_inc(state->upvalues);
+	HyValue *upvalues = &vec_at(state->upvalues, 0);
+	memmove(&upvalues[position + 1], &upvalues[position],
+		sizeof(HyValue) * (vec_len(state->upvalues) - position - 1));
+	upvalues[position] = ptr_to_val(upvalue);
+	return upvalues[position];
+}
+
+
+// Close every open upvalue referring to an absolute stack position at or above
+// `slot`, moving the value of the local it refers to into it.
+static void upvalues_close(HyState *state, uint32_t slot) {
+	while (vec_len(state->upvalues) > 0) {
+		Upvalue *upvalue = val_to_ptr(vec_last(state->upvalues));
+		if (upvalue->slot < slot) {
+			break;
+		}
+
+		upvalue->open = false;
+		upvalue->value = state->stack[upvalue->slot];
+		gc_write_barrier(&state->gc, upvalue, upvalue->value);
+		vec_len(state->upvalues)--;
+	}
+}
+
+
+// Create a closure for the function at `fn_index`, capturing its upvalues from
+// the locals of the function whose stack starts at `stack_start`, from the
+// closure `parent` being executed by that function, or from its `self`.
+static inline HyValue closure_new(HyState *state, Function *functions,
+		Index fn_index, uint32_t stack_start, HyValue parent, HyValue self) {
+	Function *fn = &functions[fn_index];
+	uint32_t count = vec_len(fn->captures);
+	Closure *closure = gc_alloc(state, OBJ_CLOSURE,
+		sizeof(Closure) + sizeof(HyValue) * count);
+	closure->fn = fn_index;
+	closure->upvalues_count = count;
+
+	for (uint32_t i = 0; i < count; i++) {
+		Capture *capture = &vec_at(fn->captures, i);
+		if (capture->type == CAPTURE_LOCAL) {
+			closure->upvalues[i] =
+				upvalue_capture(state, stack_start + capture->index);
+		} else if (capture->type == CAPTURE_UPVALUE) {
+			Closure *enclosing = val_to_ptr(parent);
+			closure->upvalues[i] = enclosing->upvalues[capture->index];
 		} else {
-			// If it's not a method, set the field to nil
-			instance->fields[i] = VALUE_NIL;
+			Upvalue *upvalue = gc_alloc(state, OBJ_UPVALUE, sizeof(Upvalue));
+			upvalue->open = false;
+			upvalue->value = self;
+			closure->upvalues[i] = ptr_to_val(upvalue);
 		}
+		gc_write_barrier(&state->gc, closure, closure->upvalues[i]);
 	}
+	return ptr_to_val(closure);
+}
 
-	return ptr_to_val(instance);
+
+// Return the upvalue at `index` in the closure being executed by the
+// function at the top of the call stack.
+static inline Upvalue * upvalue_get(Frame *call_stack,
+		uint32_t call_stack_count, uint16_t index) {
+	Closure *closure = val_to_ptr(call_stack[call_stack_count - 1].closure);
+	return val_to_ptr(closure->upvalues[index]);
+}
+
+
+// Search a struct definition for a field, after missing the inline cache
+// `cache`. Adds the field to the front of the cache if it's found, evicting
+// the oldest entry if the cache is full.
+static Index struct_slot_miss(StructDefinition *structs, FieldCache *cache,
+		Index definition, Identifier *field) {
+	StructDefinition *def = &structs[definition];
+	Index slot = struct_field_find(def, field->name, field->length);
+	if (slot == NOT_FOUND) {
+		slot = struct_method_find(def, field->name, field->length);
+		if (slot == NOT_FOUND) {
+			return NOT_FOUND;
+		}
+		slot |= FIELD_CACHE_METHOD;
+	}
+
+	// Shift every entry along by one to make room for the new one
+	for (uint32_t i = FIELD_CACHE_SIZE - 1; i > 0; i--) {
+		cache->definitions[i] = cache->definitions[i - 1];
+		cache->slots[i] = cache->slots[i - 1];
+	}
+	cache->definitions[0] = definition;
+	cache->slots[0] = slot;
+	return slot;
+}
+
+
+// Return the index of the field named `field` on instances of a struct, using
+// the inline cache `cache` if the field has been looked up on this struct
+// before. If the name refers to a method, then the method's index is returned
+// with FIELD_CACHE_METHOD set. Returns NOT_FOUND if no such field or method
+// exists.
+static inline Index struct_slot_find(StructDefinition *structs,
+		FieldCache *cache, Index definition, Identifier *field) {
+	for (uint32_t i = 0; i < FIELD_CACHE_SIZE; i++) {
+		if (cache->definitions[i] == definition) {
+			return cache->slots[i];
+		}
+	}
+	return struct_slot_miss(structs, cache, definition, field);
+}
+
+
+// Fill a call cache with the function to call for `callee`, if it's a
+// Hydrogen function, method, or closure. Returns false for any other value,
+// leaving the cache unchanged.
+static inline bool call_cache_fill(HyState *state, CallCache *cache,
+		HyValue callee) {
+	if (val_is_fn(callee, TAG_FN)) {
+		cache->fn = val_to_fn(callee, TAG_FN);
+		cache->self = VALUE_NIL;
+		cache->closure = VALUE_NIL;
+	} else if (val_is_gc(callee, OBJ_METHOD)) {
+		Method *method = (Method *) val_to_ptr(callee);
+		cache->fn = method->fn;
+		cache->self = method->parent;
+		cache->closure = VALUE_NIL;
+	} else if (val_is_gc(callee, OBJ_CLOSURE)) {
+		cache->fn = ((Closure *) val_to_ptr(callee))->fn;
+		cache->self = VALUE_NIL;
+		cache->closure = callee;
+	} else {
+		return false;
+	}
+	cache->callee = callee;
+	cache->collections = state->gc.collections;
+	return true;
 }
 
 
 // Create a new instance of a native struct. Doesn't create the methods on the
 // struct until the constructor has been called.
-static inline HyValue native_struct_instantiate(NativeStructDefinition *structs,
-		uint16_t index) {
+static inline HyValue native_struct_instantiate(HyState *state,
+		NativeStructDefinition *structs, Index index) {
 	NativeStructDefinition *def = &structs[index];
 
 	// Create the instance
 	uint32_t methods_size = sizeof(HyValue) * vec_len(def->methods);
-	NativeStruct *instance = malloc(sizeof(NativeStruct) + methods_size);
-	instance->type = OBJ_NATIVE_STRUCT;
+	NativeStruct *instance = gc_alloc(state, OBJ_NATIVE_STRUCT,
+		sizeof(NativeStruct) + methods_size);
 	instance->definition = index;
+	instance->data = NULL;
 	instance->methods_count = vec_len(def->methods);
+
+	// The instance might be garbage collected before its constructor is called,
+	// so its methods can't be left uninitialised
+	for (uint32_t i = 0; i < instance->methods_count; i++) {
+		instance->methods[i] = VALUE_NIL;
+	}
 	return ptr_to_val(instance);
 }
 
 
 // Set the methods on an instance of a native struct, after its native
 // constructor has been called.
-static inline void native_struct_construct(NativeStructDefinition *def,
-		NativeStruct *instance, void *data) {
+static inline void native_struct_construct(HyState *state,
+		NativeStructDefinition *def, NativeStruct *instance, void *data) {
+	instance->data = data;
+
 	// For each method in the definition
 	for (uint32_t i = 0; i < vec_len(def->methods); i++) {
 		NativeMethodDefinition *method_def = &vec_at(def->methods, i);
 
 		// Create the method
-		NativeMethod *method = malloc(sizeof(NativeMethod));
+		NativeMethod *method = gc_alloc(state, OBJ_NATIVE_METHOD,
+			sizeof(NativeMethod));
 
 		// Set the method's properties
-		method->type = OBJ_NATIVE_METHOD;
-		method->data = data;
+		method->parent = ptr_to_val(instance);
 		method->arity = method_def->arity;
 		method->fn = method_def->fn;
 		instance->methods[i] = ptr_to_val(method);
+		gc_write_barrier(&state->gc, instance, instance->methods[i]);
+	}
+}
+
+
+// Create a native method from a core method definition, bound to the object
+// `receiver`.
+static inline HyValue core_method_bind(HyState *state, HyValue receiver,
+		CoreMethod *def) {
+	NativeMethod *method = gc_alloc(state, OBJ_NATIVE_METHOD,
+		sizeof(NativeMethod));
+	method->parent = receiver;
+	method->arity = def->arity;
+	method->fn = def->fn;
+	return ptr_to_val(method);
+}
+
+
+// Return the data pointer to pass to a native method when it's called. For
+// native structs this is the struct's user data, and for methods on core types
+// it's the object itself.
+static inline void * native_method_data(NativeMethod *method) {
+	Object *parent = val_to_ptr(method->parent);
+	if (parent->type == OBJ_NATIVE_STRUCT) {
+		return ((NativeStruct *) parent)->data;
 	}
+	return parent;
 }
 
 
@@ -132,6 +416,7 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 		&&BC_MOV_LU, &&BC_UPVALUE_CLOSE,
 		&&BC_MOV_TL, &&BC_MOV_TI, &&BC_MOV_TN, &&BC_MOV_TS, &&BC_MOV_TP,
 		&&BC_MOV_TF, &&BC_MOV_TV, &&BC_MOV_LT, &&BC_MOV_SELF,
+		&&BC_MOV_LN_WIDE, &&BC_MOV_LS_WIDE, &&BC_MOV_LF_WIDE, &&BC_MOV_LV_WIDE,
 
 		// Operators
 		&&BC_ADD_LL, &&BC_ADD_LI, &&BC_ADD_LN, &&BC_ADD_IL, &&BC_ADD_NL,
@@ -142,6 +427,10 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 		&&BC_CONCAT_LL, &&BC_CONCAT_LS, &&BC_CONCAT_SL,
 		&&BC_NEG_L,
 
+		// Quickened arithmetic
+		&&BC_ADD_LL_NUM, &&BC_SUB_LL_NUM, &&BC_MUL_LL_NUM, &&BC_DIV_LL_NUM,
+		&&BC_MOD_LL_NUM, &&BC_MOD_LL_INT, &&BC_MOD_LI_INT,
+
 		// Comparison
 		&&BC_IS_TRUE_L, &&BC_IS_FALSE_L,
 		&&BC_EQ_LL, &&BC_EQ_LI, &&BC_EQ_LN, &&BC_EQ_LS, &&BC_EQ_LP, &&BC_EQ_LF,
@@ -153,11 +442,24 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 		&&BC_GT_LL, &&BC_GT_LI, &&BC_GT_LN,
 		&&BC_GE_LL, &&BC_GE_LI, &&BC_GE_LN,
 
+		// Fused comparisons
+		&&BC_IS_TRUE_L_JMP, &&BC_IS_FALSE_L_JMP,
+		&&BC_EQ_LL_JMP, &&BC_EQ_LI_JMP, &&BC_EQ_LN_JMP, &&BC_EQ_LS_JMP,
+		&&BC_EQ_LP_JMP, &&BC_EQ_LF_JMP, &&BC_EQ_LV_JMP,
+		&&BC_NEQ_LL_JMP, &&BC_NEQ_LI_JMP, &&BC_NEQ_LN_JMP, &&BC_NEQ_LS_JMP,
+		&&BC_NEQ_LP_JMP, &&BC_NEQ_LF_JMP, &&BC_NEQ_LV_JMP,
+		&&BC_LT_LL_JMP, &&BC_LT_LI_JMP, &&BC_LT_LN_JMP,
+		&&BC_LE_LL_JMP, &&BC_LE_LI_JMP, &&BC_LE_LN_JMP,
+		&&BC_GT_LL_JMP, &&BC_GT_LI_JMP, &&BC_GT_LN_JMP,
+		&&BC_GE_LL_JMP, &&BC_GE_LI_JMP, &&BC_GE_LN_JMP,
+
 		// Control flow
-		&&BC_JMP, &&BC_LOOP,
+		&&BC_JMP, &&BC_LOOP, &&BC_FOR_PREP, &&BC_FOR_LOOP,
+		&&BC_FOR_ARRAY_PREP, &&BC_FOR_ARRAY_LOOP,
 
 		// Function calls
-		&&BC_CALL, &&BC_RET0, &&BC_RET_L, &&BC_RET_I, &&BC_RET_N, &&BC_RET_S,
+		&&BC_CLOSURE_NEW, &&BC_CALL, &&BC_CALL_FIELD, &&BC_TAIL_CALL,
+		&&BC_RET0, &&BC_RET_L, &&BC_RET_I, &&BC_RET_N, &&BC_RET_S,
 		&&BC_RET_P, &&BC_RET_F, &&BC_RET_V,
 
 		// Structs
@@ -166,6 +468,9 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 		&&BC_STRUCT_SET_L, &&BC_STRUCT_SET_I, &&BC_STRUCT_SET_N,
 		&&BC_STRUCT_SET_S, &&BC_STRUCT_SET_P, &&BC_STRUCT_SET_F,
 		&&BC_STRUCT_SET_V,
+		&&BC_SELF_FIELD,
+		&&BC_SELF_SET_L, &&BC_SELF_SET_I, &&BC_SELF_SET_N, &&BC_SELF_SET_S,
+		&&BC_SELF_SET_P, &&BC_SELF_SET_F, &&BC_SELF_SET_V,
 
 		// Arrays
 		&&BC_ARRAY_NEW,
@@ -176,7 +481,21 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 		&&BC_ARRAY_L_SET_L, &&BC_ARRAY_L_SET_I, &&BC_ARRAY_L_SET_N,
 		&&BC_ARRAY_L_SET_S, &&BC_ARRAY_L_SET_P, &&BC_ARRAY_L_SET_F,
 		&&BC_ARRAY_L_SET_V,
+		&&BC_ARRAY_SLICE,
+
+		// Maps
+		&&BC_MAP_NEW, &&BC_MAP_GET,
+		&&BC_MAP_SET_L, &&BC_MAP_SET_I, &&BC_MAP_SET_N, &&BC_MAP_SET_S,
+		&&BC_MAP_SET_P, &&BC_MAP_SET_F, &&BC_MAP_SET_V,
+	};
+
+	// While the JIT is recording a trace, every instruction in the function
+	// containing the loop is threaded through the recorder before it's
+	// executed
+	static void *record_table[] = {
+		[0 ... NO_OP] = &&RECORD,
 	};
+	bool jit_enabled = state->jit.enabled;
 
 	// Cache pointers to arrays on the interpreter state
 	Package *packages = &vec_at(state->packages, 0);
@@ -186,19 +505,31 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 	NativeStructDefinition *native_structs = &vec_at(state->native_structs, 0);
 	Identifier *fields = &vec_at(state->fields, 0);
 	HyValue *constants = &vec_at(state->constants, 0);
-	char **strings = &vec_at(state->strings, 0);
+	String **strings = &vec_at(state->strings, 0);
+
+	// Get a pointer to the function we're executing
+	Function *fn = &functions[fn_index];
+	// debug_fn(state, fn);
+
+	// Make room on the stack for the function's locals
+	state->call_stack_count = 0;
+	if (!state_grow_stacks(state, 1, fn->frame_size + 1)) {
+		goto stack_overflow;
+	}
 
 	HyValue *stack = state->stack;
 	Frame *call_stack = state->call_stack;
 	uint32_t *call_stack_count = &state->call_stack_count;
-	*call_stack_count = 0;
 
-	// Get a pointer to the function we're executing
-	Function *fn = &functions[fn_index];
-	// debug_fn(state, fn);
+	// Build threaded code for every function that hasn't been executed before
+	for (uint32_t i = 0; i < vec_len(state->functions); i++) {
+		if (functions[i].code == NULL) {
+			fn_thread(&functions[i], dispatch_table);
+		}
+	}
 
 	// The current instruction we're executing
-	Instruction *ip = &vec_at(fn->instructions, 0);
+	ThreadedIns *ip = fn->code;
 
 	// The starting location of the current function's local variables on the
 	// stack
@@ -221,7 +552,7 @@ HyError * exec_fn(HyState *state, Index fn_index) {
 	BC_ ## prefix ## N:                               \
 		fn(constants[INS(2)]);                        \
 	BC_ ## prefix ## S:                               \
-		fn(ptr_to_val(string_copy(strings[INS(2)]))); \
+		fn(ptr_to_val(strings[INS(2)]));              \
 	BC_ ## prefix ## P:                               \
 		fn(prim_to_val(INS(2)));                      \
 	BC_ ## prefix ## F:                               \
@@ -241,21 +572,52 @@ BC_MOV_SELF:
 	STACK(INS(1)) = call_stack[*call_stack_count - 1].self;
 	NEXT();
 
+BC_MOV_LN_WIDE:
+	STACK(INS(1)) = constants[INS_WIDE(2)];
+	NEXT();
+
+BC_MOV_LS_WIDE:
+	STACK(INS(1)) = ptr_to_val(strings[INS_WIDE(2)]);
+	NEXT();
+
+BC_MOV_LF_WIDE:
+	STACK(INS(1)) = fn_to_val(INS_WIDE(2), TAG_FN);
+	NEXT();
+
+BC_MOV_LV_WIDE:
+	STACK(INS(1)) = fn_to_val(INS_WIDE(2), TAG_NATIVE);
+	NEXT();
+
 
 	//
 	//  Upvalue Storage
 	//
 
-	// The set function for MOV_U* instructions.
-#define MOV_U(value) \
-	NEXT();
+	// The set function for MOV_U* instructions. Open upvalues store their
+	// value in the stack slot of the local they captured.
+#define MOV_U(new_value) {                                                \
+	HyValue set_value = (new_value);                                      \
+	Upvalue *upvalue = upvalue_get(call_stack, *call_stack_count, INS(1)); \
+	if (upvalue->open) {                                                  \
+		stack[upvalue->slot] = set_value;                                 \
+	} else {                                                              \
+		upvalue->value = set_value;                                       \
+		gc_write_barrier(&state->gc, upvalue, set_value);                 \
+	}                                                                     \
+	NEXT();                                                               \
+}
 
 	// All MOV_U* instructions.
 	SET(MOV_U, MOV_U);
 
-BC_MOV_LU:
+BC_MOV_LU: {
+	Upvalue *upvalue = upvalue_get(call_stack, *call_stack_count, INS(2));
+	STACK(INS(1)) = upvalue->open ? stack[upvalue->slot] : upvalue->value;
 	NEXT();
+}
+
 BC_UPVALUE_CLOSE:
+	upvalues_close(state, stack_start + INS(1));
 	NEXT();
 
 
@@ -282,16 +644,45 @@ BC_MOV_LT:
 
 	// Since arithmetic instructions are all in the same form, use a define to
 	// generate code for each operator.
+	//
+	// Instructions operating on two locals quicken themselves in place into a
+	// specialised form the first time they're executed with two numbers. The
+	// specialised form only checks both operands with a single branch, and
+	// reverts back to the generic instruction (which handles errors) if it's
+	// ever given something else. Remainders of integers (including those with
+	// an integer constant divisor) are quickened into forms that avoid `fmod`.
 #define COMMA ,
 #define ARITH(ins, operator, fn)                         \
-	BC_ ## ins ## _LL:                                   \
+	BC_ ## ins ## _LL: {                                 \
+		BytecodeOpcode quickened = arith_quicken(        \
+			ins ## _LL, STACK(INS(2)), STACK(INS(3)));   \
+		if (quickened != NO_OP) {                        \
+			QUICKEN(quickened);                          \
+		}                                                \
+	}                                                    \
 		STACK(INS(1)) = num_to_val(fn(                   \
 			ensure_num(STACK(INS(2))) operator           \
 			ensure_num(STACK(INS(3)))                    \
 		));                                              \
 		NEXT();                                          \
                                                          \
+	BC_ ## ins ## _LL_NUM:                               \
+		if (!(val_is_num(STACK(INS(2))) &                \
+				val_is_num(STACK(INS(3))))) {            \
+			QUICKEN(ins ## _LL);                         \
+			goto BC_ ## ins ## _LL;                      \
+		}                                                \
+		STACK(INS(1)) = num_to_val(fn(                   \
+			val_to_num(STACK(INS(2))) operator           \
+			val_to_num(STACK(INS(3)))                    \
+		));                                              \
+		NEXT();                                          \
+                                                         \
 	BC_ ## ins ## _LI:                                   \
+		if (ins ## _LI == MOD_LI &&                      \
+				mod_is_int(STACK(INS(2)), int_to_val(INS(3)))) { \
+			QUICKEN(MOD_LI_INT);                         \
+		}                                                \
 		STACK(INS(1)) = num_to_val(fn(                   \
 			ensure_num(STACK(INS(2))) operator           \
 			(double) unsigned_to_signed(INS(3))          \
@@ -325,25 +716,44 @@ BC_MOV_LT:
 	ARITH(DIV, /, );
 	ARITH(MOD, COMMA, fmod);
 
+BC_MOD_LL_INT:
+	if (!mod_is_int(STACK(INS(2)), STACK(INS(3)))) {
+		QUICKEN(MOD_LL);
+		goto BC_MOD_LL;
+	}
+	STACK(INS(1)) = mod_int(STACK(INS(2)), STACK(INS(3)));
+	NEXT();
+
+BC_MOD_LI_INT:
+	if (!mod_is_int(STACK(INS(2)), int_to_val(INS(3)))) {
+		QUICKEN(MOD_LI);
+		goto BC_MOD_LI;
+	}
+	STACK(INS(1)) = mod_int(STACK(INS(2)), int_to_val(INS(3)));
+	NEXT();
+
 
 	//
 	//  Concatenation
 	//
 
 BC_CONCAT_LL:
-	STACK(INS(1)) = ptr_to_val(string_concat(
+	GC_CHECK();
+	STACK(INS(1)) = ptr_to_val(string_concat(state,
 		ensure_str(STACK(INS(2))), ensure_str(STACK(INS(3)))
 	));
 	NEXT();
 
 BC_CONCAT_LS:
-	STACK(INS(1)) = ptr_to_val(string_concat_right(
+	GC_CHECK();
+	STACK(INS(1)) = ptr_to_val(string_concat(state,
 		ensure_str(STACK(INS(2))), strings[INS(3)]
 	));
 	NEXT();
 
 BC_CONCAT_SL:
-	STACK(INS(1)) = ptr_to_val(string_concat_left(
+	GC_CHECK();
+	STACK(INS(1)) = ptr_to_val(string_concat(state,
 		strings[INS(2)], ensure_str(STACK(INS(3)))
 	));
 	NEXT();
@@ -362,70 +772,69 @@ BC_NEG_L:
 	//  Equality
 	//
 
-BC_IS_TRUE_L:
-	if (STACK(INS(1)) == VALUE_FALSE || STACK(INS(1)) == VALUE_NIL) {
-		ip++;
-	}
+	// Comparisons skip the JMP instruction following them if `condition` is
+	// true.
+#define BRANCH(condition) \
+	if (condition) {      \
+		ip++;             \
+	}                     \
 	NEXT();
 
-BC_IS_FALSE_L:
-	if (STACK(INS(1)) != VALUE_FALSE && STACK(INS(1)) != VALUE_NIL) {
-		ip++;
-	}
-	NEXT();
+	// Fused comparisons also skip the following JMP if `condition` is true,
+	// but otherwise jump straight to its target (stored in the comparison's
+	// third argument), so the JMP never has to be dispatched.
+#define BRANCH_JMP(condition) \
+	if (condition) {          \
+		ip += 2;              \
+		DISPATCH();           \
+	}                         \
+	ip += INS(3);             \
+	DISPATCH();
+
+	// Generate the code for the truthiness tests, using `branch` to skip the
+	// following jump. `suffix` is appended to each instruction's name.
+#define TRUTHY(suffix, branch)                                                 \
+	BC_IS_TRUE_L ## suffix:                                                    \
+		branch(STACK(INS(1)) == VALUE_FALSE || STACK(INS(1)) == VALUE_NIL);    \
+                                                                               \
+	BC_IS_FALSE_L ## suffix:                                                   \
+		branch(STACK(INS(1)) != VALUE_FALSE && STACK(INS(1)) != VALUE_NIL);
+
+	TRUTHY(, BRANCH);
+	TRUTHY(_JMP, BRANCH_JMP);
 
 	// Since equality and inequality comparisons are nearly identical, generate
 	// the code for each using a macro.
-#define EQ(ins, op)                                                 \
-	BC_ ## ins ## _LL: {                                            \
-		if (op val_cmp(STACK(INS(1)), STACK(INS(2)))) {             \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-	}                                                               \
-                                                                    \
-	BC_ ## ins ## _LI:                                              \
-		if (op (STACK(INS(1)) == int_to_val(INS(2)))) {             \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-                                                                    \
-	BC_ ## ins ## _LN:                                              \
-		if (op (STACK(INS(1)) == constants[INS(2)])) {              \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-                                                                    \
-	BC_ ## ins ## _LS:                                              \
-		if (op (val_is_gc(STACK(INS(1)), OBJ_STRING) &&             \
-				string_cmp_right(val_to_ptr(STACK(INS(1))),         \
-					strings[INS(2)]))) {                            \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-                                                                    \
-	BC_ ## ins ## _LP:                                              \
-		if (op (STACK(INS(1)) == prim_to_val(INS(2)))) {            \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-                                                                    \
-	BC_ ## ins ## _LF:                                              \
-		if (op (val_to_fn(STACK(INS(1)), TAG_FN) == INS(2))) {      \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();                                                     \
-                                                                    \
-	BC_ ## ins ## _LV:                                              \
-		if (op (val_to_fn(STACK(INS(1)), TAG_NATIVE) == INS(2)))  { \
-			ip++;                                                   \
-		}                                                           \
-		NEXT();
+#define EQ(ins, op, suffix, branch)                                          \
+	BC_ ## ins ## _LL ## suffix:                                             \
+		branch(op val_cmp(STACK(INS(1)), STACK(INS(2))));                    \
+                                                                             \
+	BC_ ## ins ## _LI ## suffix:                                             \
+		branch(op (STACK(INS(1)) == int_to_val(INS(2))));                    \
+                                                                             \
+	BC_ ## ins ## _LN ## suffix:                                             \
+		branch(op (STACK(INS(1)) == constants[INS(2)]));                     \
+                                                                             \
+	BC_ ## ins ## _LS ## suffix:                                             \
+		branch(op (STACK(INS(1)) == ptr_to_val(strings[INS(2)]) ||           \
+			(val_is_gc(STACK(INS(1)), OBJ_STRING) &&                         \
+			string_cmp(val_to_ptr(STACK(INS(1))), strings[INS(2)]))));       \
+                                                                             \
+	BC_ ## ins ## _LP ## suffix:                                             \
+		branch(op (STACK(INS(1)) == prim_to_val(INS(2))));                   \
+                                                                             \
+	BC_ ## ins ## _LF ## suffix:                                             \
+		branch(op (val_to_fn(STACK(INS(1)), TAG_FN) == INS(2)));             \
+                                                                             \
+	BC_ ## ins ## _LV ## suffix:                                             \
+		branch(op (val_to_fn(STACK(INS(1)), TAG_NATIVE) == INS(2)));
 
 	// Use the opposite comparison operation because we want to execute the
 	// jump only if the comparison is true
-	EQ(EQ, !);
-	EQ(NEQ, );
+	EQ(EQ, !, , BRANCH);
+	EQ(NEQ, , , BRANCH);
+	EQ(EQ, !, _JMP, BRANCH_JMP);
+	EQ(NEQ, , _JMP, BRANCH_JMP);
 
 
 	//
@@ -433,32 +842,26 @@ BC_IS_FALSE_L:
 	//
 
 	// Use a macro to generate code for each of the order instructions.
-#define ORD(ins, op)                                                  \
-	BC_ ## ins ## _LL:                                                \
-		if (ensure_num(STACK(INS(1))) op ensure_num(STACK(INS(2)))) { \
-			ip++;                                                     \
-		}                                                             \
-		NEXT();                                                       \
-                                                                      \
-	BC_ ## ins ## _LI:                                                \
-		if (ensure_num(STACK(INS(1))) op                              \
-				(double) unsigned_to_signed(INS(2))) {                \
-			ip++;                                                     \
-		}                                                             \
-		NEXT();                                                       \
-                                                                      \
-	BC_ ## ins ## _LN:                                                \
-		if (ensure_num(STACK(INS(1))) op                              \
-				val_to_num(constants[INS(2)])) {                      \
-			ip++;                                                     \
-		}                                                             \
-		NEXT();
+#define ORD(ins, op, suffix, branch)                                       \
+	BC_ ## ins ## _LL ## suffix:                                           \
+		branch(ensure_num(STACK(INS(1))) op ensure_num(STACK(INS(2))));    \
+                                                                           \
+	BC_ ## ins ## _LI ## suffix:                                           \
+		branch(ensure_num(STACK(INS(1))) op                                \
+			(double) unsigned_to_signed(INS(2)));                          \
+                                                                           \
+	BC_ ## ins ## _LN ## suffix:                                           \
+		branch(ensure_num(STACK(INS(1))) op val_to_num(constants[INS(2)]));
 
 	// Again, use the opposite comparison operation
-	ORD(LT, >=);
-	ORD(LE, >);
-	ORD(GT, <=);
-	ORD(GE, <);
+	ORD(LT, >=, , BRANCH);
+	ORD(LE, >, , BRANCH);
+	ORD(GT, <=, , BRANCH);
+	ORD(GE, <, , BRANCH);
+	ORD(LT, >=, _JMP, BRANCH_JMP);
+	ORD(LE, >, _JMP, BRANCH_JMP);
+	ORD(GT, <=, _JMP, BRANCH_JMP);
+	ORD(GE, <, _JMP, BRANCH_JMP);
 
 
 	//
@@ -469,72 +872,322 @@ BC_JMP:
 	ip += INS(1);
 	DISPATCH();
 
+	// Hand hot loops over to the JIT compiler when taking the back-edge of the
+	// loop with the index `index` in the JIT's list of loops.
+#define JIT_LOOP(index)                                                     \
+	if (jit_enabled && (index) != JIT_NO_LOOP) {                            \
+		JitLoop *loop = &vec_at(state->jit.loops, (index));                 \
+		if (loop->trace != NULL) {                                          \
+			/* Run the compiled trace until it exits to the interpreter */  \
+			ip = &fn->code[loop->trace(&STACK(0), packages)];               \
+			DISPATCH();                                                     \
+		} else if (++loop->hotness == JIT_HOT_LOOP &&                       \
+				jit_record_start(state, (index), stack_start)) {            \
+			fn_thread(fn, record_table);                                    \
+		}                                                                   \
+	}
+
 BC_LOOP:
+	JIT_LOOP(INS(2));
 	ip -= INS(1);
 	DISPATCH();
 
+BC_FOR_PREP:
+	if (ensure_num(STACK(INS(1))) < ensure_num(STACK(INS(1) + 1))) {
+		STACK(INS(1) + 2) = STACK(INS(1));
+		NEXT();
+	}
+	ip += INS(2);
+	DISPATCH();
+
+BC_FOR_LOOP: {
+	double counter = val_to_num(STACK(INS(1))) + 1.0;
+	STACK(INS(1)) = num_to_val(counter);
+	if (!(counter < val_to_num(STACK(INS(1) + 1)))) {
+		NEXT();
+	}
+
+	// A compiled trace starts at the beginning of the loop's body
+	STACK(INS(1) + 2) = STACK(INS(1));
+	JIT_LOOP(INS(3));
+	ip -= INS(2);
+	DISPATCH();
+}
+
+BC_FOR_ARRAY_PREP: {
+	HyValue array = STACK(INS(1));
+	if (!val_is_gc(array, OBJ_ARRAY) && !val_is_gc(array, OBJ_FLOAT_ARRAY)) {
+		printf("Attempt to iterate over non-array\n");
+		goto finish;
+	}
+
+	if (iterated_length(val_to_ptr(array)) == 0) {
+		ip += INS(2);
+		DISPATCH();
+	}
+	STACK(INS(1) + 1) = num_to_val(0.0);
+	STACK(INS(1) + 2) = iterated_element(val_to_ptr(array), 0);
+	NEXT();
+}
+
+BC_FOR_ARRAY_LOOP: {
+	// The array's type was checked by FOR_ARRAY_PREP, and nothing else can
+	// modify the slot it's stored in
+	Object *array = val_to_ptr(STACK(INS(1)));
+	uint32_t index = (uint32_t) val_to_num(STACK(INS(1) + 1)) + 1;
+	if (index >= iterated_length(array)) {
+		NEXT();
+	}
+	STACK(INS(1) + 1) = num_to_val((double) index);
+	STACK(INS(1) + 2) = iterated_element(array, index);
+	ip -= INS(2);
+	DISPATCH();
+}
+
+RECORD:
+	// Record the instruction in the trace, then execute it
+	if (!jit_record(state, fn, stack_start,
+			&vec_at(fn->instructions, ip - fn->code))) {
+		fn_thread(fn, dispatch_table);
+	}
+	goto *dispatch_table[INS(0)];
+
 
 	//
 	//  Function Calls
 	//
 
+	// Ensure there's room on the call stack for another frame, and on the
+	// stack for the locals of the function `called` starting at `start`,
+	// refreshing our cached pointers if either stack moves.
+#define STACK_CHECK(start, called)                                        \
+	if (*call_stack_count >= state->call_stack_capacity ||                \
+			(start) + (called)->frame_size + 1 > state->stack_capacity) { \
+		if (!state_grow_stacks(state, *call_stack_count + 1,              \
+				(start) + (called)->frame_size + 1)) {                    \
+			goto stack_overflow;                                          \
+		}                                                                 \
+		stack = state->stack;                                             \
+		call_stack = state->call_stack;                                   \
+	}
+
+	// Call the Hydrogen function at index `fn_index`, whose arguments start in
+	// the slot after `base`, with the given `self` argument and closure. The
+	// return value is stored in `ret`.
+#define CALL_FN(base, ret, fn_index, self_value, closure_value) { \
+	Function *called = &functions[(fn_index)];                    \
+	STACK_CHECK(stack_start + (base) + 1, called);                \
+                                                                  \
+	/* Create a stack frame for the calling function */           \
+	Index index = (*call_stack_count)++;                          \
+	call_stack[index].fn = fn;                                    \
+	call_stack[index].self = (self_value);                        \
+	call_stack[index].closure = (closure_value);                  \
+	call_stack[index].stack_start = stack_start;                  \
+	call_stack[index].return_slot = stack_start + (ret);          \
+	call_stack[index].ip = ip;                                    \
+                                                                  \
+	/* Set up state for the called function */                    \
+	stack_start = stack_start + (base) + 1;                       \
+	fn = called;                                                  \
+	ip = fn->code;                                                \
+	DISPATCH();                                                   \
+}
+
+	// Call a native function or method using the expression `call`, which has
+	// access to the arguments (starting in the slot after `base`) in `args`.
+	// The return value is stored in `ret`. Stops execution if the function
+	// reported an error.
+#define CALL_NATIVE(base, count, ret, call) { \
+	HyArgs args;                              \
+	args.stack = stack;                       \
+	args.start = stack_start + (base) + 1;    \
+	args.arity = (count);                     \
+	STACK(ret) = (call);                      \
+	if (state->error != NULL) {               \
+		goto native_error;                    \
+	}                                         \
+	NEXT();                                   \
+}
+
+	// Call the function value in slot `base`, with `count` arguments in the
+	// slots following it. The return value is stored in `ret`.
+#define CALL_VALUE(base, count, ret) {                                      \
+	HyValue fn_value = STACK(base);                                         \
+                                                                            \
+	/* Check if we're calling a Hydrogen function or a native one */       \
+	if (val_is_fn(fn_value, TAG_FN)) {                                      \
+		CALL_FN(base, ret, val_to_fn(fn_value, TAG_FN), VALUE_NIL,          \
+			VALUE_NIL);                                                     \
+	} else if (val_is_gc(fn_value, OBJ_METHOD)) {                           \
+		Method *method = (Method *) val_to_ptr(fn_value);                   \
+		CALL_FN(base, ret, method->fn, method->parent, VALUE_NIL);          \
+	} else if (val_is_gc(fn_value, OBJ_CLOSURE)) {                          \
+		Closure *closure = (Closure *) val_to_ptr(fn_value);                \
+		CALL_FN(base, ret, closure->fn, VALUE_NIL, fn_value);               \
+	} else if (val_is_fn(fn_value, TAG_NATIVE)) {                           \
+		/* Native functions are free to allocate objects */                 \
+		GC_CHECK();                                                         \
+		NativeFunction *native = &native_fns[val_to_fn(fn_value,            \
+			TAG_NATIVE)];                                                   \
+		CALL_NATIVE(base, count, ret, native->fn(state, &args));            \
+	} else if (val_is_gc(fn_value, OBJ_NATIVE_METHOD)) {                    \
+		/* The collector might move the method, so fetch it again */        \
+		GC_CHECK();                                                         \
+		NativeMethod *method = val_to_ptr(STACK(base));                     \
+		CALL_NATIVE(base, count, ret,                                       \
+			method->fn(state, native_method_data(method), &args));          \
+	} else {                                                                \
+		/* TODO: trigger attempt to call non-function error */              \
+		printf("attempt to call non-function\n");                           \
+		goto finish;                                                        \
+	}                                                                       \
+}
+
+	// Look up the function called by the current instruction in its call cache,
+	// calling the value in slot `base` using CALL_VALUE if it isn't a Hydrogen
+	// function or method.
+#define CALL_CACHE_LOOKUP(cache, base, count, ret)                      \
+	if (STACK(base) != (cache)->callee ||                               \
+			(cache)->collections != state->gc.collections) {            \
+		if (!call_cache_fill(state, (cache), STACK(base))) {            \
+			CALL_VALUE(base, count, ret);                               \
+		}                                                               \
+	}
+
+BC_CLOSURE_NEW: {
+	GC_CHECK();
+	HyValue parent = VALUE_NIL;
+	HyValue self = VALUE_NIL;
+	if (*call_stack_count > 0) {
+		parent = call_stack[*call_stack_count - 1].closure;
+		self = call_stack[*call_stack_count - 1].self;
+	}
+	STACK(INS(1)) = closure_new(state, functions, INS_WIDE(2), stack_start,
+		parent, self);
+	NEXT();
+}
+
 BC_CALL: {
-	HyValue fn_value = STACK(INS(1));
+	CallCache *cache = CALL_CACHE();
+	CALL_CACHE_LOOKUP(cache, INS(1), INS(2), INS(3));
+	CALL_FN(INS(1), INS(3), cache->fn, cache->self, cache->closure);
+}
 
-	// Check if we're calling a Hydrogen function or a native one
-	if (val_is_fn(fn_value, TAG_FN) || val_is_gc(fn_value, OBJ_METHOD)) {
-		// Create a stack frame for the calling function to save the required
-		// state
-		Index index = (*call_stack_count)++;
-		call_stack[index].fn = fn;
-		call_stack[index].stack_start = stack_start;
-		call_stack[index].return_slot = stack_start + INS(3);
-		call_stack[index].ip = ip;
+BC_CALL_FIELD: {
+	// Methods on core types and native structs are free to allocate objects
+	GC_CHECK();
 
-		// Set the self argument
-		stack_start = stack_start + INS(1) + 1;
-		if (val_is_gc(fn_value, OBJ_METHOD)) {
-			Method *method = (Method *) val_to_ptr(fn_value);
-			call_stack[index].self = method->parent;
-			fn = &functions[method->fn];
-		} else {
-			call_stack[index].self = VALUE_NIL;
-			fn = &functions[val_to_fn(fn_value, TAG_FN)];
+	Identifier *field = &fields[INS(3)];
+	HyValue receiver = STACK(INS(1));
+	if (!val_is_ptr(receiver)) {
+		// Attempt to index non-object
+		printf("attempt to index non-object\n");
+		goto finish;
+	}
+
+	Object *obj = val_to_ptr(receiver);
+	if (obj->type == OBJ_STRUCT) {
+		// Struct instance. Fields take precedence over methods
+		Struct *instance = (Struct *) obj;
+		Index slot = struct_slot_find(structs, FIELD_CACHE(),
+			instance->definition, field);
+		if (slot < FIELD_CACHE_METHOD) {
+			// Replace the receiver with the field's value and call it
+			STACK(INS(1)) = instance->fields[slot];
+			CALL_VALUE(INS(1), INS(2), INS(1));
 		}
 
-		// Set up state for the called function
-		ip = &vec_at(fn->instructions, 0);
-		DISPATCH();
-	} else if (val_is_fn(fn_value, TAG_NATIVE) ||
-			val_is_gc(fn_value, OBJ_NATIVE_METHOD)) {
-		// Create a set of arguments to pass to the native function
-		HyArgs args;
-		args.stack = stack;
-		args.start = stack_start + INS(1) + 1;
-		args.arity = INS(2);
-
-		if (val_is_fn(fn_value, TAG_NATIVE)) {
-			// Call the native function
-			uint16_t index = val_to_fn(fn_value, TAG_NATIVE);
-			NativeFunction *native = &native_fns[index];
-			STACK(INS(3)) = native->fn(state, &args);
-		} else {
-			// Call the method
-			NativeMethod *method = val_to_ptr(fn_value);
-			STACK(INS(3)) = method->fn(state, method->data, &args);
+		// Call the method directly, without binding it to the instance
+		if (slot != NOT_FOUND) {
+			StructDefinition *def = &structs[instance->definition];
+			CALL_FN(INS(1), INS(1),
+				vec_at(def->methods, slot & ~FIELD_CACHE_METHOD).fn, receiver,
+				VALUE_NIL);
+		}
+	} else if (obj->type == OBJ_NATIVE_STRUCT) {
+		// Native struct instance
+		NativeStruct *instance = (NativeStruct *) obj;
+		Index method_index = native_struct_method_find(
+			&native_structs[instance->definition], field->name, field->length);
+		if (method_index != NOT_FOUND) {
+			NativeMethod *method = val_to_ptr(instance->methods[method_index]);
+			CALL_NATIVE(INS(1), INS(2), INS(1),
+				method->fn(state, instance->data, &args));
+		}
+	} else if (obj->type == OBJ_ARRAY || obj->type == OBJ_STRING ||
+			obj->type == OBJ_FLOAT_ARRAY || obj->type == OBJ_MAP) {
+		// Array, string, float array or map instance, whose methods are
+		// stored in a table shared between all instances of the type
+		CoreMethod *methods = array_core_methods;
+		uint32_t methods_count = ARRAY_CORE_METHODS_COUNT;
+		if (obj->type == OBJ_STRING) {
+			methods = string_core_methods;
+			methods_count = STRING_CORE_METHODS_COUNT;
+		} else if (obj->type == OBJ_FLOAT_ARRAY) {
+			methods = float_array_core_methods;
+			methods_count = FLOAT_ARRAY_CORE_METHODS_COUNT;
+		} else if (obj->type == OBJ_MAP) {
+			methods = map_core_methods;
+			methods_count = MAP_CORE_METHODS_COUNT;
 		}
 
-		NEXT();
-	} else {
-		// TODO: trigger attempt to call non-function error
-		printf("attempt to call non-function\n");
-		goto finish;
+		Index method_index = core_method_find(methods, methods_count,
+			field->name, field->length);
+		if (method_index != NOT_FOUND) {
+			CALL_NATIVE(INS(1), INS(2), INS(1),
+				methods[method_index].fn(state, obj, &args));
+		}
 	}
+
+	// If we reach here, we were given an object, but not a valid field name
+	printf("Undefined field `%.*s` on object\n", field->length, field->name);
+	goto finish;
 }
 
 
-	// Shorthand for returning a value.
+	// Functions are only ever called in tail position from another function
+	// (the parser doesn't allow returning from the top level of a package), so
+	// there's always a frame on the call stack to reuse
+BC_TAIL_CALL: {
+	// Native functions don't have a stack frame to reuse, so they're called
+	// normally and the following RET_L returns their value
+	CallCache *cache = CALL_CACHE();
+	CALL_CACHE_LOOKUP(cache, INS(1), INS(2), INS(3));
+
+	// The called function's frame starts where the current one does
+	Function *called = &functions[cache->fn];
+	if (stack_start + called->frame_size + 1 > state->stack_capacity) {
+		if (!state_grow_stacks(state, *call_stack_count,
+				stack_start + called->frame_size + 1)) {
+			goto stack_overflow;
+		}
+		stack = state->stack;
+		call_stack = state->call_stack;
+	}
+
+	// Move the arguments to the start of the frame, and replace the function
+	// being executed in it. Any of the current function's locals captured by a
+	// closure are about to be overwritten
+	if (vec_len(state->upvalues) > 0) {
+		upvalues_close(state, stack_start);
+	}
+	for (uint32_t i = 0; i < INS(2); i++) {
+		STACK(i) = STACK(INS(1) + 1 + i);
+	}
+	call_stack[*call_stack_count - 1].self = cache->self;
+	call_stack[*call_stack_count - 1].closure = cache->closure;
+	fn = called;
+	ip = fn->code;
+	DISPATCH();
+}
+
+	// Shorthand for returning a value, closing any upvalues that captured the
+	// function's locals.
 #define RET(return_value) {                                \
+	if (vec_len(state->upvalues) > 0) {                    \
+		upvalues_close(state, stack_start);                \
+	}                                                      \
 	Index index = --(*call_stack_count);                   \
 	stack[call_stack[index].return_slot] = (return_value); \
 	stack_start = call_stack[index].stack_start;           \
@@ -561,16 +1214,20 @@ BC_RET0:
 	//
 
 BC_STRUCT_NEW: {
-	STACK(INS(1)) = struct_instantiate(structs, INS(2));
+	GC_CHECK();
+	STACK(INS(1)) = struct_instantiate(state, structs, INS_WIDE(2));
 	NEXT();
 }
 
 BC_NATIVE_STRUCT_NEW: {
-	STACK(INS(1)) = native_struct_instantiate(native_structs, INS(2));
+	GC_CHECK();
+	STACK(INS(1)) = native_struct_instantiate(state, native_structs,
+		INS_WIDE(2));
 	NEXT();
 }
 
 BC_STRUCT_CALL_CONSTRUCTOR: {
+	GC_CHECK();
 	Object *obj = val_to_ptr(STACK(INS(1)));
 	if (obj->type == OBJ_STRUCT) {
 		Struct *instance = (Struct *) obj;
@@ -582,11 +1239,13 @@ BC_STRUCT_CALL_CONSTRUCTOR: {
 		}
 
 		// Set up the new function's stack frame
+		STACK_CHECK(stack_start + INS(2), &functions[def->constructor]);
 		Index index = (*call_stack_count)++;
 		call_stack[index].fn = fn;
 		call_stack[index].stack_start = stack_start;
 		call_stack[index].ip = ip;
 		call_stack[index].self = STACK(INS(1));
+		call_stack[index].closure = VALUE_NIL;
 
 		// Set the return slot to one after all the arguments to the function
 		// This slot will not be used by anything
@@ -595,7 +1254,7 @@ BC_STRUCT_CALL_CONSTRUCTOR: {
 
 		stack_start = stack_start + INS(2);
 		fn = &functions[def->constructor];
-		ip = &vec_at(fn->instructions, 0);
+		ip = fn->code;
 		DISPATCH();
 	} else {
 		NativeStruct *instance = (NativeStruct *) obj;
@@ -611,24 +1270,38 @@ BC_STRUCT_CALL_CONSTRUCTOR: {
 		void *data = def->constructor(state, &args);
 
 		// Set up the remaining methods on the instance using the data pointer
-		native_struct_construct(def, instance, data);
+		native_struct_construct(state, def, instance, data);
 		NEXT();
 	}
 }
 
 BC_STRUCT_FIELD: {
 	Identifier *field = &fields[INS(3)];
+	if (!val_is_ptr(STACK(INS(2)))) {
+		printf("Attempt to index non-object\n");
+		goto finish;
+	}
 	Object *obj = val_to_ptr(STACK(INS(2)));
 
 	if (obj->type == OBJ_STRUCT) {
 		// Struct instance
 		Struct *instance = (Struct *) obj;
-		Index field_index = struct_field_find(&structs[instance->definition],
-			field->name, field->length);
+		Index slot = struct_slot_find(structs, FIELD_CACHE(),
+			instance->definition, field);
 
 		// If we found the field
-		if (field_index != NOT_FOUND) {
-			STACK(INS(1)) = instance->fields[field_index];
+		if (slot < FIELD_CACHE_METHOD) {
+			STACK(INS(1)) = instance->fields[slot];
+			NEXT();
+		}
+
+		// If we found a method, bind it to the instance, since it's being used
+		// as a value
+		if (slot != NOT_FOUND) {
+			StructDefinition *def = &structs[instance->definition];
+			GC_CHECK();
+			STACK(INS(1)) = method_bind(state, STACK(INS(2)),
+				vec_at(def->methods, slot & ~FIELD_CACHE_METHOD).fn);
 			NEXT();
 		}
 	} else if (obj->type == OBJ_NATIVE_STRUCT) {
@@ -644,24 +1317,52 @@ BC_STRUCT_FIELD: {
 		}
 	} else if (obj->type == OBJ_ARRAY) {
 		// Array instance
-		Array *array = (Array *) obj;
 		Index method_index = core_method_find(array_core_methods,
 			ARRAY_CORE_METHODS_COUNT, field->name, field->length);
 
-		// If we found the field
+		// If we found the field, bind the method to the array. Binding
+		// allocates, and a collection might move the array, so don't use
+		// `obj` after this point
 		if (method_index != NOT_FOUND) {
-			STACK(INS(1)) = array->methods[method_index];
+			GC_CHECK();
+			STACK(INS(1)) = core_method_bind(state, STACK(INS(2)),
+				&array_core_methods[method_index]);
 			NEXT();
 		}
 	} else if (obj->type == OBJ_STRING) {
 		// String instance
-		String *string = (String *) obj;
 		Index method_index = core_method_find(string_core_methods,
 			STRING_CORE_METHODS_COUNT, field->name, field->length);
 
-		// If we found the field
+		// If we found the field, bind the method to the string
+		if (method_index != NOT_FOUND) {
+			GC_CHECK();
+			STACK(INS(1)) = core_method_bind(state, STACK(INS(2)),
+				&string_core_methods[method_index]);
+			NEXT();
+		}
+	} else if (obj->type == OBJ_FLOAT_ARRAY) {
+		// Float array instance
+		Index method_index = core_method_find(float_array_core_methods,
+			FLOAT_ARRAY_CORE_METHODS_COUNT, field->name, field->length);
+
+		// If we found the field, bind the method to the float array
+		if (method_index != NOT_FOUND) {
+			GC_CHECK();
+			STACK(INS(1)) = core_method_bind(state, STACK(INS(2)),
+				&float_array_core_methods[method_index]);
+			NEXT();
+		}
+	} else if (obj->type == OBJ_MAP) {
+		// Map instance
+		Index method_index = core_method_find(map_core_methods,
+			MAP_CORE_METHODS_COUNT, field->name, field->length);
+
+		// If we found the field, bind the method to the map
 		if (method_index != NOT_FOUND) {
-			STACK(INS(1)) = string->methods[method_index];
+			GC_CHECK();
+			STACK(INS(1)) = core_method_bind(state, STACK(INS(2)),
+				&map_core_methods[method_index]);
 			NEXT();
 		}
 	} else {
@@ -680,11 +1381,13 @@ BC_STRUCT_FIELD: {
 #define STRUCT_SET(value) {                                                    \
 	Struct *instance = val_to_ptr(STACK(INS(3)));                              \
 	Identifier *field = &fields[INS(1)];                                       \
-	Index field_index = struct_field_find(&structs[instance->definition],      \
-		field->name, field->length);                                           \
+	Index slot = struct_slot_find(structs, FIELD_CACHE(),                      \
+		instance->definition, field);                                          \
                                                                                \
-	if (field_index != NOT_FOUND) {                                            \
-		instance->fields[field_index] = (value);                               \
+	/* Methods can't be assigned to */                                        \
+	if (slot < FIELD_CACHE_METHOD) {                                           \
+		instance->fields[slot] = (value);                                      \
+		gc_write_barrier(&state->gc, instance, instance->fields[slot]);        \
 		NEXT();                                                                \
 	} else {                                                                   \
 		printf("Undefined field (struct %.*s)\n", field->length, field->name); \
@@ -695,85 +1398,167 @@ BC_STRUCT_FIELD: {
 	// All STRUCT_SET_* instructions.
 	SET(STRUCT_SET_, STRUCT_SET);
 
+	// Methods are only ever called on instances of the struct they're defined
+	// on, so the parser can resolve the position of fields on `self`
+BC_SELF_FIELD: {
+	Struct *self = val_to_ptr(call_stack[*call_stack_count - 1].self);
+	STACK(INS(1)) = self->fields[INS(2)];
+	NEXT();
+}
+
+	// The set function for SELF_SET_* instructions.
+#define SELF_SET(value) {                                              \
+	Struct *self = val_to_ptr(call_stack[*call_stack_count - 1].self); \
+	self->fields[INS(1)] = (value);                                    \
+	gc_write_barrier(&state->gc, self, self->fields[INS(1)]);          \
+	NEXT();                                                            \
+}
+
+	// All SELF_SET_* instructions.
+	SET(SELF_SET_, SELF_SET);
+
 
 	//
 	//  Arrays
 	//
 
 BC_ARRAY_NEW: {
-	Array *array = malloc(sizeof(Array));
-	array->type = OBJ_ARRAY;
-	array->length = INS(2);
-	array->capacity = ceil_power_of_2(array->length);
-	array->contents = malloc(sizeof(HyValue) * array->capacity);
-
-	// Methods on the array
-	for (uint32_t i = 0; i < ARRAY_CORE_METHODS_COUNT; i++) {
-		CoreMethod *def = &array_core_methods[i];
-		NativeMethod *method = malloc(sizeof(NativeMethod));
-		method->type = OBJ_NATIVE_METHOD;
-		method->data = array;
-		method->arity = def->arity;
-		method->fn = def->fn;
-		array->methods[i] = ptr_to_val(method);
-	}
+	GC_CHECK();
 
+	// Elements are only set by the instructions following this one, so they're
+	// cleared in case a collection is triggered before then
+	Array *array = array_new(state, INS(2));
 	STACK(INS(1)) = ptr_to_val(array);
 	NEXT();
 }
 
 
-// Helper to index an array
-#define ARRAY_GET(index) {                         \
-	if (!val_is_gc(STACK(INS(3)), OBJ_ARRAY)) {    \
-		printf("Attempt to index non-array\n");    \
-		goto finish;                               \
-	}                                              \
-                                                   \
-	Array *array = val_to_ptr(STACK(INS(3)));      \
-	if ((index) < 0 || (index) >= array->length) { \
-		printf("Array index out of bounds\n");     \
-		goto finish;                               \
-	}                                              \
-                                                   \
-	STACK(INS(1)) = array->contents[(index)];      \
-	NEXT();                                        \
+// Helper to look up a key in the map in the third argument, storing the value
+// (or nil, if the key isn't in the map) in the first.
+#define MAP_LOOKUP(key) {                                           \
+	HyValue map_key = (key);                                        \
+	if (!map_key_is_valid(map_key)) {                               \
+		printf("Invalid map key\n");                                \
+		goto finish;                                                \
+	}                                                               \
+                                                                    \
+	MapEntry *entry = map_find(val_to_ptr(STACK(INS(3))), map_key); \
+	STACK(INS(1)) = (entry == NULL) ? VALUE_NIL : entry->value;     \
+	NEXT();                                                         \
+}
+
+	// Helper to set a key in the map in the third argument.
+#define MAP_STORE(key, value) {                                     \
+	HyValue map_key = (key);                                        \
+	if (!map_key_is_valid(map_key)) {                               \
+		printf("Invalid map key\n");                                \
+		goto finish;                                                \
+	}                                                               \
+                                                                    \
+	map_insert(state, val_to_ptr(STACK(INS(3))), map_key, (value)); \
+	NEXT();                                                         \
+}
+
+
+// Helper to index a float array, given an index that's known to be a number.
+#define FLOAT_ARRAY_GET(index) {                          \
+	FloatArray *array = val_to_ptr(STACK(INS(3)));        \
+	if ((index) < 0 || (index) >= array->length) {        \
+		printf("Array index out of bounds\n");            \
+		goto finish;                                      \
+	}                                                     \
+                                                          \
+	STACK(INS(1)) = num_to_val(array->contents[(index)]); \
+	NEXT();                                               \
+}
+
+// Helper to index an array. Float arrays and maps are indexed using the same
+// syntax, so fall back to them when given one instead.
+#define ARRAY_GET(index, key) {                          \
+	if (!val_is_gc(STACK(INS(3)), OBJ_ARRAY)) {          \
+		if (val_is_gc(STACK(INS(3)), OBJ_FLOAT_ARRAY)) { \
+			FLOAT_ARRAY_GET(index);                      \
+		} else if (val_is_gc(STACK(INS(3)), OBJ_MAP)) {  \
+			MAP_LOOKUP(key);                             \
+		}                                                \
+		printf("Attempt to index non-array\n");          \
+		goto finish;                                     \
+	}                                                    \
+                                                         \
+	Array *array = val_to_ptr(STACK(INS(3)));            \
+	if ((index) < 0 || (index) >= array->length) {       \
+		printf("Array index out of bounds\n");           \
+		goto finish;                                     \
+	}                                                    \
+                                                         \
+	STACK(INS(1)) = array->contents[(index)];            \
+	NEXT();                                              \
 }
 
 BC_ARRAY_GET_L: {
 	// Check we're indexing by a number
 	if (!val_is_num(STACK(INS(2)))) {
+		if (val_is_gc(STACK(INS(3)), OBJ_MAP)) {
+			MAP_LOOKUP(STACK(INS(2)));
+		}
 		printf("Expected integer when indexing array\n");
 		goto finish;
 	}
 
 	int64_t index = (int64_t) val_to_num(STACK(INS(2)));
-	ARRAY_GET(index);
+	ARRAY_GET(index, STACK(INS(2)));
 }
 
 BC_ARRAY_GET_I:
-	ARRAY_GET(INS(2));
-
-
-	// Helper to set an index in an array.
-#define ARRAY_I_SET(index, value) {                \
-	if (!val_is_gc(STACK(INS(3)), OBJ_ARRAY)) {    \
-		printf("Attempt to index non-array\n");    \
-		goto finish;                               \
-	}                                              \
-                                                   \
-	Array *array = val_to_ptr(STACK(INS(3)));      \
-	if ((index) < 0 || (index) >= array->length) { \
-		printf("Array index out of bounds\n");     \
-		goto finish;                               \
-	}                                              \
-                                                   \
-	array->contents[(index)] = (value);            \
-	NEXT();                                        \
+	ARRAY_GET(INS(2), int_to_val(INS(2)));
+
+
+	// Helper to set an index in a float array, which can only hold numbers.
+#define FLOAT_ARRAY_SET(index, value) {                               \
+	FloatArray *array = val_to_ptr(STACK(INS(3)));                    \
+	HyValue element = (value);                                        \
+	if (!val_is_num(element)) {                                       \
+		printf("Expected number when setting float array element\n"); \
+		goto finish;                                                  \
+	}                                                                 \
+                                                                      \
+	if ((index) < 0 || (index) >= array->length) {                    \
+		printf("Array index out of bounds\n");                        \
+		goto finish;                                                  \
+	}                                                                 \
+                                                                      \
+	array->contents[(index)] = val_to_num(element);                   \
+	NEXT();                                                           \
+}
+
+	// Helper to set an index in an array, float array, or a key in a map.
+#define ARRAY_I_SET(index, key, value) {                 \
+	if (!val_is_gc(STACK(INS(3)), OBJ_ARRAY)) {          \
+		if (val_is_gc(STACK(INS(3)), OBJ_FLOAT_ARRAY)) { \
+			FLOAT_ARRAY_SET(index, value);               \
+		} else if (val_is_gc(STACK(INS(3)), OBJ_MAP)) {  \
+			MAP_STORE(key, value);                       \
+		}                                                \
+		printf("Attempt to index non-array\n");          \
+		goto finish;                                     \
+	}                                                    \
+                                                         \
+	Array *array = val_to_ptr(STACK(INS(3)));            \
+	if ((index) < 0 || (index) >= array->length) {       \
+		printf("Array index out of bounds\n");           \
+		goto finish;                                     \
+	}                                                    \
+                                                         \
+	if (array->source != VALUE_NIL) {                    \
+		array_own(state, array);                         \
+	}                                                    \
+	array->contents[(index)] = (value);                  \
+	gc_write_barrier(&state->gc, array, (value));        \
+	NEXT();                                              \
 }
 
 	// Set function for ARRAY_I_SET_* instructions.
-#define ARRAY_I_SET_INS(value) ARRAY_I_SET(INS(1), value);
+#define ARRAY_I_SET_INS(value) ARRAY_I_SET(INS(1), int_to_val(INS(1)), value);
 
 	// All ARRAY_I_SET_* instructions.
 	SET(ARRAY_I_SET_, ARRAY_I_SET_INS);
@@ -781,19 +1566,112 @@ BC_ARRAY_GET_I:
 
 	// Set function for ARRAY_L_SET_* instructions.
 #define ARRAY_L_SET(value) {                              \
-	if (!val_is_num(STACK(INS(2)))) {                     \
+	if (!val_is_num(STACK(INS(1)))) {                     \
+		if (val_is_gc(STACK(INS(3)), OBJ_MAP)) {          \
+			MAP_STORE(STACK(INS(1)), value);              \
+		}                                                 \
 		printf("Expected integer when indexing array\n"); \
 		goto finish;                                      \
 	}                                                     \
                                                           \
-	int64_t index = (int64_t) val_to_num(STACK(INS(2)));  \
-	ARRAY_I_SET(index, value);                            \
+	int64_t index = (int64_t) val_to_num(STACK(INS(1)));  \
+	ARRAY_I_SET(index, STACK(INS(1)), value);             \
 }
 
 	// All ARRAY_L_SET_* instructions.
 	SET(ARRAY_L_SET_, ARRAY_L_SET);
 
 
+BC_ARRAY_SLICE: {
+	HyValue container = STACK(INS(3));
+	uint32_t length;
+	if (val_is_gc(container, OBJ_ARRAY)) {
+		length = ((Array *) val_to_ptr(container))->length;
+	} else if (val_is_gc(container, OBJ_STRING)) {
+		length = ((String *) val_to_ptr(container))->length;
+	} else {
+		printf("Attempt to slice non-array\n");
+		goto finish;
+	}
+
+	// A missing start or end is nil, and means the start or end of the array
+	uint32_t from, to;
+	if (!slice_bound(STACK(INS(2)), 0, length, &from) ||
+			!slice_bound(STACK(INS(2) + 1), length, length, &to) ||
+			from > to) {
+		printf("Slice bounds must be integers within the array or string\n");
+		goto finish;
+	}
+
+	// Arrays share their elements with the slice, but strings are stored
+	// inline in their object, so have to be copied
+	GC_CHECK();
+	container = STACK(INS(3));
+	if (val_is_gc(container, OBJ_ARRAY)) {
+		STACK(INS(1)) = ptr_to_val(array_slice(state, val_to_ptr(container),
+			from, to));
+	} else {
+		STACK(INS(1)) = ptr_to_val(string_slice(state, val_to_ptr(container),
+			from, to));
+	}
+	NEXT();
+}
+
+
+
+	//
+	//  Maps
+	//
+
+BC_MAP_NEW: {
+	GC_CHECK();
+	Map *map = map_new(state, INS(2));
+	STACK(INS(1)) = ptr_to_val(map);
+	NEXT();
+}
+
+BC_MAP_GET:
+	if (!val_is_gc(STACK(INS(3)), OBJ_MAP)) {
+		printf("Attempt to index non-map\n");
+		goto finish;
+	}
+	MAP_LOOKUP(STACK(INS(2)));
+
+
+	// Set function for MAP_SET_* instructions.
+#define MAP_SET(value) {                      \
+	if (!val_is_gc(STACK(INS(3)), OBJ_MAP)) { \
+		printf("Attempt to index non-map\n"); \
+		goto finish;                          \
+	}                                         \
+	MAP_STORE(STACK(INS(1)), value);          \
+}
+
+	// All MAP_SET_* instructions.
+	SET(MAP_SET_, MAP_SET);
+
+
+stack_overflow: {
+	Error err = err_new(state);
+	err_print(&err, "Stack overflow");
+	RECORD_STOP();
+	upvalues_close(state, 0);
+	return err_make(&err);
+}
+
+native_error: {
+	HyError *err = state->error;
+	state->error = NULL;
+	RECORD_STOP();
+	upvalues_close(state, 0);
+	return err;
+}
+
 finish:
+	RECORD_STOP();
+
+	// Execution may have stopped early because of an error, so closures can
+	// outlive the locals they captured
+	upvalues_close(state, 0);
 	return NULL;
 }
@@ -18,14 +18,23 @@ Index fn_new(HyState *state) {
 	fn->line = 0;
 	fn->arity = 0;
 	fn->frame_size = 0;
+	vec_new(fn->captures, Capture, 4);
+	fn->locals_captured = false;
 	vec_new(fn->instructions, Instruction, 64);
+	fn->caches = NULL;
+	fn->call_caches = NULL;
+	fn->code = NULL;
 	return vec_len(state->functions) - 1;
 }
 
 
 // Free resources allocated by a function.
 void fn_free(Function *fn) {
+	vec_free(fn->captures);
 	vec_free(fn->instructions);
+	free(fn->caches);
+	free(fn->call_caches);
+	free(fn->code);
 }
 
 
@@ -38,6 +47,48 @@ Index fn_emit(Function *fn, BytecodeOpcode opcode, uint16_t arg1, uint16_t arg2,
 }
 
 
+// Allocate empty inline caches for every instruction in a function. Must be
+// called after the function has been parsed, but before it's executed.
+void fn_caches_new(Function *fn) {
+	free(fn->caches);
+	fn->caches = malloc(sizeof(FieldCache) * vec_len(fn->instructions));
+
+	// Setting every byte to 0xff marks every entry as empty
+	memset(fn->caches, 0xff, sizeof(FieldCache) * vec_len(fn->instructions));
+
+	// A quiet NaN without a tag isn't a valid value, so it never matches the
+	// value being called
+	free(fn->call_caches);
+	fn->call_caches = malloc(sizeof(CallCache) * vec_len(fn->instructions));
+	for (uint32_t i = 0; i < vec_len(fn->instructions); i++) {
+		fn->call_caches[i].callee = QUIET_NAN;
+	}
+}
+
+
+
+// Point every instruction in a function's threaded code at its handler in
+// `handlers` (indexed by opcode), decoding the function's bytecode into
+// threaded code first if this hasn't been done yet. Instructions the
+// interpreter has since quickened keep their quickened opcode.
+void fn_thread(Function *fn, void **handlers) {
+	uint32_t count = vec_len(fn->instructions);
+	if (fn->code == NULL) {
+		fn->code = malloc(sizeof(ThreadedIns) * count);
+		for (uint32_t i = 0; i < count; i++) {
+			Instruction ins = vec_at(fn->instructions, i);
+			for (uint32_t n = 0; n < 4; n++) {
+				fn->code[i].args[n] = ins_arg(ins, n);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		fn->code[i].handler = handlers[fn->code[i].args[0]];
+	}
+}
+
+
 
 //
 //  Natives
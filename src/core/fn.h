@@ -13,6 +13,80 @@
 #include "ins.h"
 
 
+// The number of struct definitions an inline cache can remember at once.
+#define FIELD_CACHE_SIZE 4
+
+// Marks an unused entry in an inline cache.
+#define FIELD_CACHE_EMPTY NOT_FOUND
+
+// Set on a cached slot when it's the index of a method on the struct, rather
+// than a data field.
+#define FIELD_CACHE_METHOD 0x8000
+
+
+// An inline cache attached to an instruction that looks up a struct field by
+// name (STRUCT_FIELD, STRUCT_SET_*, and CALL_FIELD). Remembers where the field
+// was found for the last few struct definitions the instruction saw, so we
+// only need to search for the field by name the first time.
+typedef struct {
+	Index definitions[FIELD_CACHE_SIZE];
+	uint16_t slots[FIELD_CACHE_SIZE];
+} FieldCache;
+
+
+// An inline cache attached to a CALL or TAIL_CALL instruction. Remembers the
+// last Hydrogen function or method called by the instruction, so calling the
+// same value again doesn't need to work out what kind of function it is.
+// Methods are objects the garbage collector can move or free, so the cache is
+// only valid until the next collection.
+typedef struct {
+	// The value called, the `self` argument to pass to the function, and the
+	// closure to run it in (or VALUE_NIL if it isn't a closure).
+	HyValue callee;
+	HyValue self;
+	HyValue closure;
+
+	// The index of the function to call, and the number of collections the
+	// garbage collector had performed when the cache was filled.
+	Index fn;
+	uint32_t collections;
+} CallCache;
+
+
+// An instruction in a function's direct threaded code. Instructions are
+// decoded ahead of time, so the interpreter can jump straight to each
+// instruction's handler and read its arguments without shifting or masking.
+typedef struct {
+	// The address of the interpreter's handler for the instruction.
+	void *handler;
+
+	// The instruction's opcode, followed by its 3 arguments.
+	uint16_t args[4];
+} ThreadedIns;
+
+
+// Where a closure finds one of its upvalues when it's created.
+typedef enum {
+	// A local in the function creating the closure.
+	CAPTURE_LOCAL,
+
+	// One of the creating function's own upvalues, if the local belongs to a
+	// function further out.
+	CAPTURE_UPVALUE,
+
+	// The `self` argument of the method creating the closure. `self` can't be
+	// reassigned, so the closure gets its own closed upvalue holding it.
+	CAPTURE_SELF,
+} CaptureType;
+
+
+// An upvalue captured by a closure when it's created.
+typedef struct {
+	CaptureType type;
+	uint16_t index;
+} Capture;
+
+
 // A function is a collection of bytecode instructions that can be executed by
 // the interpreter.
 typedef struct {
@@ -33,8 +107,31 @@ typedef struct {
 	// The number of locals allocated in this function.
 	uint32_t frame_size;
 
+	// The upvalues captured by the function from the functions enclosing it.
+	// A function that doesn't capture anything is called directly, without
+	// creating a closure.
+	Vec(Capture) captures;
+
+	// Whether any of the function's locals are captured by a closure, in which
+	// case calls can read or modify them through an upvalue.
+	bool locals_captured;
+
 	// The array of the function's bytecode instructions.
 	Vec(Instruction) instructions;
+
+	// One inline cache for each instruction, only used by instructions that
+	// access struct fields. Allocated by `fn_caches_new` once the function has
+	// finished being parsed.
+	FieldCache *caches;
+
+	// One call cache for each instruction, only used by CALL and TAIL_CALL.
+	// Allocated along with the field caches.
+	CallCache *call_caches;
+
+	// The function's instructions as direct threaded code, or NULL if the
+	// function hasn't been executed yet. Built by the interpreter using
+	// `fn_thread`, since only it knows the address of each handler.
+	ThreadedIns *code;
 } Function;
 
 
@@ -48,6 +145,16 @@ void fn_free(Function *fn);
 Index fn_emit(Function *fn, BytecodeOpcode opcode, uint16_t arg1, uint16_t arg2,
 	uint16_t arg3);
 
+// Allocate empty inline caches for every instruction in a function. Must be
+// called after the function has been parsed, but before it's executed.
+void fn_caches_new(Function *fn);
+
+// Point every instruction in a function's threaded code at its handler in
+// `handlers` (indexed by opcode), decoding the function's bytecode into
+// threaded code first if this hasn't been done yet. Instructions the
+// interpreter has since quickened keep their quickened opcode.
+void fn_thread(Function *fn, void **handlers);
+
 
 // A native function is a wrapper around a C function pointer, which allows
 // Hydrogen code to call native C code.
@@ -0,0 +1,421 @@
+
+//
+//  Garbage Collector
+//
+
+#include "gc.h"
+#include "state.h"
+#include "value.h"
+#include "map.h"
+#include "numeric.h"
+
+
+// A function called on every value slot found while tracing the heap.
+typedef void (* Visitor)(GarbageCollector *gc, HyValue *slot);
+
+
+// Create a new garbage collector.
+void gc_new(GarbageCollector *gc) {
+	gc->nursery = malloc(GC_NURSERY_SIZE);
+	gc->nursery_top = gc->nursery;
+	gc->nursery_end = gc->nursery + GC_NURSERY_SIZE;
+
+	gc->objects = NULL;
+	gc->allocated = 0;
+	gc->threshold = GC_INITIAL_THRESHOLD;
+	gc->collections = 0;
+	vec_new(gc->remembered, Object *, 64);
+	vec_new(gc->grey, Object *, 64);
+}
+
+
+// Return the number of bytes an object occupies on the heap. Doesn't include
+// any memory the object owns separately (like the contents of an array).
+static size_t obj_size(Object *obj) {
+	switch (obj->type) {
+	case OBJ_STRING:
+		return sizeof(String) + ((String *) obj)->length + 1;
+	case OBJ_STRUCT:
+		return sizeof(Struct) +
+			sizeof(HyValue) * ((Struct *) obj)->fields_count;
+	case OBJ_NATIVE_STRUCT:
+		return sizeof(NativeStruct) +
+			sizeof(HyValue) * ((NativeStruct *) obj)->methods_count;
+	case OBJ_METHOD:
+		return sizeof(Method);
+	case OBJ_NATIVE_METHOD:
+		return sizeof(NativeMethod);
+	case OBJ_ARRAY:
+		return sizeof(Array);
+	case OBJ_FLOAT_ARRAY:
+		return sizeof(FloatArray);
+	case OBJ_MAP:
+		return sizeof(Map);
+	case OBJ_CLOSURE:
+		return sizeof(Closure) +
+			sizeof(HyValue) * ((Closure *) obj)->upvalues_count;
+	case OBJ_UPVALUE:
+		return sizeof(Upvalue);
+	default:
+		return 0;
+	}
+}
+
+
+// Release any memory owned separately by an object, calling the destructor for
+// native structs.
+static void obj_release(HyState *state, Object *obj) {
+	switch (obj->type) {
+	case OBJ_NATIVE_STRUCT: {
+		NativeStruct *instance = (NativeStruct *) obj;
+		NativeStructDefinition *def =
+			&vec_at(state->native_structs, instance->definition);
+		if (def->destructor != NULL && instance->data != NULL) {
+			def->destructor(state, instance->data);
+		}
+		break;
+	}
+	case OBJ_ARRAY: {
+		// Slices don't own their contents
+		Array *array = (Array *) obj;
+		if (array->source == VALUE_NIL) {
+			state->gc.allocated -= sizeof(HyValue) * array->capacity;
+			free(array->contents);
+		}
+		break;
+	}
+	case OBJ_FLOAT_ARRAY:
+		float_array_free(state, (FloatArray *) obj);
+		break;
+	case OBJ_MAP:
+		map_free(state, (Map *) obj);
+		break;
+	default:
+		break;
+	}
+}
+
+
+// Release the memory owned by every object in the nursery that wasn't copied
+// out of it during a minor collection.
+static void nursery_release(HyState *state) {
+	GarbageCollector *gc = &state->gc;
+	char *cursor = gc->nursery;
+	while (cursor < gc->nursery_top) {
+		Object *obj = (Object *) cursor;
+		if (obj->next == NULL) {
+			obj_release(state, obj);
+		}
+		cursor += GC_ALIGN(obj_size(obj));
+	}
+}
+
+
+// Free every object allocated by a garbage collector, as well as the
+// collector itself.
+void gc_free(HyState *state, GarbageCollector *gc) {
+	nursery_release(state);
+	free(gc->nursery);
+
+	Object *obj = gc->objects;
+	while (obj != NULL) {
+		Object *next = obj->next;
+		obj_release(state, obj);
+		free(obj);
+		obj = next;
+	}
+
+	gc->objects = NULL;
+	gc->allocated = 0;
+	vec_free(gc->remembered);
+	vec_free(gc->grey);
+}
+
+
+// Allocate a new object of type `type` that is `size` bytes large. Never
+// triggers a collection, so it's safe to call at any point during execution.
+void * gc_alloc(HyState *state, ObjType type, size_t size) {
+	GarbageCollector *gc = &state->gc;
+	size_t aligned = GC_ALIGN(size);
+	Object *obj;
+
+	// Native structs are never allocated in the nursery, since their
+	// destructor must be called when they die
+	if (type != OBJ_NATIVE_STRUCT && aligned <= GC_NURSERY_MAX_OBJECT &&
+			gc->nursery_top + aligned <= gc->nursery_end) {
+		obj = (Object *) gc->nursery_top;
+		gc->nursery_top += aligned;
+		obj->next = NULL;
+	} else {
+		// Link the object into the list of old objects
+		obj = malloc(size);
+		obj->next = gc->objects;
+		gc->objects = obj;
+		gc->allocated += size;
+	}
+
+	obj->type = type;
+	obj->mark = false;
+	obj->remembered = false;
+	return obj;
+}
+
+
+// Add an old object to the remembered set.
+void gc_remember(GarbageCollector *gc, Object *obj) {
+	if (!obj->remembered) {
+		obj->remembered = true;
+		vec_inc(gc->remembered);
+		vec_last(gc->remembered) = obj;
+	}
+}
+
+
+
+//
+//  Tracing
+//
+
+// Call `visit` on a list of values.
+static inline void visit_vals(GarbageCollector *gc, HyValue *values,
+		uint32_t count, Visitor visit) {
+	for (uint32_t i = 0; i < count; i++) {
+		visit(gc, &values[i]);
+	}
+}
+
+
+// Call `visit` on every value referenced by an object.
+static void visit_children(GarbageCollector *gc, Object *obj, Visitor visit) {
+	switch (obj->type) {
+	case OBJ_STRUCT: {
+		Struct *instance = (Struct *) obj;
+		visit_vals(gc, instance->fields, instance->fields_count, visit);
+		break;
+	}
+	case OBJ_NATIVE_STRUCT: {
+		NativeStruct *instance = (NativeStruct *) obj;
+		visit_vals(gc, instance->methods, instance->methods_count, visit);
+		break;
+	}
+	case OBJ_METHOD:
+		visit(gc, &((Method *) obj)->parent);
+		break;
+	case OBJ_NATIVE_METHOD:
+		visit(gc, &((NativeMethod *) obj)->parent);
+		break;
+	case OBJ_ARRAY: {
+		Array *array = (Array *) obj;
+		visit_vals(gc, array->contents, array->length, visit);
+		visit(gc, &array->source);
+		break;
+	}
+	case OBJ_MAP: {
+		Map *map = (Map *) obj;
+		for (uint32_t i = 0; i < map->capacity; i++) {
+			if (map_slot_is_full(map, i)) {
+				visit(gc, &map->entries[i].key);
+				visit(gc, &map->entries[i].value);
+			}
+		}
+		break;
+	}
+	case OBJ_CLOSURE: {
+		Closure *closure = (Closure *) obj;
+		visit_vals(gc, closure->upvalues, closure->upvalues_count, visit);
+		break;
+	}
+	case OBJ_UPVALUE:
+		visit(gc, &((Upvalue *) obj)->value);
+		break;
+	default:
+		break;
+	}
+}
+
+
+// Return the absolute position on the stack one past the last slot used by
+// any function in the call stack.
+static uint32_t stack_extent(HyState *state, uint32_t stack_top) {
+	for (uint32_t i = 0; i < state->call_stack_count; i++) {
+		Frame *frame = &state->call_stack[i];
+		uint32_t top = frame->stack_start + frame->fn->frame_size + 1;
+		if (top > stack_top) {
+			stack_top = top;
+		}
+	}
+	return stack_top;
+}
+
+
+// Call `visit` on every value directly reachable by the interpreter.
+static void visit_roots(HyState *state, uint32_t stack_top, Visitor visit) {
+	GarbageCollector *gc = &state->gc;
+
+	// Stack
+	visit_vals(gc, state->stack, stack_top, visit);
+
+	// Self arguments for methods and closures in the call stack
+	for (uint32_t i = 0; i < state->call_stack_count; i++) {
+		visit(gc, &state->call_stack[i].self);
+		visit(gc, &state->call_stack[i].closure);
+	}
+
+	// Open upvalues
+	visit_vals(gc, &vec_at(state->upvalues, 0), vec_len(state->upvalues),
+		visit);
+
+	// Top level locals in each package
+	for (uint32_t i = 0; i < vec_len(state->packages); i++) {
+		Package *pkg = &vec_at(state->packages, i);
+		visit_vals(gc, &vec_at(pkg->locals, 0), vec_len(pkg->locals), visit);
+	}
+
+	// Constants
+	visit_vals(gc, &vec_at(state->constants, 0), vec_len(state->constants),
+		visit);
+}
+
+
+// Call `visit` on the children of every object in the grey stack, until the
+// stack is empty.
+static void visit_grey(GarbageCollector *gc, Visitor visit) {
+	while (vec_len(gc->grey) > 0) {
+		Object *obj = vec_last(gc->grey);
+		vec_len(gc->grey)--;
+		visit_children(gc, obj, visit);
+	}
+}
+
+
+
+//
+//  Minor Collection
+//
+
+// Copy a value's object out of the nursery into old space if it hasn't been
+// copied already, and update the slot to point to the copy.
+static void evacuate(GarbageCollector *gc, HyValue *slot) {
+	if (!val_is_ptr(*slot) || !gc_in_nursery(gc, val_to_ptr(*slot))) {
+		return;
+	}
+
+	// Check if the object has already been copied
+	Object *obj = val_to_ptr(*slot);
+	if (obj->next == NULL) {
+		size_t size = obj_size(obj);
+		Object *copy = malloc(size);
+		memcpy(copy, obj, size);
+
+		// Link the copy into the list of old objects
+		copy->next = gc->objects;
+		gc->objects = copy;
+		gc->allocated += size;
+
+		// Leave a forwarding pointer behind, and trace the copy's children
+		obj->next = copy;
+		vec_inc(gc->grey);
+		vec_last(gc->grey) = copy;
+	}
+
+	*slot = ptr_to_val(obj->next);
+}
+
+
+// Copy every reachable object out of the nursery, then empty it.
+static void gc_minor(HyState *state, uint32_t stack_top) {
+	GarbageCollector *gc = &state->gc;
+
+	// Old objects in the remembered set act as extra roots
+	for (uint32_t i = 0; i < vec_len(gc->remembered); i++) {
+		Object *obj = vec_at(gc->remembered, i);
+		obj->remembered = false;
+		visit_children(gc, obj, evacuate);
+	}
+	vec_len(gc->remembered) = 0;
+
+	visit_roots(state, stack_top, evacuate);
+	visit_grey(gc, evacuate);
+
+	// Nothing in old space references the nursery anymore
+	nursery_release(state);
+	gc->nursery_top = gc->nursery;
+}
+
+
+
+//
+//  Major Collection
+//
+
+// Mark a value as reachable, if it's an object that hasn't been marked yet.
+static void mark(GarbageCollector *gc, HyValue *slot) {
+	if (!val_is_ptr(*slot)) {
+		return;
+	}
+
+	Object *obj = val_to_ptr(*slot);
+	if (!obj->mark) {
+		obj->mark = true;
+		vec_inc(gc->grey);
+		vec_last(gc->grey) = obj;
+	}
+}
+
+
+// Free all unmarked old objects, and reset the mark on all remaining ones.
+static void sweep(HyState *state) {
+	GarbageCollector *gc = &state->gc;
+	Object **link = &gc->objects;
+	while (*link != NULL) {
+		Object *obj = *link;
+		if (obj->mark) {
+			obj->mark = false;
+			link = &obj->next;
+		} else {
+			*link = obj->next;
+			gc->allocated -= obj_size(obj);
+			obj_release(state, obj);
+			free(obj);
+		}
+	}
+}
+
+
+// Free all unreachable objects in old space. Must only be called when the
+// nursery is empty.
+static void gc_major(HyState *state, uint32_t stack_top) {
+	GarbageCollector *gc = &state->gc;
+	visit_roots(state, stack_top, mark);
+	visit_grey(gc, mark);
+	sweep(state);
+
+	// Schedule the next major collection
+	gc->threshold = gc->allocated * GC_GROWTH_FACTOR;
+	if (gc->threshold < GC_INITIAL_THRESHOLD) {
+		gc->threshold = GC_INITIAL_THRESHOLD;
+	}
+}
+
+
+// Free all objects unreachable from the interpreter's roots. `stack_top` is
+// the absolute position on the stack one past the last slot used by the
+// currently executing function.
+void gc_collect(HyState *state, uint32_t stack_top) {
+	stack_top = stack_extent(state, stack_top);
+	state->gc.collections++;
+
+	// Always empty the nursery, and only collect old space if it's grown large
+	// enough
+	gc_minor(state, stack_top);
+	if (state->gc.allocated > state->gc.threshold) {
+		gc_major(state, stack_top);
+	}
+
+	// Stack slots above the top may still hold pointers to objects we just
+	// freed (or into the nursery), so clear them to ensure they never get
+	// treated as roots during a later collection
+	for (uint32_t i = stack_top; i < state->stack_capacity; i++) {
+		state->stack[i] = VALUE_NIL;
+	}
+}
@@ -0,0 +1,176 @@
+
+//
+//  Garbage Collector
+//
+
+#ifndef GC_H
+#define GC_H
+
+#include <hydrogen.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <vec.h>
+
+// * The heap is split into two generations: a small nursery, and old space
+// * Most new objects are allocated in the nursery, a single contiguous block of
+//   memory, simply by incrementing a pointer
+// * Most objects die young (eg. temporary strings created by concatenation in
+//   a loop), so when the nursery fills up we perform a minor collection,
+//   copying the few objects still reachable out of the nursery into old
+//   space, then reset the nursery's pointer back to its start
+// * Objects in old space are individually heap allocated, and linked into a
+//   single list on the interpreter state, so that the collector can find every
+//   old object that exists at any point in time
+// * Old space is collected by a simple mark and sweep collector. Starting from
+//   a set of roots (the stack, top level package locals, constants, etc.), we
+//   mark every object that's reachable, then walk the list of old objects,
+//   freeing every object that wasn't marked
+// * A minor collection doesn't look at every old object, so any old object
+//   that might reference an object in the nursery is recorded in a remembered
+//   set by a write barrier, and treated as an extra root
+// * Marking uses an explicit stack of grey objects (marked but whose children
+//   haven't been traced yet), so deeply nested objects can't overflow the C
+//   stack
+// * Collections only ever happen at the start of instructions which allocate,
+//   when every live value is guaranteed to be stored somewhere we can find it
+//   (ie. never in a temporary C variable)
+
+
+
+//
+//  Objects
+//
+
+// The type of an object stored on the heap.
+typedef enum {
+	OBJ_STRING,
+	OBJ_STRUCT,
+	OBJ_NATIVE_STRUCT,
+	OBJ_METHOD,
+	OBJ_NATIVE_METHOD,
+	OBJ_ARRAY,
+	OBJ_FLOAT_ARRAY,
+	OBJ_MAP,
+	OBJ_CLOSURE,
+	OBJ_UPVALUE,
+} ObjType;
+
+
+// Objects are stored in values as pointers to heap allocated blocks of memory
+// Since these pointers don't contain any type information about what the object
+// is (ie. string, struct, etc), each object must have a header containing that
+// information.
+//
+// This only acts as a header for other, type specific objects, which all
+// require this general information to be accessible in a consistent manner.
+// The header also contains the information required by the garbage collector:
+// whether the object has been marked in the current collection, whether it's
+// in the remembered set, and a link to the next object in the list of old
+// objects. Objects in the nursery aren't part of this list, so instead use
+// `next` to store the address an object was copied to during a minor
+// collection (or NULL if it hasn't been copied yet).
+#define ObjHeader        \
+	ObjType type;        \
+	bool mark;           \
+	bool remembered;     \
+	struct object *next;
+
+
+// Since we require a general pointer to objects (ignoring specific types),
+// create a struct containing common information between objects.
+typedef struct object {
+	ObjHeader;
+} Object;
+
+
+
+//
+//  Collector
+//
+
+// The number of bytes we allocate in old space before triggering the first
+// major collection.
+#define GC_INITIAL_THRESHOLD (1024 * 1024)
+
+// The size of the nursery, in bytes.
+#define GC_NURSERY_SIZE (512 * 1024)
+
+// Objects larger than this are allocated directly in old space, since copying
+// them out of the nursery would be expensive. A minor collection is triggered
+// once the nursery has less than this much space remaining.
+#define GC_NURSERY_MAX_OBJECT 4096
+
+// Round an allocation size up so every object in the nursery is 8 byte
+// aligned.
+#define GC_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+// After a collection, the next one will be triggered once the number of bytes
+// allocated grows to this multiple of the number of bytes that survived.
+#define GC_GROWTH_FACTOR 2
+
+
+// Garbage collector state, stored on the interpreter state.
+typedef struct {
+	// The nursery's memory, the position of the next object to be allocated in
+	// it, and the end of the nursery's memory.
+	char *nursery;
+	char *nursery_top;
+	char *nursery_end;
+
+	// The head of a linked list of every object allocated in old space.
+	Object *objects;
+
+	// The number of bytes currently allocated to old objects (plus the contents
+	// of all arrays), and the number of bytes at which we'll trigger the next
+	// major collection.
+	size_t allocated;
+	size_t threshold;
+
+	// The number of collections performed so far, used to invalidate inline
+	// caches holding pointers to objects.
+	uint32_t collections;
+
+	// Old objects that might reference an object in the nursery.
+	Vec(Object *) remembered;
+
+	// A stack of objects that have been marked, but whose children haven't been
+	// traced yet.
+	Vec(Object *) grey;
+} GarbageCollector;
+
+
+// Create a new garbage collector.
+void gc_new(GarbageCollector *gc);
+
+// Free every object allocated by a garbage collector, as well as the
+// collector itself.
+void gc_free(HyState *state, GarbageCollector *gc);
+
+// Allocate a new object of type `type` that is `size` bytes large. Never
+// triggers a collection, so it's safe to call at any point during execution.
+void * gc_alloc(HyState *state, ObjType type, size_t size);
+
+// Add an old object to the remembered set.
+void gc_remember(GarbageCollector *gc, Object *obj);
+
+// Free all objects unreachable from the interpreter's roots. `stack_top` is
+// the absolute position on the stack one past the last slot used by the
+// currently executing function.
+void gc_collect(HyState *state, uint32_t stack_top);
+
+
+// Return true if an object lives in the nursery.
+static inline bool gc_in_nursery(GarbageCollector *gc, void *obj) {
+	return (char *) obj >= gc->nursery && (char *) obj < gc->nursery_end;
+}
+
+
+// Return true if the nursery is nearly full, or enough memory has been
+// allocated in old space since the last collection that we should trigger
+// another one.
+static inline bool gc_should_collect(GarbageCollector *gc) {
+	return gc->nursery_end - gc->nursery_top < GC_NURSERY_MAX_OBJECT ||
+		gc->allocated > gc->threshold;
+}
+
+#endif
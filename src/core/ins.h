@@ -39,4 +39,18 @@ static inline Instruction ins_set(Instruction ins, uint32_t n, uint16_t value) {
 	return cleared | (((uint64_t) value) << (n << 4));
 }
 
+
+// Return the generic form of an instruction's opcode, undoing any quickening
+// performed by the interpreter.
+static inline BytecodeOpcode ins_generic_opcode(BytecodeOpcode opcode) {
+	if (opcode >= ADD_LL_NUM && opcode <= MOD_LL_NUM) {
+		return (BytecodeOpcode) (ADD_LL + (opcode - ADD_LL_NUM) * 5);
+	} else if (opcode == MOD_LL_INT) {
+		return MOD_LL;
+	} else if (opcode == MOD_LI_INT) {
+		return MOD_LI;
+	}
+	return opcode;
+}
+
 #endif
@@ -0,0 +1,1066 @@
+
+//
+//  Tracing JIT Compiler
+//
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "jit.h"
+#include "state.h"
+#include "value.h"
+#include "jmp.h"
+
+#ifdef JIT_SUPPORTED
+#include <math.h>
+#include <sys/mman.h>
+#endif
+
+
+// Create a new JIT compiler.
+void jit_new(Jit *jit) {
+#ifdef JIT_SUPPORTED
+	jit->enabled = true;
+#else
+	jit->enabled = false;
+#endif
+	jit->show_info = false;
+	vec_new(jit->loops, JitLoop, 8);
+	jit->recording = NOT_FOUND;
+	jit->recording_start = 0;
+	vec_new(jit->trace, uint32_t, 64);
+}
+
+
+// Free the JIT compiler, and the machine code for every compiled trace.
+void jit_free(Jit *jit) {
+#ifdef JIT_SUPPORTED
+	for (uint32_t i = 0; i < vec_len(jit->loops); i++) {
+		JitLoop *loop = &vec_at(jit->loops, i);
+		if (loop->trace != NULL) {
+			munmap((void *) loop->trace, loop->size);
+		}
+	}
+#endif
+	vec_free(jit->loops);
+	vec_free(jit->trace);
+}
+
+
+// Enable or disable the JIT compiler. Has no effect on platforms the JIT
+// doesn't support.
+void hy_set_jit(HyState *state, bool enabled) {
+#ifdef JIT_SUPPORTED
+	state->jit.enabled = enabled;
+#else
+	(void) state;
+	(void) enabled;
+#endif
+}
+
+
+// Print information about every trace the JIT compiles (or fails to compile)
+// to the standard error output.
+void hy_set_jit_info(HyState *state, bool show) {
+	state->jit.show_info = show;
+}
+
+
+// Return the argument of a LOOP or FOR_LOOP instruction storing the index of
+// its loop in the JIT's list of loops.
+static inline uint32_t loop_index_arg(BytecodeOpcode opcode) {
+	return (opcode == LOOP) ? 2 : 3;
+}
+
+
+// Give every LOOP and FOR_LOOP instruction in a function an entry in the JIT's
+// list of loops. Must be called after the function has been parsed, but before
+// it's executed.
+void jit_fn_prepare(HyState *state, Index fn_index) {
+	Function *fn = &vec_at(state->functions, fn_index);
+	for (uint32_t i = 0; i < vec_len(fn->instructions); i++) {
+		Instruction *ins = &vec_at(fn->instructions, i);
+		BytecodeOpcode opcode = ins_arg(*ins, 0);
+		if (opcode != LOOP && opcode != FOR_LOOP) {
+			continue;
+		}
+
+		// The loop's index has to fit into an instruction argument
+		Index index = vec_len(state->jit.loops);
+		if (index >= JIT_NO_LOOP) {
+			*ins = ins_set(*ins, loop_index_arg(opcode), JIT_NO_LOOP);
+			continue;
+		}
+
+		vec_inc(state->jit.loops);
+		JitLoop *loop = &vec_last(state->jit.loops);
+		loop->fn = fn_index;
+		loop->pc = i;
+		loop->hotness = 0;
+		loop->aborts = 0;
+		loop->trace = NULL;
+		loop->size = 0;
+		*ins = ins_set(*ins, loop_index_arg(opcode), index);
+	}
+}
+
+
+// Print the location of a loop, used when showing JIT information.
+static void print_loop(HyState *state, JitLoop *loop) {
+	Function *fn = &vec_at(state->functions, loop->fn);
+	Instruction ins = vec_at(fn->instructions, loop->pc);
+	uint32_t offset_arg = (ins_arg(ins, 0) == LOOP) ? 1 : 2;
+	uint32_t header = loop->pc - ins_arg(ins, offset_arg);
+	if (fn->name != NULL) {
+		fprintf(stderr, "`%.*s`", fn->length, fn->name);
+	} else {
+		fprintf(stderr, "<main>");
+	}
+	fprintf(stderr, " (instructions %d-%d)", header, loop->pc);
+}
+
+
+// Stop recording the current trace without compiling it.
+void jit_record_abort(HyState *state, char *reason) {
+	Jit *jit = &state->jit;
+	JitLoop *loop = &vec_at(jit->loops, jit->recording);
+	jit->recording = NOT_FOUND;
+
+	// Try again later, unless we've failed too many times already
+	loop->aborts++;
+	if (loop->aborts < JIT_MAX_ABORTS) {
+		loop->hotness = 0;
+	}
+
+	if (jit->show_info) {
+		fprintf(stderr, "[jit] Aborted trace for loop in ");
+		print_loop(state, loop);
+		fprintf(stderr, ": %s\n", reason);
+	}
+}
+
+
+// Start recording a trace for a loop, which has just taken its back-edge in a
+// function whose stack frame starts at `stack_start`. Returns false if we
+// can't record the loop.
+bool jit_record_start(HyState *state, Index loop, uint32_t stack_start) {
+#ifdef JIT_SUPPORTED
+	Jit *jit = &state->jit;
+	if (jit->recording != NOT_FOUND) {
+		return false;
+	}
+
+	jit->recording = loop;
+	jit->recording_start = stack_start;
+	vec_len(jit->trace) = 0;
+	return true;
+#else
+	(void) state;
+	(void) loop;
+	(void) stack_start;
+	return false;
+#endif
+}
+
+
+
+//
+//  Recording
+//
+
+#ifdef JIT_SUPPORTED
+
+// Forward declaration.
+static Trace trace_compile(HyState *state, JitLoop *loop, size_t *size);
+
+
+// Returns true if a slot holds a number.
+static inline bool slot_is_num(HyValue *frame, uint16_t slot) {
+	return val_is_num(frame[slot]);
+}
+
+
+// Returns true if we're able to compile an instruction, given the values of
+// its arguments on the stack at the time it was recorded.
+static bool record_supported(HyValue *frame, Instruction ins) {
+	BytecodeOpcode opcode = ins_generic_opcode(ins_arg(ins, 0));
+	if (jmp_is_fused(opcode)) {
+		opcode = jmp_unfused(opcode);
+	}
+
+	switch (opcode) {
+	case MOV_LL: case MOV_LI: case MOV_LN: case MOV_LP:
+	case MOV_LT: case MOV_TL: case MOV_TI: case MOV_TN: case MOV_TP:
+	case EQ_LI: case EQ_LN: case EQ_LP:
+	case NEQ_LI: case NEQ_LN: case NEQ_LP:
+	case IS_TRUE_L: case IS_FALSE_L:
+	case JMP: case LOOP: case FOR_LOOP:
+		return true;
+
+		// Both arguments must be numbers
+	case ADD_LL: case SUB_LL: case MUL_LL: case DIV_LL: case MOD_LL:
+		return slot_is_num(frame, ins_arg(ins, 2)) &&
+			slot_is_num(frame, ins_arg(ins, 3));
+	case EQ_LL: case NEQ_LL:
+	case LT_LL: case LE_LL: case GT_LL: case GE_LL:
+		return slot_is_num(frame, ins_arg(ins, 1)) &&
+			slot_is_num(frame, ins_arg(ins, 2));
+
+		// Only the first argument is a slot
+	case NEG_L:
+	case ADD_LI: case SUB_LI: case MUL_LI: case DIV_LI: case MOD_LI:
+	case ADD_LN: case SUB_LN: case MUL_LN: case DIV_LN: case MOD_LN:
+		return slot_is_num(frame, ins_arg(ins, 2));
+	case LT_LI: case LE_LI: case GT_LI: case GE_LI:
+	case LT_LN: case LE_LN: case GT_LN: case GE_LN:
+		return slot_is_num(frame, ins_arg(ins, 1));
+
+		// Only the second argument is a slot
+	case ADD_IL: case SUB_IL: case MUL_IL: case DIV_IL: case MOD_IL:
+	case ADD_NL: case SUB_NL: case MUL_NL: case DIV_NL: case MOD_NL:
+		return slot_is_num(frame, ins_arg(ins, 3));
+
+	default:
+		return false;
+	}
+}
+
+#endif
+
+
+// Record an instruction that's about to be executed. Compiles the trace once
+// we've recorded the whole loop. Returns false once recording is finished,
+// either because the trace was compiled or recording was aborted.
+bool jit_record(HyState *state, Function *fn, uint32_t stack_start,
+		Instruction *ip) {
+#ifdef JIT_SUPPORTED
+	Jit *jit = &state->jit;
+	JitLoop *loop = &vec_at(jit->loops, jit->recording);
+
+	// Calls and returns are never recorded, so we can't have left the loop's
+	// function, but check anyway
+	if (fn != &vec_at(state->functions, loop->fn) ||
+			stack_start != jit->recording_start) {
+		jit_record_abort(state, "left function");
+		return false;
+	}
+
+	// Check we can compile the instruction
+	uint32_t pc = ip - &vec_at(fn->instructions, 0);
+	HyValue *frame = &state->stack[stack_start];
+	if (!record_supported(frame, *ip)) {
+		jit_record_abort(state, "unsupported instruction");
+		return false;
+	} else if ((ins_arg(*ip, 0) == LOOP || ins_arg(*ip, 0) == FOR_LOOP) &&
+			pc != loop->pc) {
+		jit_record_abort(state, "nested loop");
+		return false;
+	} else if (vec_len(jit->trace) >= JIT_MAX_TRACE) {
+		jit_record_abort(state, "trace too long");
+		return false;
+	}
+
+	vec_inc(jit->trace);
+	vec_last(jit->trace) = pc;
+
+	// Keep recording until we get back to the loop's back-edge
+	if (pc != loop->pc) {
+		return true;
+	}
+
+	// Compile the trace
+	clock_t start = clock();
+	size_t size = 0;
+	Trace trace = trace_compile(state, loop, &size);
+	if (trace == NULL) {
+		jit_record_abort(state, "type mismatch");
+		return false;
+	}
+
+	loop->trace = trace;
+	loop->size = size;
+	jit->recording = NOT_FOUND;
+
+	if (jit->show_info) {
+		double ms = (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+		fprintf(stderr, "[jit] Compiled trace for loop in ");
+		print_loop(state, loop);
+		fprintf(stderr, ": %d instructions, %zu bytes of machine code, "
+			"%.3f ms\n", vec_len(jit->trace), size, ms);
+	}
+	return false;
+#else
+	(void) state;
+	(void) fn;
+	(void) stack_start;
+	(void) ip;
+	return false;
+#endif
+}
+
+
+
+//
+//  Assembler
+//
+
+#ifdef JIT_SUPPORTED
+
+// Registers used by the generated code. The frame pointer is kept in RBX and
+// the list of packages in R12 for the whole trace, since they're preserved
+// across calls.
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define XMM0 0
+#define XMM1 1
+#define XMM2 2
+
+// Condition codes for the second byte of a conditional jump.
+#define JB  0x82
+#define JAE 0x83
+#define JE  0x84
+#define JNE 0x85
+#define JBE 0x86
+#define JA  0x87
+#define JP  0x8a
+#define JLE 0x8e
+
+
+// A conditional jump to a side exit, which is patched once we've emitted the
+// code for the exit after the loop.
+typedef struct {
+	// The offset of the jump's 32 bit displacement in the machine code.
+	uint32_t patch;
+
+	// The instruction the interpreter should resume at.
+	uint32_t pc;
+} SideExit;
+
+
+// Builds the machine code for a trace.
+typedef struct {
+	Vec(uint8_t) code;
+	Vec(SideExit) exits;
+} Assembler;
+
+
+// Append a byte of machine code.
+static void emit(Assembler *as, uint8_t byte) {
+	vec_inc(as->code);
+	vec_last(as->code) = byte;
+}
+
+
+// Append a little endian 32 bit integer.
+static void emit_u32(Assembler *as, uint32_t value) {
+	for (uint32_t i = 0; i < 4; i++) {
+		emit(as, (value >> (i * 8)) & 0xff);
+	}
+}
+
+
+// Append a little endian 64 bit integer.
+static void emit_u64(Assembler *as, uint64_t value) {
+	for (uint32_t i = 0; i < 8; i++) {
+		emit(as, (value >> (i * 8)) & 0xff);
+	}
+}
+
+
+// Append a ModRM byte addressing a stack slot relative to RBX, followed by
+// its 32 bit displacement.
+static void emit_slot(Assembler *as, uint32_t reg, uint16_t slot) {
+	emit(as, 0x83 | (reg << 3));
+	emit_u32(as, (uint32_t) slot * sizeof(HyValue));
+}
+
+
+// mov reg, imm64
+static void emit_mov_imm(Assembler *as, uint32_t reg, uint64_t value) {
+	emit(as, 0x48);
+	emit(as, 0xb8 + reg);
+	emit_u64(as, value);
+}
+
+
+// mov reg, [rbx + slot * 8]
+static void emit_load(Assembler *as, uint32_t reg, uint16_t slot) {
+	emit(as, 0x48);
+	emit(as, 0x8b);
+	emit_slot(as, reg, slot);
+}
+
+
+// mov [rbx + slot * 8], reg
+static void emit_store(Assembler *as, uint16_t slot, uint32_t reg) {
+	emit(as, 0x48);
+	emit(as, 0x89);
+	emit_slot(as, reg, slot);
+}
+
+
+// movsd xmm, [rbx + slot * 8]
+static void emit_load_num(Assembler *as, uint32_t xmm, uint16_t slot) {
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x10);
+	emit_slot(as, xmm, slot);
+}
+
+
+// movsd [rbx + slot * 8], xmm
+static void emit_store_num(Assembler *as, uint16_t slot, uint32_t xmm) {
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x11);
+	emit_slot(as, xmm, slot);
+}
+
+
+// Load a pointer to the top level locals of a package into RAX.
+static void emit_locals(Assembler *as, uint16_t pkg) {
+	// mov rax, [r12 + offset]
+	emit(as, 0x49);
+	emit(as, 0x8b);
+	emit(as, 0x84);
+	emit(as, 0x24);
+	emit_u32(as, pkg * sizeof(Package) + offsetof(Package, locals.values));
+}
+
+
+// mov rcx, [rax + local * 8]
+static void emit_load_local(Assembler *as, uint16_t local) {
+	emit(as, 0x48);
+	emit(as, 0x8b);
+	emit(as, 0x88);
+	emit_u32(as, (uint32_t) local * sizeof(HyValue));
+}
+
+
+// mov [rax + local * 8], rcx
+static void emit_store_local(Assembler *as, uint16_t local) {
+	emit(as, 0x48);
+	emit(as, 0x89);
+	emit(as, 0x88);
+	emit_u32(as, (uint32_t) local * sizeof(HyValue));
+}
+
+
+// Load a constant number into an XMM register.
+static void emit_num_imm(Assembler *as, uint32_t xmm, double number) {
+	emit_mov_imm(as, RAX, num_to_val(number));
+
+	// movq xmm, rax
+	emit(as, 0x66);
+	emit(as, 0x48);
+	emit(as, 0x0f);
+	emit(as, 0x6e);
+	emit(as, 0xc0 | (xmm << 3) | RAX);
+}
+
+
+// cmp rax, rcx
+static void emit_cmp(Assembler *as) {
+	emit(as, 0x48);
+	emit(as, 0x39);
+	emit(as, 0xc8);
+}
+
+
+// ucomisd left, right
+static void emit_ucomisd(Assembler *as, uint32_t left, uint32_t right) {
+	emit(as, 0x66);
+	emit(as, 0x0f);
+	emit(as, 0x2e);
+	emit(as, 0xc0 | (left << 3) | right);
+}
+
+
+// Emit a jump to a location within the trace that hasn't been emitted yet,
+// returning the offset to patch once it has (see `emit_land`). A `condition`
+// of 0 emits an unconditional jump.
+static uint32_t emit_jump(Assembler *as, uint8_t condition) {
+	if (condition == 0) {
+		emit(as, 0xe9);
+	} else {
+		emit(as, 0x0f);
+		emit(as, condition);
+	}
+	uint32_t patch = vec_len(as->code);
+	emit_u32(as, 0);
+	return patch;
+}
+
+
+// Point a jump emitted by `emit_jump` at the current end of the machine code.
+static void emit_land(Assembler *as, uint32_t patch) {
+	uint32_t offset = vec_len(as->code) - (patch + 4);
+	memcpy(&vec_at(as->code, patch), &offset, sizeof(uint32_t));
+}
+
+
+// Convert the number in an XMM register to a 32 bit integer in a general
+// purpose register, emitting jumps (added to `slow`) taken if the number isn't
+// exactly representable as one. Uses XMM2 as scratch.
+static void emit_to_int(Assembler *as, uint32_t reg, uint32_t xmm,
+		uint32_t *slow) {
+	// cvttsd2si reg, xmm
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x2c);
+	emit(as, 0xc0 | (reg << 3) | xmm);
+
+	// cvtsi2sd xmm2, reg
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x2a);
+	emit(as, 0xc0 | (XMM2 << 3) | reg);
+
+	// Converting back must give the same number (which also excludes NaNs)
+	emit_ucomisd(as, XMM2, xmm);
+	slow[0] = emit_jump(as, JNE);
+	slow[1] = emit_jump(as, JP);
+}
+
+
+// Emit a conditional jump to a side exit, which resumes the interpreter at
+// the instruction `pc`.
+static void emit_exit(Assembler *as, uint8_t condition, uint32_t pc) {
+	emit(as, 0x0f);
+	emit(as, condition);
+
+	vec_inc(as->exits);
+	vec_last(as->exits).patch = vec_len(as->code);
+	vec_last(as->exits).pc = pc;
+	emit_u32(as, 0);
+}
+
+
+// Emit the code for every side exit, and patch the jumps to them.
+static void emit_exits(Assembler *as) {
+	for (uint32_t i = 0; i < vec_len(as->exits); i++) {
+		SideExit *exit = &vec_at(as->exits, i);
+		uint32_t target = vec_len(as->code);
+		uint32_t offset = target - (exit->patch + 4);
+		memcpy(&vec_at(as->code, exit->patch), &offset, sizeof(uint32_t));
+
+		// mov eax, pc; pop rcx; pop r12; pop rbx; ret
+		emit(as, 0xb8);
+		emit_u32(as, exit->pc);
+		emit(as, 0x59);
+		emit(as, 0x41);
+		emit(as, 0x5c);
+		emit(as, 0x5b);
+		emit(as, 0xc3);
+	}
+}
+
+
+
+//
+//  Code Generation
+//
+
+// What we know about the type of a value in a stack slot at a point in a
+// trace.
+typedef enum {
+	KIND_UNKNOWN,
+	KIND_NUM,
+	KIND_PRIM,
+} SlotKind;
+
+
+// State used while compiling a trace.
+typedef struct {
+	HyState *state;
+	Function *fn;
+	Assembler as;
+
+	// The kind of value in each stack slot of the function.
+	uint8_t *kinds;
+
+	// Set to false if the trace can't be compiled.
+	bool ok;
+} Compiler;
+
+
+// Ensure a stack slot holds a number before it's read, emitting a type guard
+// which exits to the instruction at `pc` if we don't already know the slot's
+// type.
+static void compile_guard_num(Compiler *c, uint16_t slot, uint32_t pc) {
+	if (slot > c->fn->frame_size) {
+		c->ok = false;
+		return;
+	}
+	if (c->kinds[slot] == KIND_NUM) {
+		return;
+	} else if (c->kinds[slot] == KIND_PRIM) {
+		// The trace itself stores something other than a number here
+		c->ok = false;
+		return;
+	}
+
+	// A value is a number if it isn't a quiet NaN
+	Assembler *as = &c->as;
+	emit_load(as, RAX, slot);
+	emit_mov_imm(as, RCX, QUIET_NAN);
+
+	// and rax, rcx
+	emit(as, 0x48);
+	emit(as, 0x21);
+	emit(as, 0xc8);
+
+	emit_cmp(as);
+	emit_exit(as, JE, pc);
+	c->kinds[slot] = KIND_NUM;
+}
+
+
+// Set what we know about the value stored into a slot.
+static void compile_write(Compiler *c, uint16_t slot, SlotKind kind) {
+	if (slot > c->fn->frame_size) {
+		c->ok = false;
+		return;
+	}
+	c->kinds[slot] = kind;
+}
+
+
+// Load an instruction argument into an XMM register as a number. `type` is
+// either 'L' (a stack slot), 'I' (a signed integer), or 'N' (a constant).
+static void compile_operand(Compiler *c, uint32_t xmm, char type,
+		uint16_t arg) {
+	switch (type) {
+	case 'L':
+		emit_load_num(&c->as, xmm, arg);
+		break;
+	case 'I':
+		emit_num_imm(&c->as, xmm, (double) unsigned_to_signed(arg));
+		break;
+	case 'N':
+		emit_num_imm(&c->as, xmm,
+			val_to_num(vec_at(c->state->constants, arg)));
+		break;
+	}
+}
+
+
+// Compile the remainder of XMM0 and XMM1 into XMM0. Uses integer division when
+// both are 32 bit integers and the divisor is positive, and `fmod` otherwise.
+static void compile_mod(Assembler *as) {
+	uint32_t slow[5];
+	emit_to_int(as, RAX, XMM0, &slow[0]);
+	emit_to_int(as, RCX, XMM1, &slow[2]);
+
+	// test ecx, ecx
+	emit(as, 0x85);
+	emit(as, 0xc9);
+	slow[4] = emit_jump(as, JLE);
+
+	// cdq; idiv ecx; test edx, edx
+	emit(as, 0x99);
+	emit(as, 0xf7);
+	emit(as, 0xf9);
+	emit(as, 0x85);
+	emit(as, 0xd2);
+	uint32_t zero = emit_jump(as, JE);
+
+	// cvtsi2sd xmm0, edx
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x2a);
+	emit(as, 0xc0 | (XMM0 << 3) | RDX);
+	uint32_t done = emit_jump(as, 0);
+
+	// A zero remainder takes the sign of the dividend, like `fmod`, so
+	// multiply the dividend by zero: xorpd xmm2, xmm2; mulsd xmm0, xmm2
+	emit_land(as, zero);
+	emit(as, 0x66);
+	emit(as, 0x0f);
+	emit(as, 0x57);
+	emit(as, 0xd2);
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x59);
+	emit(as, 0xc2);
+	uint32_t zero_done = emit_jump(as, 0);
+
+	// Otherwise call `fmod`, which takes and returns its arguments in XMM
+	// registers. The stack is already 16 byte aligned by the trace's prologue
+	for (uint32_t i = 0; i < 5; i++) {
+		emit_land(as, slow[i]);
+	}
+	emit_mov_imm(as, RAX, (uint64_t) (uintptr_t) &fmod);
+
+	// call rax
+	emit(as, 0xff);
+	emit(as, 0xd0);
+
+	emit_land(as, done);
+	emit_land(as, zero_done);
+}
+
+
+// Compile an arithmetic instruction. `op` is the SSE2 opcode for the
+// operation, or 0 for modulo. `left` and `right` are the types of the
+// instruction's operands.
+static void compile_arith(Compiler *c, Instruction ins, uint32_t pc,
+		uint8_t op, char left, char right) {
+	uint16_t dest = ins_arg(ins, 1);
+	if (left == 'L') {
+		compile_guard_num(c, ins_arg(ins, 2), pc);
+	}
+	if (right == 'L') {
+		compile_guard_num(c, ins_arg(ins, 3), pc);
+	}
+
+	Assembler *as = &c->as;
+	compile_operand(c, XMM0, left, ins_arg(ins, 2));
+	compile_operand(c, XMM1, right, ins_arg(ins, 3));
+
+	if (op == 0) {
+		compile_mod(as);
+	} else {
+		// op xmm0, xmm1
+		emit(as, 0xf2);
+		emit(as, 0x0f);
+		emit(as, op);
+		emit(as, 0xc1);
+	}
+
+	emit_store_num(as, dest, XMM0);
+	compile_write(c, dest, KIND_NUM);
+}
+
+
+// Compile a conditional instruction, which skips the following JMP if
+// `condition` is set in the flags register. Exits the trace if the branch
+// doesn't go the same way it did when the trace was recorded, where `next` is
+// the index of the instruction executed after this one.
+static void compile_branch(Compiler *c, uint32_t pc, uint32_t next,
+		uint8_t condition) {
+	if (next == pc + 2) {
+		// The JMP was skipped, so exit if the condition is false
+		emit_exit(&c->as, condition ^ 1, pc + 1);
+	} else {
+		// The JMP was taken, so exit if the condition is true
+		emit_exit(&c->as, condition, pc + 2);
+	}
+}
+
+
+// Compile an equality comparison, which compares the raw bits of the value in
+// the slot in the first argument against `value` (in RCX).
+static void compile_eq(Compiler *c, Instruction ins, uint32_t pc,
+		uint32_t next, bool negate) {
+	emit_load(&c->as, RAX, ins_arg(ins, 1));
+	emit_cmp(&c->as);
+
+	// EQ skips the jump if the values aren't equal
+	compile_branch(c, pc, next, negate ? JE : JNE);
+}
+
+
+// Compile an ordering comparison. `type` is the type of the second operand
+// (see `compile_operand`). The interpreter skips the jump when the comparison
+// is false, so the condition we test for is the inverted comparison.
+static void compile_ord(Compiler *c, Instruction ins, uint32_t pc,
+		uint32_t next, char type) {
+	compile_guard_num(c, ins_arg(ins, 1), pc);
+	if (type == 'L') {
+		compile_guard_num(c, ins_arg(ins, 2), pc);
+	}
+	compile_operand(c, XMM0, 'L', ins_arg(ins, 1));
+	compile_operand(c, XMM1, type, ins_arg(ins, 2));
+
+	// NaNs set the carry flag, so arrange the comparison so the jump condition
+	// is false if either value is NaN, just like in C
+	BytecodeOpcode opcode = ins_arg(ins, 0);
+	if (opcode >= LT_LL && opcode <= LT_LN) {
+		// Skip if left >= right
+		emit_ucomisd(&c->as, XMM0, XMM1);
+		compile_branch(c, pc, next, JAE);
+	} else if (opcode >= LE_LL && opcode <= LE_LN) {
+		// Skip if left > right
+		emit_ucomisd(&c->as, XMM0, XMM1);
+		compile_branch(c, pc, next, JA);
+	} else if (opcode >= GT_LL && opcode <= GT_LN) {
+		// Skip if left <= right
+		emit_ucomisd(&c->as, XMM1, XMM0);
+		compile_branch(c, pc, next, JAE);
+	} else {
+		// Skip if left < right
+		emit_ucomisd(&c->as, XMM1, XMM0);
+		compile_branch(c, pc, next, JA);
+	}
+}
+
+
+// Compile the FOR_LOOP instruction at the end of a trace for a numeric for
+// loop, which increments the loop's counter and exits the trace once it
+// reaches the limit.
+static void compile_for_loop(Compiler *c, Instruction ins, uint32_t pc) {
+	Assembler *as = &c->as;
+	uint16_t base = ins_arg(ins, 1);
+	emit_load_num(as, XMM0, base);
+	emit_num_imm(as, XMM1, 1.0);
+
+	// addsd xmm0, xmm1
+	emit(as, 0xf2);
+	emit(as, 0x0f);
+	emit(as, 0x58);
+	emit(as, 0xc1);
+	emit_store_num(as, base, XMM0);
+
+	// Exit unless the limit is greater than the counter, which is also the
+	// case if either is NaN
+	emit_load_num(as, XMM1, base + 1);
+	emit_ucomisd(as, XMM1, XMM0);
+	emit_exit(as, JBE, pc + 1);
+	emit_store_num(as, base + 2, XMM0);
+}
+
+
+// Compile a single instruction in a trace. `next` is the index of the
+// instruction that was executed after this one.
+static void compile_ins(Compiler *c, uint32_t pc, uint32_t next) {
+	Assembler *as = &c->as;
+	Instruction ins = vec_at(c->fn->instructions, pc);
+	BytecodeOpcode opcode = ins_generic_opcode(ins_arg(ins, 0));
+
+	// Fused comparisons behave exactly like their unfused counterparts, since
+	// the JMP following them is still there to exit to
+	if (jmp_is_fused(opcode)) {
+		opcode = jmp_unfused(opcode);
+	}
+	ins = ins_set(ins, 0, opcode);
+
+	// Arithmetic instructions come in groups of 5 (LL, LI, LN, IL, NL)
+	static const char left_types[] = {'L', 'L', 'L', 'I', 'N'};
+	static const char right_types[] = {'L', 'I', 'N', 'L', 'L'};
+	static const uint8_t arith_ops[] = {0x58, 0x5c, 0x59, 0x5e, 0};
+	if (opcode >= ADD_LL && opcode <= MOD_NL) {
+		uint32_t variant = (opcode - ADD_LL) % 5;
+		uint32_t op = (opcode - ADD_LL) / 5;
+		compile_arith(c, ins, pc, arith_ops[op], left_types[variant],
+			right_types[variant]);
+		return;
+	}
+
+	switch (opcode) {
+	case MOV_LL: {
+		uint16_t src = ins_arg(ins, 2);
+		if (src > c->fn->frame_size) {
+			c->ok = false;
+			return;
+		}
+		emit_load(as, RAX, src);
+		emit_store(as, ins_arg(ins, 1), RAX);
+		compile_write(c, ins_arg(ins, 1), c->kinds[src]);
+		break;
+	}
+	case MOV_LI:
+	case MOV_LN: {
+		HyValue value = (opcode == MOV_LI) ? int_to_val(ins_arg(ins, 2)) :
+			vec_at(c->state->constants, ins_arg(ins, 2));
+		emit_mov_imm(as, RAX, value);
+		emit_store(as, ins_arg(ins, 1), RAX);
+		compile_write(c, ins_arg(ins, 1), KIND_NUM);
+		break;
+	}
+	case MOV_LP:
+		emit_mov_imm(as, RAX, prim_to_val(ins_arg(ins, 2)));
+		emit_store(as, ins_arg(ins, 1), RAX);
+		compile_write(c, ins_arg(ins, 1), KIND_PRIM);
+		break;
+
+	case MOV_LT:
+		// We don't know the type of a top level local
+		emit_locals(as, ins_arg(ins, 3));
+		emit_load_local(as, ins_arg(ins, 2));
+		emit_store(as, ins_arg(ins, 1), RCX);
+		compile_write(c, ins_arg(ins, 1), KIND_UNKNOWN);
+		break;
+	case MOV_TL:
+		if (ins_arg(ins, 2) > c->fn->frame_size) {
+			c->ok = false;
+			return;
+		}
+		emit_load(as, RCX, ins_arg(ins, 2));
+		emit_locals(as, ins_arg(ins, 3));
+		emit_store_local(as, ins_arg(ins, 1));
+		break;
+	case MOV_TI:
+	case MOV_TN:
+	case MOV_TP: {
+		HyValue value = prim_to_val(ins_arg(ins, 2));
+		if (opcode == MOV_TI) {
+			value = int_to_val(ins_arg(ins, 2));
+		} else if (opcode == MOV_TN) {
+			value = vec_at(c->state->constants, ins_arg(ins, 2));
+		}
+		emit_mov_imm(as, RCX, value);
+		emit_locals(as, ins_arg(ins, 3));
+		emit_store_local(as, ins_arg(ins, 1));
+		break;
+	}
+
+	case NEG_L:
+		compile_guard_num(c, ins_arg(ins, 2), pc);
+		emit_load(as, RAX, ins_arg(ins, 2));
+
+		// btc rax, 63
+		emit(as, 0x48);
+		emit(as, 0x0f);
+		emit(as, 0xba);
+		emit(as, 0xf8);
+		emit(as, 0x3f);
+
+		emit_store(as, ins_arg(ins, 1), RAX);
+		compile_write(c, ins_arg(ins, 1), KIND_NUM);
+		break;
+
+	case IS_TRUE_L:
+	case IS_FALSE_L:
+		// False and nil are the only falsy values, and differ only in their
+		// lowest bit
+		emit_load(as, RAX, ins_arg(ins, 1));
+
+		// or rax, 1
+		emit(as, 0x48);
+		emit(as, 0x83);
+		emit(as, 0xc8);
+		emit(as, 0x01);
+
+		emit_mov_imm(as, RCX, VALUE_NIL);
+		emit_cmp(as);
+
+		// IS_TRUE skips the jump if the value is falsy
+		compile_branch(c, pc, next, opcode == IS_TRUE_L ? JE : JNE);
+		break;
+
+	case EQ_LL:
+	case NEQ_LL:
+		// Both values are numbers, so comparing their bits matches `val_cmp`
+		compile_guard_num(c, ins_arg(ins, 1), pc);
+		compile_guard_num(c, ins_arg(ins, 2), pc);
+		emit_load(as, RCX, ins_arg(ins, 2));
+		compile_eq(c, ins, pc, next, opcode == NEQ_LL);
+		break;
+	case EQ_LI:
+	case NEQ_LI:
+		emit_mov_imm(as, RCX, int_to_val(ins_arg(ins, 2)));
+		compile_eq(c, ins, pc, next, opcode == NEQ_LI);
+		break;
+	case EQ_LN:
+	case NEQ_LN:
+		emit_mov_imm(as, RCX, vec_at(c->state->constants, ins_arg(ins, 2)));
+		compile_eq(c, ins, pc, next, opcode == NEQ_LN);
+		break;
+	case EQ_LP:
+	case NEQ_LP:
+		emit_mov_imm(as, RCX, prim_to_val(ins_arg(ins, 2)));
+		compile_eq(c, ins, pc, next, opcode == NEQ_LP);
+		break;
+
+	case LT_LL: case LE_LL: case GT_LL: case GE_LL:
+		compile_ord(c, ins, pc, next, 'L');
+		break;
+	case LT_LI: case LE_LI: case GT_LI: case GE_LI:
+		compile_ord(c, ins, pc, next, 'I');
+		break;
+	case LT_LN: case LE_LN: case GT_LN: case GE_LN:
+		compile_ord(c, ins, pc, next, 'N');
+		break;
+
+	case JMP:
+		// The trace already follows the jump
+		break;
+
+	default:
+		c->ok = false;
+		break;
+	}
+}
+
+
+// Copy `size` bytes of machine code into executable memory.
+static void * code_map(uint8_t *code, size_t size) {
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		return NULL;
+	}
+
+	memcpy(memory, code, size);
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, size);
+		return NULL;
+	}
+	return memory;
+}
+
+
+// Compile the recorded trace for a loop into machine code. Returns NULL if
+// the trace can't be compiled.
+static Trace trace_compile(HyState *state, JitLoop *loop, size_t *size) {
+	Jit *jit = &state->jit;
+	Compiler c;
+	c.state = state;
+	c.fn = &vec_at(state->functions, loop->fn);
+	c.ok = true;
+	c.kinds = calloc(c.fn->frame_size + 1, sizeof(uint8_t));
+	vec_new(c.as.code, uint8_t, 256);
+	vec_new(c.as.exits, SideExit, 16);
+
+	// push rbx; push r12; push rax; mov rbx, rdi; mov r12, rsi. The extra
+	// push keeps the stack 16 byte aligned for calls
+	emit(&c.as, 0x53);
+	emit(&c.as, 0x41);
+	emit(&c.as, 0x54);
+	emit(&c.as, 0x50);
+	emit(&c.as, 0x48);
+	emit(&c.as, 0x89);
+	emit(&c.as, 0xfb);
+	emit(&c.as, 0x49);
+	emit(&c.as, 0x89);
+	emit(&c.as, 0xf4);
+
+	// Compile everything except the final LOOP instruction. We don't know
+	// anything about the stack at the start of each iteration, except that a
+	// numeric for loop's counter, limit, and variable are numbers
+	Instruction back_edge = vec_at(c.fn->instructions, loop->pc);
+	bool for_loop = ins_arg(back_edge, 0) == FOR_LOOP;
+	for (uint32_t i = 0; for_loop && i < 3; i++) {
+		compile_write(&c, ins_arg(back_edge, 1) + i, KIND_NUM);
+	}
+	uint32_t loop_start = vec_len(c.as.code);
+	uint32_t count = vec_len(jit->trace);
+	for (uint32_t i = 0; i + 1 < count && c.ok; i++) {
+		compile_ins(&c, vec_at(jit->trace, i), vec_at(jit->trace, i + 1));
+	}
+	if (for_loop) {
+		compile_for_loop(&c, back_edge, loop->pc);
+	}
+
+	// jmp loop_start
+	emit(&c.as, 0xe9);
+	emit_u32(&c.as, loop_start - (vec_len(c.as.code) + 4));
+	emit_exits(&c.as);
+
+	Trace trace = NULL;
+	if (c.ok) {
+		*size = vec_len(c.as.code);
+		trace = (Trace) code_map(&vec_at(c.as.code, 0), *size);
+	}
+
+	free(c.kinds);
+	vec_free(c.as.code);
+	vec_free(c.as.exits);
+	return trace;
+}
+
+#endif
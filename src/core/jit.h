@@ -0,0 +1,127 @@
+
+//
+//  Tracing JIT Compiler
+//
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <hydrogen.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <vec.h>
+
+#include "fn.h"
+#include "pkg.h"
+
+// * Loops are where a program spends most of its time, so every LOOP and
+//   FOR_LOOP instruction counts how many times its back-edge is taken
+// * Once a loop gets hot, we record a trace through it: the interpreter swaps
+//   to a dispatch table that calls the recorder before executing each
+//   instruction, until execution arrives back at the loop's back-edge
+// * The recorded instructions form a single path through the loop's body,
+//   which we compile into x86-64 machine code specialised for numbers. Guards
+//   check the types of values read from the stack and the direction taken by
+//   each branch
+// * Values always live in their stack slots, so when a guard fails we just
+//   return the index of the instruction the interpreter should resume at (a
+//   side exit), without needing to restore any state
+// * Only a small subset of instructions (moves between stack slots and top
+//   level locals, arithmetic, comparisons, and jumps) can be compiled. Traces
+//   containing anything else are aborted, and a loop that fails to record too
+//   many times is never traced again
+
+// The JIT compiler emits x86-64 code using the System V calling convention.
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED
+#endif
+
+// The number of times a loop's back-edge must be taken before we trace it.
+#define JIT_HOT_LOOP 50
+
+// The maximum number of instructions in a trace.
+#define JIT_MAX_TRACE 512
+
+// The number of times recording a trace for a loop can fail before we give up
+// on the loop.
+#define JIT_MAX_ABORTS 3
+
+// Stored in the second argument of a LOOP instruction (or the third of a
+// FOR_LOOP) when the loop couldn't be given an entry in the JIT's list of
+// loops.
+#define JIT_NO_LOOP 0xffff
+
+
+// A compiled trace. Takes a pointer to the start of the stack frame for the
+// function containing the loop and the list of packages (for top level
+// locals), and runs until a side exit is taken, returning the index of the
+// instruction the interpreter should resume at.
+typedef uint32_t (* Trace)(HyValue *frame, Package *packages);
+
+
+// Information about each LOOP and FOR_LOOP instruction in every function.
+typedef struct {
+	// The function containing the loop, and the index of the LOOP or FOR_LOOP
+	// instruction in it.
+	Index fn;
+	uint32_t pc;
+
+	// The number of times the loop's back-edge has been taken, and the number
+	// of times recording a trace for the loop has been aborted.
+	uint32_t hotness;
+	uint32_t aborts;
+
+	// The compiled trace for the loop (or NULL if it hasn't been compiled
+	// yet), and the size of the memory mapped for its machine code.
+	Trace trace;
+	size_t size;
+} JitLoop;
+
+
+// JIT compiler state, stored on the interpreter state.
+typedef struct {
+	// Whether traces are recorded and executed, and whether to print
+	// information about each trace to the standard error output.
+	bool enabled;
+	bool show_info;
+
+	// Every loop in every function.
+	Vec(JitLoop) loops;
+
+	// The loop we're currently recording a trace for (or NOT_FOUND), and the
+	// start of the stack frame for the function containing it.
+	Index recording;
+	uint32_t recording_start;
+
+	// The index of each instruction executed so far in the trace being
+	// recorded.
+	Vec(uint32_t) trace;
+} Jit;
+
+
+// Create a new JIT compiler.
+void jit_new(Jit *jit);
+
+// Free the JIT compiler, and the machine code for every compiled trace.
+void jit_free(Jit *jit);
+
+// Give every LOOP instruction in a function an entry in the JIT's list of
+// loops. Must be called after the function has been parsed, but before it's
+// executed.
+void jit_fn_prepare(HyState *state, Index fn_index);
+
+// Start recording a trace for a loop, which has just taken its back-edge in a
+// function whose stack frame starts at `stack_start`. Returns false if we
+// can't record the loop.
+bool jit_record_start(HyState *state, Index loop, uint32_t stack_start);
+
+// Record an instruction that's about to be executed. Compiles the trace once
+// we've recorded the whole loop. Returns false once recording is finished,
+// either because the trace was compiled or recording was aborted.
+bool jit_record(HyState *state, Function *fn, uint32_t stack_start,
+	Instruction *ip);
+
+// Stop recording the current trace without compiling it.
+void jit_record_abort(HyState *state, char *reason);
+
+#endif
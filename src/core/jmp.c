@@ -55,3 +55,29 @@ void jmp_invert_condition(Function *fn, Index jump) {
 	BytecodeOpcode inverted = jmp_inverted_opcode(current);
 	vec_at(fn->instructions, jump - 1) = ins_set(ins, 0, inverted);
 }
+
+
+// Replace every comparison in a function's bytecode with its fused
+// counterpart, which jumps straight to the target of the JMP instruction
+// following it. Must be called once the function has been fully parsed.
+void jmp_fuse(Function *fn) {
+	for (Index i = 0; i + 1 < vec_len(fn->instructions); i++) {
+		Instruction ins = vec_at(fn->instructions, i);
+		BytecodeOpcode opcode = ins_arg(ins, 0);
+		if (opcode < IS_TRUE_L || opcode > GE_LN) {
+			continue;
+		}
+
+		// The JMP is left where it is, since other jumps might target it. Its
+		// target must still be representable relative to the comparison
+		Instruction jump = vec_at(fn->instructions, i + 1);
+		uint32_t offset = ins_arg(jump, JMP_TARGET_ARG) + 1;
+		if (ins_arg(jump, 0) != JMP || offset > UINT16_MAX) {
+			continue;
+		}
+
+		BytecodeOpcode fused = IS_TRUE_L_JMP + (opcode - IS_TRUE_L);
+		ins = ins_set(ins, 0, fused);
+		vec_at(fn->instructions, i) = ins_set(ins, 3, offset);
+	}
+}
@@ -7,6 +7,7 @@
 #define JMP_H
 
 #include <vec.h>
+#include <stdbool.h>
 
 #include "ins.h"
 #include "fn.h"
@@ -130,4 +131,21 @@ void jmp_false_case(Function *fn, Index jump, Index target);
 // Invert the condition of a conditional jump operation.
 void jmp_invert_condition(Function *fn, Index jump);
 
+// Replace every comparison in a function's bytecode with its fused
+// counterpart, which jumps straight to the target of the JMP instruction
+// following it. Must be called once the function has been fully parsed.
+void jmp_fuse(Function *fn);
+
+
+// Return true if an opcode is a fused comparison.
+static inline bool jmp_is_fused(BytecodeOpcode opcode) {
+	return opcode >= IS_TRUE_L_JMP && opcode <= GE_LN_JMP;
+}
+
+
+// Return the unfused comparison opcode for a fused one.
+static inline BytecodeOpcode jmp_unfused(BytecodeOpcode opcode) {
+	return (BytecodeOpcode) (IS_TRUE_L + (opcode - IS_TRUE_L_JMP));
+}
+
 #endif
@@ -421,6 +421,7 @@ static bool lex_keyword(Lexer *lexer) {
 	KEYWORD("while", TOKEN_WHILE)
 	KEYWORD("loop", TOKEN_LOOP)
 	KEYWORD("for", TOKEN_FOR)
+	KEYWORD("in", TOKEN_IN)
 	KEYWORD("break", TOKEN_BREAK)
 	KEYWORD("let", TOKEN_LET)
 	KEYWORD("fn", TOKEN_FN)
@@ -536,6 +537,7 @@ void lexer_next(Lexer *lexer) {
 	case '{': set(lexer, TOKEN_OPEN_BRACE); break;
 	case '}': set(lexer, TOKEN_CLOSE_BRACE); break;
 	case ',': set(lexer, TOKEN_COMMA); break;
+	case ':': set(lexer, TOKEN_COLON); break;
 	case '+': set_2(lexer, TOKEN_ADD, '=', TOKEN_ADD_ASSIGN); break;
 	case '-': set_2(lexer, TOKEN_SUB, '=', TOKEN_SUB_ASSIGN); break;
 	case '*': set_2(lexer, TOKEN_MUL, '=', TOKEN_MUL_ASSIGN); break;
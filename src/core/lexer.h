@@ -59,6 +59,7 @@ typedef enum {
 	TOKEN_CLOSE_BRACE,
 	TOKEN_COMMA,
 	TOKEN_DOT,
+	TOKEN_COLON,
 
 	// Values
 	TOKEN_IDENTIFIER,
@@ -77,6 +78,7 @@ typedef enum {
 	TOKEN_LOOP,
 	TOKEN_BREAK,
 	TOKEN_FOR,
+	TOKEN_IN,
 	TOKEN_LET,
 	TOKEN_FN,
 	TOKEN_RETURN,
@@ -6,13 +6,70 @@
 #include <stdio.h>
 
 #include "lib.h"
+#include "err.h"
 #include "value.h"
+#include "state.h"
+#include "map.h"
+#include "numeric.h"
+#include "text.h"
 
 
 // Will evaluate to the largest of two numbers.
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 
+// A list of core methods on strings, shared between all string instances.
+CoreMethod string_core_methods[STRING_CORE_METHODS_COUNT] = {
+	{"len", 0, string_len},
+	{"slice", 2, string_slice_method},
+	{"find", 1, string_find},
+	{"contains", 1, string_contains},
+	{"starts_with", 1, string_starts_with},
+	{"split", 1, string_split},
+	{"replace", 2, string_replace},
+	{"trim", 0, string_trim},
+	{"lower", 0, string_lower},
+	{"upper", 0, string_upper},
+	{"byte_at", 1, string_byte_at},
+};
+
+
+// A list of core methods on arrays, shared between all array instances.
+CoreMethod array_core_methods[ARRAY_CORE_METHODS_COUNT] = {
+	{"len", 0, array_len},
+	{"push", HY_VAR_ARG, array_push},
+	{"insert", 2, array_insert},
+	{"remove", 1, array_remove},
+	{"pop", 0, array_pop},
+	{"floats", 0, array_floats},
+	{"slice", 2, array_slice_method},
+};
+
+
+// A list of core methods on float arrays, shared between all float array
+// instances.
+CoreMethod float_array_core_methods[FLOAT_ARRAY_CORE_METHODS_COUNT] = {
+	{"len", 0, float_array_len},
+	{"push", HY_VAR_ARG, float_array_push},
+	{"pop", 0, float_array_pop},
+	{"sum", 0, float_array_sum},
+	{"min", 0, float_array_min},
+	{"max", 0, float_array_max},
+	{"dot", 1, float_array_dot},
+	{"scale", 1, float_array_scale},
+	{"add", 1, float_array_add},
+};
+
+
+// A list of core methods on maps, shared between all map instances.
+CoreMethod map_core_methods[MAP_CORE_METHODS_COUNT] = {
+	{"len", 0, map_len},
+	{"get", 1, map_get},
+	{"set", 2, map_set},
+	{"remove", 1, map_remove},
+};
+
+
 // Find a core method with the given name.
 Index core_method_find(CoreMethod *methods, uint32_t methods_count, char *name,
 		uint32_t length) {
@@ -38,6 +95,225 @@ HyValue string_len(HyState *state, void *obj, HyArgs *args) {
 }
 
 
+// Read the bounds of a slice from the two arguments to a native method,
+// triggering an error and returning false if they aren't integers (or nil)
+// with 0 <= start <= end <= length.
+static bool slice_bounds(HyState *state, HyArgs *args, uint32_t length,
+		uint32_t *start, uint32_t *end) {
+	if (slice_bound(hy_arg(args, 0), 0, length, start) &&
+			slice_bound(hy_arg(args, 1), length, length, end) &&
+			*start <= *end) {
+		return true;
+	}
+	err_native(state, "Slice bounds must be integers within the array or "
+		"string");
+	return false;
+}
+
+
+// Return a new string containing the characters from a start index up to (but
+// not including) an end index.
+HyValue string_slice_method(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	uint32_t start, end;
+	if (!slice_bounds(state, args, string->length, &start, &end)) {
+		return VALUE_NIL;
+	}
+	return ptr_to_val(string_slice(state, string, start, end));
+}
+
+
+// Return the argument at `index` to a native method if it's a string, or
+// trigger an error and return NULL otherwise.
+static String * string_arg(HyState *state, HyArgs *args, uint32_t index) {
+	HyValue arg = hy_arg(args, index);
+	if (!val_is_gc(arg, OBJ_STRING)) {
+		err_native(state, "Expected string as argument %u", index + 1);
+		return NULL;
+	}
+	return val_to_ptr(arg);
+}
+
+
+// Return the index of the first occurrence of a substring, or nil if the
+// string doesn't contain it.
+HyValue string_find(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *needle = string_arg(state, args, 0);
+	if (needle == NULL) {
+		return VALUE_NIL;
+	}
+
+	Index index = text_find(string->contents, string->length, needle->contents,
+		needle->length, 0);
+	return (index == NOT_FOUND) ? VALUE_NIL : num_to_val((double) index);
+}
+
+
+// Return true if a string contains a substring.
+HyValue string_contains(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *needle = string_arg(state, args, 0);
+	if (needle == NULL) {
+		return VALUE_NIL;
+	}
+
+	Index index = text_find(string->contents, string->length, needle->contents,
+		needle->length, 0);
+	return (index == NOT_FOUND) ? VALUE_FALSE : VALUE_TRUE;
+}
+
+
+// Return true if a string starts with a prefix.
+HyValue string_starts_with(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *prefix = string_arg(state, args, 0);
+	if (prefix == NULL) {
+		return VALUE_NIL;
+	}
+
+	bool matches = prefix->length <= string->length &&
+		memcmp(string->contents, prefix->contents, prefix->length) == 0;
+	return matches ? VALUE_TRUE : VALUE_FALSE;
+}
+
+
+// Return an array of the pieces of a string between each occurrence of a
+// separator.
+HyValue string_split(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *separator = string_arg(state, args, 0);
+	if (separator == NULL) {
+		return VALUE_NIL;
+	} else if (separator->length == 0) {
+		err_native(state, "Cannot split a string on an empty separator");
+		return VALUE_NIL;
+	}
+
+	// Count the separators first, so the array is allocated at its final size
+	char *contents = string->contents;
+	uint32_t count = text_count(contents, string->length, separator->contents,
+		separator->length);
+	Array *pieces = array_new(state, count + 1);
+
+	uint32_t start = 0;
+	for (uint32_t i = 0; i <= count; i++) {
+		Index end = text_find(contents, string->length, separator->contents,
+			separator->length, start);
+		if (end == NOT_FOUND) {
+			end = string->length;
+		}
+
+		HyValue piece = ptr_to_val(string_slice(state, string, start, end));
+		pieces->contents[i] = piece;
+		gc_write_barrier(&state->gc, pieces, piece);
+		start = end + separator->length;
+	}
+	return ptr_to_val(pieces);
+}
+
+
+// Return a copy of a string with every occurrence of one substring replaced
+// by another.
+HyValue string_replace(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *from = string_arg(state, args, 0);
+	String *to = string_arg(state, args, 1);
+	if (from == NULL || to == NULL) {
+		return VALUE_NIL;
+	} else if (from->length == 0) {
+		err_native(state, "Cannot replace an empty string");
+		return VALUE_NIL;
+	}
+
+	// Strings are immutable, so there's no need to copy one without any
+	// occurrences
+	uint32_t count = text_count(string->contents, string->length,
+		from->contents, from->length);
+	if (count == 0) {
+		return ptr_to_val(string);
+	}
+
+	// Copy everything between occurrences into a string of the final length
+	uint32_t length = string->length - count * from->length +
+		count * to->length;
+	String *result = string_new(state, length);
+	char *cursor = result->contents;
+	uint32_t start = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		Index end = text_find(string->contents, string->length, from->contents,
+			from->length, start);
+		memcpy(cursor, &string->contents[start], end - start);
+		cursor += end - start;
+		memcpy(cursor, to->contents, to->length);
+		cursor += to->length;
+		start = end + from->length;
+	}
+	memcpy(cursor, &string->contents[start], string->length - start);
+	result->contents[length] = '\0';
+	return ptr_to_val(result);
+}
+
+
+// Return a string with the whitespace removed from both ends.
+HyValue string_trim(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	uint32_t start = 0;
+	uint32_t end = string->length;
+	while (start < end && text_is_space(string->contents[start])) {
+		start++;
+	}
+	while (end > start && text_is_space(string->contents[end - 1])) {
+		end--;
+	}
+
+	if (start == 0 && end == string->length) {
+		return ptr_to_val(string);
+	}
+	return ptr_to_val(string_slice(state, string, start, end));
+}
+
+
+// Return a copy of a string with every ASCII letter in lowercase.
+HyValue string_lower(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *result = string_new(state, string->length);
+	text_lower(result->contents, string->contents, string->length);
+	result->contents[result->length] = '\0';
+	return ptr_to_val(result);
+}
+
+
+// Return a copy of a string with every ASCII letter in uppercase.
+HyValue string_upper(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	String *result = string_new(state, string->length);
+	text_upper(result->contents, string->contents, string->length);
+	result->contents[result->length] = '\0';
+	return ptr_to_val(result);
+}
+
+
+// Return the byte at an index in a string as a number, or nil if the index is
+// out of bounds.
+HyValue string_byte_at(HyState *state, void *obj, HyArgs *args) {
+	String *string = (String *) obj;
+	HyValue arg = hy_arg(args, 0);
+	if (!val_is_num(arg)) {
+		err_native(state, "Expected number as byte index");
+		return VALUE_NIL;
+	}
+
+	// Also rejects NaN and fractional indices
+	double index = val_to_num(arg);
+	if (!(index >= 0 && index < string->length) ||
+			index != (double) (uint32_t) index) {
+		return VALUE_NIL;
+	}
+	return num_to_val((double) (uint8_t) string->contents[(uint32_t) index]);
+}
+
+
 
 //
 //  Arrays
@@ -50,11 +326,15 @@ HyValue array_len(HyState *state, void *obj, HyArgs *args) {
 
 
 // Increase the capacity of an array to hold at least `minimum` elements.
-static void array_resize(Array *array, uint32_t minimum) {
+static void array_resize(HyState *state, Array *array, uint32_t minimum) {
 	if (array->capacity < minimum) {
+		uint32_t old_size = sizeof(HyValue) * array->capacity;
 		array->capacity = MAX(array->capacity *= 2, minimum);
 		uint32_t new_size = sizeof(HyValue) * array->capacity;
 		array->contents = realloc(array->contents, new_size);
+
+		// Let the garbage collector know about the additional memory
+		state->gc.allocated += new_size - old_size;
 	}
 }
 
@@ -62,9 +342,10 @@ static void array_resize(Array *array, uint32_t minimum) {
 // Append an element to the end of an array.
 HyValue array_push(HyState *state, void *obj, HyArgs *args) {
 	Array *array = (Array *) obj;
+	array_own(state, array);
 
 	// Resize the array to hold the required number of additional elements
-	array_resize(array, array->length + hy_args_count(args));
+	array_resize(state, array, array->length + hy_args_count(args));
 
 	// Increment the length
 	uint32_t start = array->length;
@@ -73,6 +354,7 @@ HyValue array_push(HyState *state, void *obj, HyArgs *args) {
 	// Add each element in the arguments
 	for (uint32_t i = 0; i < hy_args_count(args); i++) {
 		array->contents[start + i] = hy_arg(args, i);
+		gc_write_barrier(&state->gc, array, array->contents[start + i]);
 	}
 
 	return VALUE_NIL;
@@ -88,9 +370,10 @@ HyValue array_insert(HyState *state, void *obj, HyArgs *args) {
 	}
 
 	Array *array = (Array *) obj;
+	array_own(state, array);
 
 	// Resize the array to hold the additional element
-	array_resize(array, array->length + 1);
+	array_resize(state, array, array->length + 1);
 
 	// Move everything after the index right one element
 	int32_t size = (array->length - index) * sizeof(HyValue);
@@ -101,6 +384,7 @@ HyValue array_insert(HyState *state, void *obj, HyArgs *args) {
 
 	// Set the element
 	array->contents[index] = hy_arg(args, 1);
+	gc_write_barrier(&state->gc, array, array->contents[index]);
 
 	return VALUE_NIL;
 }
@@ -115,6 +399,7 @@ HyValue array_remove(HyState *state, void *obj, HyArgs *args) {
 	}
 
 	Array *array = (Array *) obj;
+	array_own(state, array);
 
 	// Move everything to the right of the index left one element
 	int32_t size = (array->length - index - 1) * sizeof(HyValue);
@@ -140,3 +425,213 @@ HyValue array_pop(HyState *state, void *obj, HyArgs *args) {
 	// Return the last element
 	return value;
 }
+
+
+// Return a float array containing the elements of an array, which must all be
+// numbers.
+HyValue array_floats(HyState *state, void *obj, HyArgs *args) {
+	Array *array = (Array *) obj;
+	for (uint32_t i = 0; i < array->length; i++) {
+		if (!val_is_num(array->contents[i])) {
+			err_native(state, "Expected number at index %u of array", i);
+			return VALUE_NIL;
+		}
+	}
+
+	FloatArray *floats = float_array_new(state, array->length);
+	for (uint32_t i = 0; i < array->length; i++) {
+		floats->contents[i] = val_to_num(array->contents[i]);
+	}
+	return ptr_to_val(floats);
+}
+
+
+// Return a slice of an array from a start index up to (but not including) an
+// end index. The slice shares its elements with the array until either one is
+// modified.
+HyValue array_slice_method(HyState *state, void *obj, HyArgs *args) {
+	Array *array = (Array *) obj;
+	uint32_t start, end;
+	if (!slice_bounds(state, args, array->length, &start, &end)) {
+		return VALUE_NIL;
+	}
+	return ptr_to_val(array_slice(state, array, start, end));
+}
+
+
+
+//
+//  Float Arrays
+//
+
+// Return the number of elements in a float array.
+HyValue float_array_len(HyState *state, void *obj, HyArgs *args) {
+	return num_to_val((double) ((FloatArray *) obj)->length);
+}
+
+
+// Append numbers to the end of a float array.
+HyValue float_array_push(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	uint32_t count = hy_args_count(args);
+	for (uint32_t i = 0; i < count; i++) {
+		if (!val_is_num(hy_arg(args, i))) {
+			err_native(state, "Expected number to push onto float array");
+			return VALUE_NIL;
+		}
+	}
+
+	float_array_resize(state, array, array->length + count);
+	for (uint32_t i = 0; i < count; i++) {
+		array->contents[array->length + i] = val_to_num(hy_arg(args, i));
+	}
+	array->length += count;
+	return VALUE_NIL;
+}
+
+
+// Remove the last element from a float array, and return it.
+HyValue float_array_pop(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	if (array->length == 0) {
+		return VALUE_NIL;
+	}
+	array->length--;
+	return num_to_val(array->contents[array->length]);
+}
+
+
+// Return the sum of the elements in a float array.
+HyValue float_array_sum(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	return num_to_val(numeric_sum(array->contents, array->length));
+}
+
+
+// Return the smallest element in a float array, or nil if it's empty.
+HyValue float_array_min(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	if (array->length == 0) {
+		return VALUE_NIL;
+	}
+	return num_to_val(numeric_min(array->contents, array->length));
+}
+
+
+// Return the largest element in a float array, or nil if it's empty.
+HyValue float_array_max(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	if (array->length == 0) {
+		return VALUE_NIL;
+	}
+	return num_to_val(numeric_max(array->contents, array->length));
+}
+
+
+// Return the float array passed as the only argument to a method on `array`.
+// Reports an error and returns NULL if the argument isn't a float array of the
+// same length.
+static FloatArray * float_array_arg(HyState *state, FloatArray *array,
+		HyArgs *args) {
+	HyValue arg = hy_arg(args, 0);
+	if (!val_is_gc(arg, OBJ_FLOAT_ARRAY)) {
+		err_native(state, "Expected float array");
+		return NULL;
+	}
+
+	FloatArray *other = val_to_ptr(arg);
+	if (other->length != array->length) {
+		err_native(state, "Expected float array of length %u, found length %u",
+			array->length, other->length);
+		return NULL;
+	}
+	return other;
+}
+
+
+// Return the dot product of two float arrays of the same length.
+HyValue float_array_dot(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	FloatArray *other = float_array_arg(state, array, args);
+	if (other == NULL) {
+		return VALUE_NIL;
+	}
+	return num_to_val(numeric_dot(array->contents, other->contents,
+		array->length));
+}
+
+
+// Multiply every element in a float array by a number, in place.
+HyValue float_array_scale(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	HyValue factor = hy_arg(args, 0);
+	if (!val_is_num(factor)) {
+		err_native(state, "Expected number to scale float array by");
+		return VALUE_NIL;
+	}
+	numeric_scale(array->contents, array->length, val_to_num(factor));
+	return VALUE_NIL;
+}
+
+
+// Add each element of another float array of the same length to the
+// corresponding element in this one, in place.
+HyValue float_array_add(HyState *state, void *obj, HyArgs *args) {
+	FloatArray *array = (FloatArray *) obj;
+	FloatArray *other = float_array_arg(state, array, args);
+	if (other == NULL) {
+		return VALUE_NIL;
+	}
+	numeric_add(array->contents, other->contents, array->length);
+	return VALUE_NIL;
+}
+
+
+
+//
+//  Maps
+//
+
+// Return the number of keys in a map.
+HyValue map_len(HyState *state, void *obj, HyArgs *args) {
+	return num_to_val((double) ((Map *) obj)->length);
+}
+
+
+// Return the value stored against a key in a map, or nil if the key isn't in
+// the map.
+HyValue map_get(HyState *state, void *obj, HyArgs *args) {
+	HyValue key = hy_arg(args, 0);
+	if (!map_key_is_valid(key)) {
+		err_native(state, "Invalid map key");
+		return VALUE_NIL;
+	}
+
+	MapEntry *entry = map_find((Map *) obj, key);
+	return (entry == NULL) ? VALUE_NIL : entry->value;
+}
+
+
+// Set the value stored against a key in a map.
+HyValue map_set(HyState *state, void *obj, HyArgs *args) {
+	HyValue key = hy_arg(args, 0);
+	if (!map_key_is_valid(key)) {
+		err_native(state, "Invalid map key");
+		return VALUE_NIL;
+	}
+
+	map_insert(state, (Map *) obj, key, hy_arg(args, 1));
+	return VALUE_NIL;
+}
+
+
+// Remove a key from a map, returning true if the key was in the map.
+HyValue map_remove(HyState *state, void *obj, HyArgs *args) {
+	HyValue key = hy_arg(args, 0);
+	if (!map_key_is_valid(key)) {
+		err_native(state, "Invalid map key");
+		return VALUE_NIL;
+	}
+
+	return map_delete((Map *) obj, key) ? VALUE_TRUE : VALUE_FALSE;
+}
@@ -17,6 +17,41 @@
 // Return the number of characters in a string.
 HyValue string_len(HyState *state, void *string, HyArgs *args);
 
+// Return a new string containing the characters from a start index up to (but
+// not including) an end index.
+HyValue string_slice_method(HyState *state, void *obj, HyArgs *args);
+
+// Return the index of the first occurrence of a substring, or nil if the
+// string doesn't contain it.
+HyValue string_find(HyState *state, void *obj, HyArgs *args);
+
+// Return true if a string contains a substring.
+HyValue string_contains(HyState *state, void *obj, HyArgs *args);
+
+// Return true if a string starts with a prefix.
+HyValue string_starts_with(HyState *state, void *obj, HyArgs *args);
+
+// Return an array of the pieces of a string between each occurrence of a
+// separator.
+HyValue string_split(HyState *state, void *obj, HyArgs *args);
+
+// Return a copy of a string with every occurrence of one substring replaced
+// by another.
+HyValue string_replace(HyState *state, void *obj, HyArgs *args);
+
+// Return a string with the whitespace removed from both ends.
+HyValue string_trim(HyState *state, void *obj, HyArgs *args);
+
+// Return a copy of a string with every ASCII letter in lowercase.
+HyValue string_lower(HyState *state, void *obj, HyArgs *args);
+
+// Return a copy of a string with every ASCII letter in uppercase.
+HyValue string_upper(HyState *state, void *obj, HyArgs *args);
+
+// Return the byte at an index in a string as a number, or nil if the index is
+// out of bounds.
+HyValue string_byte_at(HyState *state, void *obj, HyArgs *args);
+
 
 
 //
@@ -38,6 +73,68 @@ HyValue array_remove(HyState *state, void *obj, HyArgs *args);
 // Remove the last element from the array, and return it.
 HyValue array_pop(HyState *state, void *obj, HyArgs *args);
 
+// Return a float array containing the elements of an array, which must all be
+// numbers.
+HyValue array_floats(HyState *state, void *obj, HyArgs *args);
+
+// Return a slice of an array from a start index up to (but not including) an
+// end index. The slice shares its elements with the array until either one is
+// modified.
+HyValue array_slice_method(HyState *state, void *obj, HyArgs *args);
+
+
+
+//
+//  Float Arrays
+//
+
+// Return the number of elements in a float array.
+HyValue float_array_len(HyState *state, void *obj, HyArgs *args);
+
+// Append numbers to the end of a float array.
+HyValue float_array_push(HyState *state, void *obj, HyArgs *args);
+
+// Remove the last element from a float array, and return it.
+HyValue float_array_pop(HyState *state, void *obj, HyArgs *args);
+
+// Return the sum of the elements in a float array.
+HyValue float_array_sum(HyState *state, void *obj, HyArgs *args);
+
+// Return the smallest element in a float array, or nil if it's empty.
+HyValue float_array_min(HyState *state, void *obj, HyArgs *args);
+
+// Return the largest element in a float array, or nil if it's empty.
+HyValue float_array_max(HyState *state, void *obj, HyArgs *args);
+
+// Return the dot product of two float arrays of the same length.
+HyValue float_array_dot(HyState *state, void *obj, HyArgs *args);
+
+// Multiply every element in a float array by a number, in place.
+HyValue float_array_scale(HyState *state, void *obj, HyArgs *args);
+
+// Add each element of another float array of the same length to the
+// corresponding element in this one, in place.
+HyValue float_array_add(HyState *state, void *obj, HyArgs *args);
+
+
+
+//
+//  Maps
+//
+
+// Return the number of keys in a map.
+HyValue map_len(HyState *state, void *obj, HyArgs *args);
+
+// Return the value stored against a key in a map, or nil if the key isn't in
+// the map.
+HyValue map_get(HyState *state, void *obj, HyArgs *args);
+
+// Set the value stored against a key in a map.
+HyValue map_set(HyState *state, void *obj, HyArgs *args);
+
+// Remove a key from a map, returning true if the key was in the map.
+HyValue map_remove(HyState *state, void *obj, HyArgs *args);
+
 
 
 //
@@ -45,10 +142,16 @@ HyValue array_pop(HyState *state, void *obj, HyArgs *args);
 //
 
 // The nubmer of methods defined on strings.
-#define STRING_CORE_METHODS_COUNT 1
+#define STRING_CORE_METHODS_COUNT 11
 
 // The number of methods defined on arrays.
-#define ARRAY_CORE_METHODS_COUNT 5
+#define ARRAY_CORE_METHODS_COUNT 7
+
+// The number of methods defined on float arrays.
+#define FLOAT_ARRAY_CORE_METHODS_COUNT 9
+
+// The number of methods defined on maps.
+#define MAP_CORE_METHODS_COUNT 4
 
 
 // A method available on a core data type.
@@ -64,20 +167,18 @@ typedef struct {
 } CoreMethod;
 
 
-// A list of core methods on strings.
-static CoreMethod string_core_methods[STRING_CORE_METHODS_COUNT] = {
-	{"len", 0, string_len},
-};
+// A list of core methods on strings, shared between all string instances.
+extern CoreMethod string_core_methods[STRING_CORE_METHODS_COUNT];
+
+// A list of core methods on arrays, shared between all array instances.
+extern CoreMethod array_core_methods[ARRAY_CORE_METHODS_COUNT];
 
+// A list of core methods on float arrays, shared between all float array
+// instances.
+extern CoreMethod float_array_core_methods[FLOAT_ARRAY_CORE_METHODS_COUNT];
 
-// A list of core methods on arrays.
-static CoreMethod array_core_methods[ARRAY_CORE_METHODS_COUNT] = {
-	{"len", 0, array_len},
-	{"push", HY_VAR_ARG, array_push},
-	{"insert", 2, array_insert},
-	{"remove", 1, array_remove},
-	{"pop", 0, array_pop},
-};
+// A list of core methods on maps, shared between all map instances.
+extern CoreMethod map_core_methods[MAP_CORE_METHODS_COUNT];
 
 
 // Find a core method with the given name.
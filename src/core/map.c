@@ -0,0 +1,278 @@
+
+//
+//  Maps
+//
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "map.h"
+#include "state.h"
+
+
+// Return the smallest capacity for a map that can hold `count` keys without
+// exceeding a load factor of 7/8.
+static uint32_t map_capacity(uint32_t count) {
+	if (count == 0) {
+		return 0;
+	}
+
+	uint32_t capacity = MAP_GROUP_SIZE;
+	while (capacity / 8 * 7 < count) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+
+// Allocate the control bytes and entries for a map with the given capacity,
+// marking every slot as empty.
+static void map_alloc(HyState *state, Map *map, uint32_t capacity) {
+	map->capacity = capacity;
+	map->tombstones = 0;
+	if (capacity == 0) {
+		map->control = NULL;
+		map->entries = NULL;
+		return;
+	}
+
+	// The capacity is a multiple of the group size, so the entries after the
+	// control bytes are suitably aligned
+	map->control = malloc(MAP_SLOT_SIZE * capacity);
+	map->entries = (MapEntry *) &map->control[capacity];
+	memset(map->control, MAP_EMPTY, capacity);
+	state->gc.allocated += MAP_SLOT_SIZE * capacity;
+}
+
+
+// Create a new map with enough room for `count` keys before it has to grow.
+// Allocates, so must only be called when a garbage collection is safe.
+Map * map_new(HyState *state, uint32_t count) {
+	Map *map = gc_alloc(state, OBJ_MAP, sizeof(Map));
+	map->length = 0;
+	map_alloc(state, map, map_capacity(count));
+	return map;
+}
+
+
+// Free the slots allocated by a map. Doesn't free the map object itself.
+void map_free(HyState *state, Map *map) {
+	state->gc.allocated -= MAP_SLOT_SIZE * map->capacity;
+	free(map->control);
+}
+
+
+
+//
+//  Hashing
+//
+
+// Return true if a value can be used as a key in a map.
+bool map_key_is_valid(HyValue key) {
+	return !val_is_ptr(key) || val_is_gc(key, OBJ_STRING);
+}
+
+
+// Hash a key. The low bits of the hash select the group a key starts probing
+// from, and the top 7 bits are stored in the key's control byte.
+static inline uint32_t key_hash(HyValue key) {
+	if (val_is_ptr(key)) {
+		return string_hash_get(val_to_ptr(key));
+	}
+
+	// Mix every bit of the value into the lower 32 (the finaliser from
+	// MurmurHash3), since the interesting bits of numbers are mostly in the
+	// upper half
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return (uint32_t) key;
+}
+
+
+// Return the control byte for a full slot holding a key with the given hash.
+static inline uint8_t hash_control(uint32_t hash) {
+	return hash >> 25;
+}
+
+
+// Return true if two keys are equal.
+static inline bool key_cmp(HyValue left, HyValue right) {
+	return left == right || (val_is_gc(left, OBJ_STRING) &&
+		val_is_gc(right, OBJ_STRING) &&
+		string_cmp(val_to_ptr(left), val_to_ptr(right)));
+}
+
+
+
+//
+//  Groups
+//
+
+// Return a bit mask of the slots in a group whose control byte is `control`,
+// with the first slot in the lowest bit.
+static inline uint32_t group_match(uint8_t *group, uint8_t control) {
+#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128((__m128i *) group);
+	__m128i matches = _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) control));
+	return (uint32_t) _mm_movemask_epi8(matches);
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < MAP_GROUP_SIZE; i++) {
+		mask |= (uint32_t) (group[i] == control) << i;
+	}
+	return mask;
+#endif
+}
+
+
+// Return a bit mask of the slots in a group that don't hold a key (empty or
+// deleted), which are the slots with the top bit of their control byte set.
+static inline uint32_t group_match_free(uint8_t *group) {
+#ifdef __SSE2__
+	return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((__m128i *) group));
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < MAP_GROUP_SIZE; i++) {
+		mask |= (uint32_t) (group[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+
+// Return the index of the slot holding `key`, or NOT_FOUND.
+static Index map_slot(Map *map, HyValue key, uint32_t hash) {
+	if (map->capacity == 0) {
+		return NOT_FOUND;
+	}
+
+	uint32_t mask = map->capacity / MAP_GROUP_SIZE - 1;
+	uint32_t group = hash & mask;
+	uint8_t control = hash_control(hash);
+	for (uint32_t step = 1; step <= mask + 1; step++) {
+		uint8_t *bytes = &map->control[group * MAP_GROUP_SIZE];
+
+		// Compare the keys in every slot whose control byte matches
+		uint32_t matches = group_match(bytes, control);
+		while (matches != 0) {
+			Index slot = group * MAP_GROUP_SIZE + __builtin_ctz(matches);
+			if (key_cmp(map->entries[slot].key, key)) {
+				return slot;
+			}
+			matches &= matches - 1;
+		}
+
+		// The key would have been inserted into an empty slot in this group
+		if (group_match(bytes, MAP_EMPTY) != 0) {
+			return NOT_FOUND;
+		}
+		group = (group + step) & mask;
+	}
+	return NOT_FOUND;
+}
+
+
+// Return the index of the first slot along the probe sequence for `hash` that
+// doesn't hold a key. The map must have at least one such slot.
+static Index map_slot_free(Map *map, uint32_t hash) {
+	uint32_t mask = map->capacity / MAP_GROUP_SIZE - 1;
+	uint32_t group = hash & mask;
+	for (uint32_t step = 1; ; step++) {
+		uint8_t *bytes = &map->control[group * MAP_GROUP_SIZE];
+		uint32_t matches = group_match_free(bytes);
+		if (matches != 0) {
+			return group * MAP_GROUP_SIZE + __builtin_ctz(matches);
+		}
+		group = (group + step) & mask;
+	}
+}
+
+
+// Reallocate a map's slots with a new capacity, reinserting every key and
+// dropping any tombstones.
+static void map_resize(HyState *state, Map *map, uint32_t capacity) {
+	uint8_t *control = map->control;
+	MapEntry *entries = map->entries;
+	uint32_t old_capacity = map->capacity;
+	map_alloc(state, map, capacity);
+
+	// Keys are already unique, so we don't need to compare them
+	for (uint32_t i = 0; i < old_capacity; i++) {
+		if ((control[i] & MAP_EMPTY) == 0) {
+			uint32_t hash = key_hash(entries[i].key);
+			Index slot = map_slot_free(map, hash);
+			map->control[slot] = hash_control(hash);
+			map->entries[slot] = entries[i];
+		}
+	}
+
+	state->gc.allocated -= MAP_SLOT_SIZE * old_capacity;
+	free(control);
+}
+
+
+
+//
+//  Access
+//
+
+// Return the entry for `key` in a map, or NULL if the key isn't in the map.
+// The key must be valid.
+MapEntry * map_find(Map *map, HyValue key) {
+	Index slot = map_slot(map, key, key_hash(key));
+	return (slot == NOT_FOUND) ? NULL : &map->entries[slot];
+}
+
+
+// Set the value stored against `key` in a map, inserting the key if it isn't
+// already there. The key must be valid.
+void map_insert(HyState *state, Map *map, HyValue key, HyValue value) {
+	uint32_t hash = key_hash(key);
+	Index slot = map_slot(map, key, hash);
+
+	if (slot == NOT_FOUND) {
+		// Grow the map (or just clear out its tombstones) if inserting another
+		// key would exceed the load factor
+		if ((map->length + map->tombstones + 1) * 8 > map->capacity * 7) {
+			map_resize(state, map, map_capacity(map->length + 1));
+		}
+
+		slot = map_slot_free(map, hash);
+		if (map->control[slot] == MAP_DELETED) {
+			map->tombstones--;
+		}
+		map->control[slot] = hash_control(hash);
+		map->entries[slot].key = key;
+		map->length++;
+		gc_write_barrier(&state->gc, map, key);
+	}
+
+	map->entries[slot].value = value;
+	gc_write_barrier(&state->gc, map, value);
+}
+
+
+// Remove a key from a map. Returns false if the key wasn't in the map.
+bool map_delete(Map *map, HyValue key) {
+	Index slot = map_slot(map, key, key_hash(key));
+	if (slot == NOT_FOUND) {
+		return false;
+	}
+
+	// Lookups stop at a group with an empty slot, so if this slot's group
+	// already has one then no probe sequence can pass through it, and the slot
+	// can be made empty rather than leaving a tombstone
+	uint8_t *group = &map->control[slot - slot % MAP_GROUP_SIZE];
+	if (group_match(group, MAP_EMPTY) != 0) {
+		map->control[slot] = MAP_EMPTY;
+	} else {
+		map->control[slot] = MAP_DELETED;
+		map->tombstones++;
+	}
+	map->length--;
+	return true;
+}
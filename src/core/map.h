@@ -0,0 +1,72 @@
+
+//
+//  Maps
+//
+
+#ifndef MAP_H
+#define MAP_H
+
+#include <hydrogen.h>
+#include <stdbool.h>
+
+#include "value.h"
+
+// * Maps are open addressing hash tables, laid out in the style of Google's
+//   SwissTable
+// * Every slot has a one byte control value alongside its entry: either empty,
+//   deleted (a tombstone left behind by a removed key), or the top 7 bits of
+//   the hash of the key stored in the slot
+// * Slots are split into groups of 16. The low bits of a key's hash select the
+//   group to start probing from, and with SSE2 we compare all 16 control bytes
+//   in a group against the key's 7 bit hash in a single instruction, only
+//   comparing keys for the (usually one or zero) slots that match
+// * A lookup stops at the first group containing an empty slot, since the key
+//   would have been inserted there otherwise. If there isn't one, we move onto
+//   the next group using triangular probing, which visits every group once
+//   since the number of groups is always a power of 2
+// * Keys are restricted to strings and values that aren't objects (numbers,
+//   booleans, nil and functions). Strings are hashed by their contents, and
+//   everything else by its bits. Other objects can't be used as keys, since
+//   they're compared by structure and moved by the garbage collector
+
+// The number of slots whose control bytes are probed at once.
+#define MAP_GROUP_SIZE 16
+
+// The control byte for a slot which has never held a key.
+#define MAP_EMPTY 0x80
+
+// The control byte for a slot whose key has been removed.
+#define MAP_DELETED 0xfe
+
+// The number of bytes allocated for each slot in a map.
+#define MAP_SLOT_SIZE (sizeof(MapEntry) + 1)
+
+
+// Create a new map with enough room for `count` keys before it has to grow.
+// Allocates, so must only be called when a garbage collection is safe.
+Map * map_new(HyState *state, uint32_t count);
+
+// Free the slots allocated by a map. Doesn't free the map object itself.
+void map_free(HyState *state, Map *map);
+
+// Return true if a value can be used as a key in a map.
+bool map_key_is_valid(HyValue key);
+
+// Return the entry for `key` in a map, or NULL if the key isn't in the map.
+// The key must be valid.
+MapEntry * map_find(Map *map, HyValue key);
+
+// Set the value stored against `key` in a map, inserting the key if it isn't
+// already there. The key must be valid.
+void map_insert(HyState *state, Map *map, HyValue key, HyValue value);
+
+// Remove a key from a map. Returns false if the key wasn't in the map.
+bool map_delete(Map *map, HyValue key);
+
+
+// Return true if the slot at `index` in a map holds a key.
+static inline bool map_slot_is_full(Map *map, uint32_t index) {
+	return (map->control[index] & MAP_EMPTY) == 0;
+}
+
+#endif
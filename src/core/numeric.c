@@ -0,0 +1,230 @@
+
+//
+//  Numeric Arrays
+//
+
+#include <string.h>
+
+#include "numeric.h"
+#include "state.h"
+
+// Operations on a vector register holding `LANES` doubles, using the widest
+// instruction set the compiler is targeting. `LANES` is left undefined if
+// there's no vector instruction set, and the kernels only use plain C.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LANES 4
+typedef __m256d Lanes;
+#define lanes_load(ptr)     _mm256_loadu_pd(ptr)
+#define lanes_store(ptr, v) _mm256_storeu_pd((ptr), (v))
+#define lanes_set(value)    _mm256_set1_pd(value)
+#define lanes_add(a, b)     _mm256_add_pd((a), (b))
+#define lanes_mul(a, b)     _mm256_mul_pd((a), (b))
+#define lanes_min(a, b)     _mm256_min_pd((a), (b))
+#define lanes_max(a, b)     _mm256_max_pd((a), (b))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LANES 2
+typedef __m128d Lanes;
+#define lanes_load(ptr)     _mm_loadu_pd(ptr)
+#define lanes_store(ptr, v) _mm_storeu_pd((ptr), (v))
+#define lanes_set(value)    _mm_set1_pd(value)
+#define lanes_add(a, b)     _mm_add_pd((a), (b))
+#define lanes_mul(a, b)     _mm_mul_pd((a), (b))
+#define lanes_min(a, b)     _mm_min_pd((a), (b))
+#define lanes_max(a, b)     _mm_max_pd((a), (b))
+#endif
+
+
+
+//
+//  Float Arrays
+//
+
+// Create a new float array of `length` elements, all set to 0. Allocates, so
+// must only be called when a garbage collection is safe.
+FloatArray * float_array_new(HyState *state, uint32_t length) {
+	FloatArray *array = gc_alloc(state, OBJ_FLOAT_ARRAY, sizeof(FloatArray));
+	array->length = length;
+	array->capacity = ceil_power_of_2(length);
+	array->contents = calloc(array->capacity, sizeof(double));
+	state->gc.allocated += sizeof(double) * array->capacity;
+	return array;
+}
+
+
+// Free the contents of a float array. Doesn't free the array object itself.
+void float_array_free(HyState *state, FloatArray *array) {
+	state->gc.allocated -= sizeof(double) * array->capacity;
+	free(array->contents);
+}
+
+
+// Increase the capacity of a float array to hold at least `minimum` elements.
+void float_array_resize(HyState *state, FloatArray *array, uint32_t minimum) {
+	if (array->capacity < minimum) {
+		uint32_t old_size = sizeof(double) * array->capacity;
+		array->capacity = ceil_power_of_2(minimum);
+		uint32_t new_size = sizeof(double) * array->capacity;
+		array->contents = realloc(array->contents, new_size);
+
+		// Let the garbage collector know about the additional memory
+		state->gc.allocated += new_size - old_size;
+	}
+}
+
+
+
+//
+//  Reductions
+//
+
+// Return the sum of `count` numbers.
+double numeric_sum(double *values, uint32_t count) {
+	double sum = 0.0;
+	uint32_t i = 0;
+
+#ifdef LANES
+	// Use two accumulators so consecutive additions don't wait on each other
+	Lanes first = lanes_set(0.0);
+	Lanes second = lanes_set(0.0);
+	for (; i + 2 * LANES <= count; i += 2 * LANES) {
+		first = lanes_add(first, lanes_load(&values[i]));
+		second = lanes_add(second, lanes_load(&values[i + LANES]));
+	}
+
+	double lanes[LANES];
+	lanes_store(lanes, lanes_add(first, second));
+	for (uint32_t lane = 0; lane < LANES; lane++) {
+		sum += lanes[lane];
+	}
+#endif
+
+	for (; i < count; i++) {
+		sum += values[i];
+	}
+	return sum;
+}
+
+
+// Return the smallest of `count` numbers. `count` must be at least 1.
+double numeric_min(double *values, uint32_t count) {
+	double min = values[0];
+	uint32_t i = 0;
+
+#ifdef LANES
+	if (count >= LANES) {
+		Lanes smallest = lanes_load(&values[0]);
+		for (i = LANES; i + LANES <= count; i += LANES) {
+			smallest = lanes_min(smallest, lanes_load(&values[i]));
+		}
+
+		double lanes[LANES];
+		lanes_store(lanes, smallest);
+		for (uint32_t lane = 0; lane < LANES; lane++) {
+			min = (lanes[lane] < min) ? lanes[lane] : min;
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		min = (values[i] < min) ? values[i] : min;
+	}
+	return min;
+}
+
+
+// Return the largest of `count` numbers. `count` must be at least 1.
+double numeric_max(double *values, uint32_t count) {
+	double max = values[0];
+	uint32_t i = 0;
+
+#ifdef LANES
+	if (count >= LANES) {
+		Lanes largest = lanes_load(&values[0]);
+		for (i = LANES; i + LANES <= count; i += LANES) {
+			largest = lanes_max(largest, lanes_load(&values[i]));
+		}
+
+		double lanes[LANES];
+		lanes_store(lanes, largest);
+		for (uint32_t lane = 0; lane < LANES; lane++) {
+			max = (lanes[lane] > max) ? lanes[lane] : max;
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		max = (values[i] > max) ? values[i] : max;
+	}
+	return max;
+}
+
+
+// Return the dot product of two lists of `count` numbers.
+double numeric_dot(double *left, double *right, uint32_t count) {
+	double dot = 0.0;
+	uint32_t i = 0;
+
+#ifdef LANES
+	Lanes first = lanes_set(0.0);
+	Lanes second = lanes_set(0.0);
+	for (; i + 2 * LANES <= count; i += 2 * LANES) {
+		Lanes products = lanes_mul(lanes_load(&left[i]), lanes_load(&right[i]));
+		first = lanes_add(first, products);
+		products = lanes_mul(lanes_load(&left[i + LANES]),
+			lanes_load(&right[i + LANES]));
+		second = lanes_add(second, products);
+	}
+
+	double lanes[LANES];
+	lanes_store(lanes, lanes_add(first, second));
+	for (uint32_t lane = 0; lane < LANES; lane++) {
+		dot += lanes[lane];
+	}
+#endif
+
+	for (; i < count; i++) {
+		dot += left[i] * right[i];
+	}
+	return dot;
+}
+
+
+
+//
+//  Element Wise Operations
+//
+
+// Multiply `count` numbers by `factor` in place.
+void numeric_scale(double *values, uint32_t count, double factor) {
+	uint32_t i = 0;
+
+#ifdef LANES
+	Lanes factors = lanes_set(factor);
+	for (; i + LANES <= count; i += LANES) {
+		lanes_store(&values[i], lanes_mul(lanes_load(&values[i]), factors));
+	}
+#endif
+
+	for (; i < count; i++) {
+		values[i] *= factor;
+	}
+}
+
+
+// Add each of `count` numbers in `src` to the corresponding number in `dest`.
+void numeric_add(double *dest, double *src, uint32_t count) {
+	uint32_t i = 0;
+
+#ifdef LANES
+	for (; i + LANES <= count; i += LANES) {
+		lanes_store(&dest[i], lanes_add(lanes_load(&dest[i]),
+			lanes_load(&src[i])));
+	}
+#endif
+
+	for (; i < count; i++) {
+		dest[i] += src[i];
+	}
+}
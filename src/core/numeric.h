@@ -0,0 +1,51 @@
+
+//
+//  Numeric Arrays
+//
+
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include <hydrogen.h>
+
+#include "value.h"
+
+// * A float array stores its elements as raw doubles rather than as values,
+//   so its contents can be handed straight to the kernels below
+// * Each kernel is written with AVX2 when the compiler targets it, otherwise
+//   with SSE2 (always available on x86-64), and falls back to plain C on
+//   other architectures
+// * The vectorised reductions accumulate in several lanes at once, so `sum`
+//   and `dot` may round differently to adding the elements in order
+
+
+// Create a new float array of `length` elements, all set to 0. Allocates, so
+// must only be called when a garbage collection is safe.
+FloatArray * float_array_new(HyState *state, uint32_t length);
+
+// Free the contents of a float array. Doesn't free the array object itself.
+void float_array_free(HyState *state, FloatArray *array);
+
+// Increase the capacity of a float array to hold at least `minimum` elements.
+void float_array_resize(HyState *state, FloatArray *array, uint32_t minimum);
+
+
+// Return the sum of `count` numbers.
+double numeric_sum(double *values, uint32_t count);
+
+// Return the smallest of `count` numbers. `count` must be at least 1.
+double numeric_min(double *values, uint32_t count);
+
+// Return the largest of `count` numbers. `count` must be at least 1.
+double numeric_max(double *values, uint32_t count);
+
+// Return the dot product of two lists of `count` numbers.
+double numeric_dot(double *left, double *right, uint32_t count);
+
+// Multiply `count` numbers by `factor` in place.
+void numeric_scale(double *values, uint32_t count, double factor);
+
+// Add each of `count` numbers in `src` to the corresponding number in `dest`.
+void numeric_add(double *dest, double *src, uint32_t count);
+
+#endif
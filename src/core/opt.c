@@ -0,0 +1,606 @@
+
+//
+//  Bytecode Optimiser
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "jmp.h"
+
+
+// Return a bit mask for the `n`th argument of an instruction.
+#define ARG(n) (1 << (n))
+
+// The number of stack slots stored in each word of a slot set.
+#define SET_BITS 64
+
+
+// The stack slots an instruction uses.
+typedef struct {
+	// A bit mask of the arguments naming stack slots the instruction reads.
+	uint8_t reads;
+
+	// The argument naming the stack slot the instruction writes to, or 0 if it
+	// doesn't write to one.
+	uint8_t write;
+
+	// Whether the instruction calls a function, which reads `count`
+	// consecutive stack slots starting at `start` (the function or object
+	// followed by the arguments to the call), and may overwrite any slot after
+	// them. For loops are treated the same way, since they implicitly use the
+	// slots after their counter (or array).
+	bool call;
+	uint32_t start;
+	uint32_t count;
+} Access;
+
+
+// Return true if an opcode is an (unfused) comparison, which is always
+// followed by a JMP.
+static inline bool is_comparison(BytecodeOpcode opcode) {
+	return opcode >= IS_TRUE_L && opcode <= GE_LN;
+}
+
+
+// Return true if an opcode transfers control to the instruction at the offset
+// stored in one of its arguments.
+static inline bool is_jump(BytecodeOpcode opcode) {
+	return opcode == JMP || opcode == LOOP ||
+		(opcode >= FOR_PREP && opcode <= FOR_ARRAY_LOOP);
+}
+
+
+// Return true if an opcode is a return instruction.
+static inline bool is_return(BytecodeOpcode opcode) {
+	return opcode >= RET0 && opcode <= RET_V;
+}
+
+
+// Return true if an opcode only moves a value into a stack slot, so it can be
+// removed if nothing reads the slot afterwards.
+static inline bool is_move(BytecodeOpcode opcode) {
+	return (opcode >= MOV_LL && opcode <= MOV_LV) || opcode == MOV_LU ||
+		opcode == MOV_LT || opcode == MOV_SELF ||
+		(opcode >= MOV_LN_WIDE && opcode <= MOV_LV_WIDE);
+}
+
+
+// Return the stack slots used by an instruction.
+static Access ins_access(Instruction ins) {
+	BytecodeOpcode opcode = ins_generic_opcode(ins_arg(ins, 0));
+	if (jmp_is_fused(opcode)) {
+		opcode = jmp_unfused(opcode);
+	}
+
+	// Arithmetic instructions come in groups of 5 with the same operand types
+	static const uint8_t arith_reads[] = {
+		ARG(2) | ARG(3), ARG(2), ARG(2), ARG(3), ARG(3),
+	};
+
+	Access access = {0, 0, false, 0, 0};
+	if (opcode >= MOV_LL && opcode <= MOV_LV) {
+		access.write = 1;
+		access.reads = (opcode == MOV_LL) ? ARG(2) : 0;
+	} else if (opcode == MOV_UL || opcode == MOV_TL) {
+		access.reads = ARG(2);
+	} else if (opcode == MOV_LU || opcode == MOV_LT || opcode == MOV_SELF ||
+			(opcode >= MOV_LN_WIDE && opcode <= MOV_LV_WIDE)) {
+		access.write = 1;
+	} else if (opcode >= ADD_LL && opcode <= MOD_NL) {
+		access.write = 1;
+		access.reads = arith_reads[(opcode - ADD_LL) % 5];
+	} else if (opcode >= CONCAT_LL && opcode <= NEG_L) {
+		static const uint8_t reads[] = {
+			ARG(2) | ARG(3), ARG(2), ARG(3), ARG(2),
+		};
+		access.write = 1;
+		access.reads = reads[opcode - CONCAT_LL];
+	} else if (is_comparison(opcode)) {
+		bool two_locals = opcode == EQ_LL || opcode == NEQ_LL ||
+			opcode == LT_LL || opcode == LE_LL || opcode == GT_LL ||
+			opcode == GE_LL;
+		access.reads = ARG(1) | (two_locals ? ARG(2) : 0);
+	} else if (opcode == CALL || opcode == CALL_FIELD || opcode == TAIL_CALL) {
+		access.write = (opcode == CALL_FIELD) ? 1 : 3;
+		access.call = true;
+		access.start = ins_arg(ins, 1);
+		access.count = ins_arg(ins, 2) + 1;
+	} else if (opcode == STRUCT_CALL_CONSTRUCTOR) {
+		access.reads = ARG(1);
+		access.call = true;
+		access.start = ins_arg(ins, 2);
+		access.count = ins_arg(ins, 3) + 1;
+	} else if (opcode >= FOR_PREP && opcode <= FOR_ARRAY_LOOP) {
+		access.call = true;
+		access.start = ins_arg(ins, 1);
+		access.count = 3;
+	} else if (opcode == RET_L || opcode == SELF_SET_L) {
+		access.reads = ARG(2);
+	} else if (opcode == STRUCT_NEW || opcode == NATIVE_STRUCT_NEW ||
+			opcode == SELF_FIELD || opcode == ARRAY_NEW ||
+			opcode == CLOSURE_NEW || opcode == MAP_NEW) {
+		access.write = 1;
+	} else if (opcode == STRUCT_FIELD || opcode == ARRAY_GET_L ||
+			opcode == MAP_GET) {
+		access.write = 1;
+		access.reads = ARG(2) | ((opcode != STRUCT_FIELD) ? ARG(3) : 0);
+	} else if (opcode == ARRAY_GET_I) {
+		access.write = 1;
+		access.reads = ARG(3);
+	} else if (opcode == ARRAY_SLICE) {
+		// The end of the slice is in the slot after the start
+		access.write = 1;
+		access.reads = ARG(3);
+		access.call = true;
+		access.start = ins_arg(ins, 2);
+		access.count = 2;
+	} else if ((opcode >= STRUCT_SET_L && opcode <= STRUCT_SET_V) ||
+			(opcode >= ARRAY_I_SET_L && opcode <= ARRAY_I_SET_V)) {
+		bool local = opcode == STRUCT_SET_L || opcode == ARRAY_I_SET_L;
+		access.reads = ARG(3) | (local ? ARG(2) : 0);
+	} else if ((opcode >= ARRAY_L_SET_L && opcode <= ARRAY_L_SET_V) ||
+			(opcode >= MAP_SET_L && opcode <= MAP_SET_V)) {
+		bool local = opcode == ARRAY_L_SET_L || opcode == MAP_SET_L;
+		access.reads = ARG(1) | ARG(3) | (local ? ARG(2) : 0);
+	}
+	return access;
+}
+
+
+// Return the argument a jump instruction stores its offset in.
+static inline uint32_t jump_arg(BytecodeOpcode opcode) {
+	bool for_loop = opcode >= FOR_PREP && opcode <= FOR_ARRAY_LOOP;
+	return for_loop ? 2 : JMP_TARGET_ARG;
+}
+
+
+// Return true if a jump instruction jumps backwards.
+static inline bool jump_is_backwards(BytecodeOpcode opcode) {
+	return opcode == LOOP || opcode == FOR_LOOP || opcode == FOR_ARRAY_LOOP;
+}
+
+
+// Return the index of the instruction a jump instruction jumps to.
+static uint32_t jump_target(Function *fn, uint32_t index) {
+	Instruction ins = vec_at(fn->instructions, index);
+	BytecodeOpcode opcode = ins_arg(ins, 0);
+	uint16_t offset = ins_arg(ins, jump_arg(opcode));
+	return jump_is_backwards(opcode) ? index - offset : index + offset;
+}
+
+
+
+//
+//  Slot Sets
+//
+
+// A set of stack slots, stored as a bit set `words` words long.
+typedef uint64_t SlotSet;
+
+
+// Add a stack slot to a set.
+static inline void set_add(SlotSet *set, uint32_t slot) {
+	set[slot / SET_BITS] |= ((uint64_t) 1) << (slot % SET_BITS);
+}
+
+
+// Remove a stack slot from a set.
+static inline void set_remove(SlotSet *set, uint32_t slot) {
+	set[slot / SET_BITS] &= ~(((uint64_t) 1) << (slot % SET_BITS));
+}
+
+
+// Return true if a set contains a stack slot.
+static inline bool set_has(SlotSet *set, uint32_t slot) {
+	return (set[slot / SET_BITS] >> (slot % SET_BITS)) & 1;
+}
+
+
+// Add the stack slots read by an instruction to a set.
+static void set_add_reads(SlotSet *set, Instruction ins, Access *access) {
+	for (uint32_t n = 1; n <= 3; n++) {
+		if (access->reads & ARG(n)) {
+			set_add(set, ins_arg(ins, n));
+		}
+	}
+	if (access->call) {
+		for (uint32_t i = 0; i < access->count; i++) {
+			set_add(set, access->start + i);
+		}
+	}
+}
+
+
+
+//
+//  Basic Blocks
+//
+
+// The control flow graph for a function, splitting its bytecode into basic
+// blocks.
+typedef struct {
+	// The number of instructions in the function.
+	uint32_t length;
+
+	// Whether each instruction is the first in a basic block (with one extra
+	// element for the end of the function).
+	bool *leaders;
+
+	// The index of the first instruction in each block, followed by the
+	// length of the function, and the block containing each instruction.
+	uint32_t *starts;
+	uint32_t *blocks;
+	uint32_t count;
+
+	// The number of words in each slot set, and the slots that are live on
+	// entry to each block, read in each block before being written to, and
+	// written to in each block. Each array holds `count` sets.
+	uint32_t words;
+	SlotSet *live;
+	SlotSet *uses;
+	SlotSet *defs;
+} Graph;
+
+
+// Split a function's bytecode into basic blocks.
+static Graph graph_new(Function *fn, uint32_t slots) {
+	Graph graph;
+	graph.length = vec_len(fn->instructions);
+	graph.leaders = calloc(graph.length + 1, sizeof(bool));
+	graph.leaders[0] = true;
+	graph.leaders[graph.length] = true;
+
+	for (uint32_t i = 0; i < graph.length; i++) {
+		BytecodeOpcode opcode = ins_arg(vec_at(fn->instructions, i), 0);
+		if (is_jump(opcode)) {
+			graph.leaders[jump_target(fn, i)] = true;
+		}
+		if (is_jump(opcode) || is_return(opcode) || is_comparison(opcode)) {
+			graph.leaders[i + 1] = true;
+		}
+	}
+
+	graph.starts = malloc(sizeof(uint32_t) * (graph.length + 1));
+	graph.blocks = malloc(sizeof(uint32_t) * (graph.length + 1));
+	graph.count = 0;
+	for (uint32_t i = 0; i <= graph.length; i++) {
+		if (graph.leaders[i]) {
+			graph.starts[graph.count++] = i;
+		}
+		graph.blocks[i] = graph.count - 1;
+	}
+
+	// The end of the function was counted as a block
+	graph.count--;
+
+	graph.words = (slots + SET_BITS - 1) / SET_BITS;
+	uint32_t size = graph.count * graph.words;
+	graph.live = calloc(size, sizeof(SlotSet));
+	graph.uses = calloc(size, sizeof(SlotSet));
+	graph.defs = calloc(size, sizeof(SlotSet));
+	return graph;
+}
+
+
+// Free resources allocated by a control flow graph.
+static void graph_free(Graph *graph) {
+	free(graph->leaders);
+	free(graph->starts);
+	free(graph->blocks);
+	free(graph->live);
+	free(graph->uses);
+	free(graph->defs);
+}
+
+
+// Return the slot set at `block` in one of the graph's arrays of sets.
+static inline SlotSet * graph_set(Graph *graph, SlotSet *sets, uint32_t block) {
+	return &sets[block * graph->words];
+}
+
+
+// Compute the set of slots that are live after the last instruction in a
+// block, from the slots that are live on entry to its successors.
+static void graph_live_out(Function *fn, Graph *graph, uint32_t block,
+		SlotSet *out) {
+	memset(out, 0, sizeof(SlotSet) * graph->words);
+
+	uint32_t last = graph->starts[block + 1] - 1;
+	BytecodeOpcode opcode = ins_arg(vec_at(fn->instructions, last), 0);
+	uint32_t successors[2];
+	uint32_t count = 0;
+	if (is_jump(opcode)) {
+		successors[count++] = jump_target(fn, last);
+	}
+	if (!is_return(opcode) && opcode != JMP && opcode != LOOP) {
+		successors[count++] = last + 1;
+	}
+
+	// A comparison can also skip the JMP following it
+	if (is_comparison(opcode)) {
+		successors[count++] = last + 2;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (successors[i] >= graph->length) {
+			continue;
+		}
+		Index successor = graph->blocks[successors[i]];
+		SlotSet *in = graph_set(graph, graph->live, successor);
+		for (uint32_t word = 0; word < graph->words; word++) {
+			out[word] |= in[word];
+		}
+	}
+}
+
+
+// Compute the slots live on entry to every block in the graph.
+static void graph_liveness(Function *fn, Graph *graph) {
+	// The slots each block reads before writing, and writes
+	for (uint32_t block = 0; block < graph->count; block++) {
+		SlotSet *uses = graph_set(graph, graph->uses, block);
+		SlotSet *defs = graph_set(graph, graph->defs, block);
+		for (uint32_t i = graph->starts[block]; i < graph->starts[block + 1];
+				i++) {
+			Instruction ins = vec_at(fn->instructions, i);
+			Access access = ins_access(ins);
+			for (uint32_t n = 1; n <= 3; n++) {
+				uint16_t slot = ins_arg(ins, n);
+				if ((access.reads & ARG(n)) && !set_has(defs, slot)) {
+					set_add(uses, slot);
+				}
+			}
+			for (uint32_t slot = access.start;
+					access.call && slot < access.start + access.count; slot++) {
+				if (!set_has(defs, slot)) {
+					set_add(uses, slot);
+				}
+			}
+			if (access.write != 0) {
+				set_add(defs, ins_arg(ins, access.write));
+			}
+		}
+	}
+
+	// Propagate liveness backwards until nothing changes
+	SlotSet *out = malloc(sizeof(SlotSet) * graph->words);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (uint32_t block = graph->count; block-- > 0;) {
+			graph_live_out(fn, graph, block, out);
+			SlotSet *live = graph_set(graph, graph->live, block);
+			SlotSet *uses = graph_set(graph, graph->uses, block);
+			SlotSet *defs = graph_set(graph, graph->defs, block);
+			for (uint32_t word = 0; word < graph->words; word++) {
+				uint64_t in = uses[word] | (out[word] & ~defs[word]);
+				if (in != live[word]) {
+					live[word] = in;
+					changed = true;
+				}
+			}
+		}
+	}
+	free(out);
+}
+
+
+
+//
+//  Passes
+//
+
+// Point every JMP that lands on another JMP at the end of the chain.
+static void thread_jumps(Function *fn) {
+	uint32_t length = vec_len(fn->instructions);
+	for (uint32_t i = 0; i < length; i++) {
+		Instruction ins = vec_at(fn->instructions, i);
+		if (ins_arg(ins, 0) != JMP) {
+			continue;
+		}
+
+		// Jumps only go forwards, so the chain can't loop
+		uint32_t target = jump_target(fn, i);
+		while (target < length && target > i) {
+			Instruction next = vec_at(fn->instructions, target);
+			if (ins_arg(next, 0) != JMP || ins_arg(next, JMP_TARGET_ARG) == 0 ||
+					target + ins_arg(next, JMP_TARGET_ARG) - i > UINT16_MAX) {
+				break;
+			}
+			target = jump_target(fn, target);
+		}
+		vec_at(fn->instructions, i) = ins_set(ins, JMP_TARGET_ARG, target - i);
+	}
+}
+
+
+// Replace reads of the local each MOV_LL copies into with reads of the local
+// it copies from, until the end of the basic block or until either local is
+// overwritten.
+static void propagate_copies(Function *fn, Graph *graph) {
+	for (uint32_t i = 0; i < graph->length; i++) {
+		Instruction ins = vec_at(fn->instructions, i);
+		uint16_t dest = ins_arg(ins, 1);
+		uint16_t src = ins_arg(ins, 2);
+		if (ins_arg(ins, 0) != MOV_LL || dest == src) {
+			continue;
+		}
+
+		for (uint32_t j = i + 1; !graph->leaders[j]; j++) {
+			Instruction use = vec_at(fn->instructions, j);
+			Access access = ins_access(use);
+			for (uint32_t n = 1; n <= 3; n++) {
+				if ((access.reads & ARG(n)) && ins_arg(use, n) == dest) {
+					use = ins_set(use, n, src);
+				}
+			}
+			vec_at(fn->instructions, j) = use;
+
+			// The arguments to a call can't be renamed, and the called function
+			// can overwrite its caller's locals after them
+			uint16_t written = ins_arg(use, access.write);
+			if (access.call || (access.write != 0 &&
+					(written == dest || written == src))) {
+				break;
+			}
+		}
+	}
+}
+
+
+// Remove instructions that move values into slots which are never read, and
+// write the result of an instruction straight into the local it's then copied
+// into, if nothing else reads it. Removed instructions are replaced by NO_OP.
+static void remove_dead_moves(Function *fn, Graph *graph) {
+	SlotSet *live = malloc(sizeof(SlotSet) * graph->words);
+	for (uint32_t block = 0; block < graph->count; block++) {
+		graph_live_out(fn, graph, block, live);
+
+		uint32_t start = graph->starts[block];
+		for (uint32_t i = graph->starts[block + 1]; i-- > start;) {
+			Instruction ins = vec_at(fn->instructions, i);
+			BytecodeOpcode opcode = ins_arg(ins, 0);
+			Access access = ins_access(ins);
+			uint16_t written = ins_arg(ins, access.write);
+
+			// Moves into slots that aren't live, or that copy a local into
+			// itself
+			if (is_move(opcode) && (!set_has(live, written) ||
+					(opcode == MOV_LL && ins_arg(ins, 2) == written))) {
+				vec_at(fn->instructions, i) = ins_new(NO_OP, 0, 0, 0);
+				continue;
+			}
+
+			// A copy out of a slot the previous instruction just wrote to
+			if (opcode == MOV_LL && i > start &&
+					!set_has(live, ins_arg(ins, 2))) {
+				Instruction prev = vec_at(fn->instructions, i - 1);
+				Access prev_access = ins_access(prev);
+				bool retarget = prev_access.write != 0 &&
+					ins_arg(prev, prev_access.write) == ins_arg(ins, 2) &&
+					(!prev_access.call || ins_arg(prev, 0) == CALL);
+				if (retarget) {
+					vec_at(fn->instructions, i - 1) =
+						ins_set(prev, prev_access.write, written);
+					vec_at(fn->instructions, i) = ins_new(NO_OP, 0, 0, 0);
+					continue;
+				}
+			}
+
+			if (access.write != 0) {
+				set_remove(live, written);
+			}
+			set_add_reads(live, ins, &access);
+		}
+	}
+	free(live);
+}
+
+
+// Find where each instruction will be once every NO_OP is removed, storing
+// the index of the next instruction that isn't a NO_OP for each one.
+static void compact_map(Function *fn, uint32_t *map) {
+	uint32_t length = vec_len(fn->instructions);
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < length; i++) {
+		map[i] = next;
+		if (ins_arg(vec_at(fn->instructions, i), 0) != NO_OP) {
+			next++;
+		}
+	}
+	map[length] = next;
+}
+
+
+// Remove every NO_OP from a function's bytecode, along with any JMP that would
+// then jump to the instruction directly after it, updating the offset of each
+// remaining jump.
+static void compact(Function *fn) {
+	uint32_t length = vec_len(fn->instructions);
+	uint32_t *map = malloc(sizeof(uint32_t) * (length + 1));
+
+	// Removing a jump can make the jump before it redundant
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		compact_map(fn, map);
+		for (uint32_t i = 0; i < length; i++) {
+			Instruction ins = vec_at(fn->instructions, i);
+			bool conditional = i > 0 &&
+				is_comparison(ins_arg(vec_at(fn->instructions, i - 1), 0));
+			if (ins_arg(ins, 0) == JMP && !conditional &&
+					map[jump_target(fn, i)] == map[i + 1]) {
+				vec_at(fn->instructions, i) = ins_new(NO_OP, 0, 0, 0);
+				changed = true;
+			}
+		}
+	}
+
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < length; i++) {
+		Instruction ins = vec_at(fn->instructions, i);
+		BytecodeOpcode opcode = ins_arg(ins, 0);
+		if (opcode == NO_OP) {
+			continue;
+		}
+
+		if (is_jump(opcode) && jump_is_backwards(opcode)) {
+			uint32_t offset = map[i] - map[jump_target(fn, i)];
+			ins = ins_set(ins, jump_arg(opcode), offset);
+		} else if (is_jump(opcode)) {
+			uint32_t offset = map[jump_target(fn, i)] - map[i];
+			ins = ins_set(ins, jump_arg(opcode), offset);
+		}
+		vec_at(fn->instructions, next++) = ins;
+	}
+	vec_len(fn->instructions) = next;
+	free(map);
+}
+
+
+// Return the number of stack slots used by a function's bytecode.
+static uint32_t frame_size(Function *fn) {
+	uint32_t size = fn->arity;
+	for (uint32_t i = 0; i < vec_len(fn->instructions); i++) {
+		Instruction ins = vec_at(fn->instructions, i);
+		Access access = ins_access(ins);
+		for (uint32_t n = 1; n <= 3; n++) {
+			bool used = (access.reads & ARG(n)) || access.write == n;
+			if (used && ins_arg(ins, n) + 1u > size) {
+				size = ins_arg(ins, n) + 1;
+			}
+		}
+
+		// A constructor call's return value is discarded into the slot after
+		// its arguments
+		if (access.call && access.start + access.count + 1 > size) {
+			size = access.start + access.count + 1;
+		}
+	}
+	return size;
+}
+
+
+// Optimise a function's bytecode. Must be called once the function has been
+// fully parsed, but before `jmp_fuse`.
+void opt_fn(Function *fn) {
+	thread_jumps(fn);
+
+	// Locals captured by a closure can be read or modified by any call, so
+	// only optimise the data flow through functions without any
+	if (!fn->locals_captured) {
+		Graph graph = graph_new(fn, frame_size(fn));
+		propagate_copies(fn, &graph);
+		graph_liveness(fn, &graph);
+		remove_dead_moves(fn, &graph);
+		graph_free(&graph);
+	}
+
+	compact(fn);
+	uint32_t size = frame_size(fn);
+	if (size < fn->frame_size) {
+		fn->frame_size = size;
+	}
+}
@@ -0,0 +1,24 @@
+
+//
+//  Bytecode Optimiser
+//
+
+#ifndef OPT_H
+#define OPT_H
+
+#include "fn.h"
+
+// * The parser emits bytecode in a single pass, so it can't know whether the
+//   value a local is set to is ever used, or whether a jump lands on another
+//   jump
+// * The optimiser runs over each function once it's been parsed, before its
+//   comparisons are fused with their jumps
+// * It threads jumps to jumps, propagates copies between locals, removes
+//   moves into locals that are never read, and shrinks the function's frame
+//   to the locals it actually uses
+
+// Optimise a function's bytecode. Must be called once the function has been
+// fully parsed, but before `jmp_fuse`.
+void opt_fn(Function *fn);
+
+#endif
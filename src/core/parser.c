@@ -119,6 +119,7 @@ static FunctionScope scope_new(Parser *parser) {
 	FunctionScope scope;
 	scope.parent = NULL;
 	scope.fn_index = fn_new(parser->state);
+	scope.struct_index = NOT_FOUND;
 	scope.loop = NULL;
 	scope.block_depth = 0;
 	scope.actives_count = 0;
@@ -210,6 +211,7 @@ static uint16_t local_new(Parser *parser) {
 	local->name = NULL;
 	local->length = 0;
 	local->block = scope->block_depth;
+	local->captured = false;
 	return local_reserve(parser);
 }
 
@@ -235,12 +237,12 @@ static void local_free(Parser *parser) {
 }
 
 
-// Search for a local in the parser's current function scope. Return its index
-// if found.
-static Index local_find(Parser *parser, char *name, uint32_t length) {
+// Search for a local in a function scope. Return its index if found.
+static Index local_find(Parser *parser, FunctionScope *scope, char *name,
+		uint32_t length) {
 	// Search in reverse order
-	for (int32_t i = (int32_t) parser->scope->actives_count - 1; i >= 0; i--) {
-		Local *local = local_get(parser, i);
+	for (int32_t i = (int32_t) scope->actives_count - 1; i >= 0; i--) {
+		Local *local = &vec_at(parser->locals, scope->actives_start + i);
 		if (length == local->length &&
 				strncmp(name, local->name, length) == 0) {
 			return i;
@@ -254,7 +256,7 @@ static Index local_find(Parser *parser, char *name, uint32_t length) {
 // override locals outside the function scope and top level variables).
 static bool local_is_unique(Parser *parser, char *name, uint32_t length) {
 	// Check locals or top level values if we're not inside a function
-	return !(local_find(parser, name, length) != NOT_FOUND ||
+	return !(local_find(parser, parser->scope, name, length) != NOT_FOUND ||
 		(parser->scope->parent == NULL &&
 		 pkg_local_find(parser_pkg(parser), name, length) != NOT_FOUND));
 }
@@ -280,17 +282,101 @@ typedef struct {
 } Resolution;
 
 
+// Add an upvalue to the function being parsed in `scope`, captured from a
+// local in the enclosing function, one of the enclosing function's upvalues,
+// or the enclosing method's `self`. Return the index of the upvalue.
+static Index upvalue_add(Parser *parser, FunctionScope *scope,
+		CaptureType type, uint16_t index) {
+	// Reuse the upvalue if the function has already captured the same value
+	Function *fn = &vec_at(parser->state->functions, scope->fn_index);
+	for (uint32_t i = 0; i < vec_len(fn->captures); i++) {
+		Capture *capture = &vec_at(fn->captures, i);
+		if (capture->type == type && capture->index == index) {
+			return i;
+		}
+	}
+
+	// Methods are called with their struct as `self`, so there's nowhere to
+	// store their upvalues
+	if (scope->struct_index != NOT_FOUND) {
+		Token *token = &parser->lexer.token;
+		err_fatal(parser, token, "Cannot capture local `%.*s` in a method",
+			token->length, token->start);
+	}
+
+	vec_inc(fn->captures);
+	vec_last(fn->captures).type = type;
+	vec_last(fn->captures).index = index;
+	return vec_len(fn->captures) - 1;
+}
+
+
+// Search the functions enclosing `scope` for a local with the given name,
+// capturing it as an upvalue in every function between the one defining the
+// local and `scope`. Return the index of the upvalue in `scope`'s function.
+static Index upvalue_resolve(Parser *parser, FunctionScope *scope, char *name,
+		uint32_t length) {
+	FunctionScope *parent = scope->parent;
+	if (parent == NULL) {
+		return NOT_FOUND;
+	}
+
+	// Check if the local is defined in the enclosing function
+	Index index = local_find(parser, parent, name, length);
+	if (index != NOT_FOUND) {
+		vec_at(parser->locals, parent->actives_start + index).captured = true;
+		vec_at(parser->state->functions, parent->fn_index).locals_captured =
+			true;
+		return upvalue_add(parser, scope, CAPTURE_LOCAL, index);
+	}
+
+	// Otherwise the enclosing function needs to capture it too
+	index = upvalue_resolve(parser, parent, name, length);
+	if (index != NOT_FOUND) {
+		return upvalue_add(parser, scope, CAPTURE_UPVALUE, index);
+	}
+	return NOT_FOUND;
+}
+
+
+// Search the functions enclosing `scope` for a method, capturing its `self` as
+// an upvalue in every function between the method and `scope`. Return the
+// index of the upvalue in `scope`'s function, or NOT_FOUND if `scope` isn't
+// nested inside a method.
+static Index self_resolve(Parser *parser, FunctionScope *scope) {
+	FunctionScope *parent = scope->parent;
+	if (parent == NULL) {
+		return NOT_FOUND;
+	} else if (parent->struct_index != NOT_FOUND) {
+		return upvalue_add(parser, scope, CAPTURE_SELF, 0);
+	}
+
+	Index index = self_resolve(parser, parent);
+	if (index != NOT_FOUND) {
+		return upvalue_add(parser, scope, CAPTURE_UPVALUE, index);
+	}
+	return NOT_FOUND;
+}
+
+
 // Resolve a string (the name of a value) into a value.
 static Resolution local_resolve(Parser *parser, char *name, uint32_t length) {
 	Resolution resolved;
 
 	// Local variables
-	resolved.index = local_find(parser, name, length);
+	resolved.index = local_find(parser, parser->scope, name, length);
 	if (resolved.index != NOT_FOUND) {
 		resolved.type = RESOLVED_LOCAL;
 		return resolved;
 	}
 
+	// Locals in enclosing functions
+	resolved.index = upvalue_resolve(parser, parser->scope, name, length);
+	if (resolved.index != NOT_FOUND) {
+		resolved.type = RESOLVED_UPVALUE;
+		return resolved;
+	}
+
 	// Top level variables
 	Package *pkg = parser_pkg(parser);
 	resolved.index = pkg_local_find(pkg, name, length);
@@ -333,11 +419,19 @@ static void block_free(Parser *parser) {
 	ASSERT(parser->scope->locals_count == parser->scope->actives_count);
 
 	// Free locals inside this block
+	bool captured = false;
 	while (vec_len(parser->locals) > 0 && parser->scope->locals_count > 0 &&
 			vec_last(parser->locals).block >= parser->scope->block_depth) {
+		captured = captured || vec_last(parser->locals).captured;
 		local_free(parser);
 	}
 
+	// Close the upvalues of any locals captured by a closure
+	if (captured) {
+		fn_emit(parser_fn(parser), UPVALUE_CLOSE, parser->scope->locals_count,
+			0, 0);
+	}
+
 	// Decrement the block depth
 	parser->scope->block_depth--;
 }
@@ -397,7 +491,11 @@ static Index import_new(Parser *parser, Token *token, char *path, char *name) {
 	// Insert a call to the package's main function
 	uint16_t slot = local_reserve(parser);
 	Function *fn = parser_fn(parser);
-	fn_emit(fn, MOV_LF, slot, main_fn, 0);
+	if (main_fn > UINT16_MAX) {
+		fn_emit(fn, MOV_LF_WIDE, slot, main_fn & 0xffff, main_fn >> 16);
+	} else {
+		fn_emit(fn, MOV_LF, slot, main_fn, 0);
+	}
 	fn_emit(fn, CALL, slot, 0, 0);
 	local_free(parser);
 	return index;
@@ -539,8 +637,9 @@ typedef struct {
 	OpType type;
 
 	union {
-		// The value of the operand.
-		uint16_t value;
+		// The value of the operand. Indices into the constants, strings,
+		// functions, or native functions lists can take the full 32 bits.
+		Index value;
 
 		// If the operand is a jump, then we need to store the index into the
 		// bytecode of the jump instruction instead of its value.
@@ -550,7 +649,7 @@ typedef struct {
 
 
 // Forward declarations.
-static Index parse_fn_def_body(Parser *parser, bool is_method);
+static Index parse_fn_def_body(Parser *parser, Index struct_index);
 static Operand parse_expr(Parser *parser, uint16_t slot);
 static void expr_emit(Parser *parser, uint16_t slot);
 
@@ -593,6 +692,7 @@ typedef enum {
 } Precedence;
 
 
+
 // Return the precedence of a binary operator.
 static Precedence prec_binary(TokenType operator) {
 	switch (operator) {
@@ -726,12 +826,6 @@ static inline double operand_to_num(Parser *parser, Operand *operand) {
 }
 
 
-// Convert a string operand into its underlying `char *` value.
-static inline char * operand_to_str(Parser *parser, Operand *operand) {
-	return vec_at(parser->state->strings, operand->value);
-}
-
-
 // Convert an operand into a boolean.
 static inline bool operand_to_bool(Operand *operand) {
 	return operand->type != OP_PRIMITIVE || operand->value == TAG_TRUE;
@@ -957,22 +1051,22 @@ static bool fold_concat(Parser *parser, Operand *left, Operand right) {
 	}
 
 	// Extract string values
-	char *left_str = vec_at(parser->state->strings, left->value);
-	char *right_str = vec_at(parser->state->strings, right.value);
+	String *left_str = vec_at(parser->state->strings, left->value);
+	String *right_str = vec_at(parser->state->strings, right.value);
 
 	// Create the result string
-	uint32_t left_len = strlen(left_str);
-	uint32_t length = left_len + strlen(right_str);
+	uint32_t length = left_str->length + right_str->length;
 	Index index = state_add_string(parser->state, length);
-	char *result = vec_at(parser->state->strings, index);
+	String *result = vec_at(parser->state->strings, index);
 
 	// Concatenate both values into one string
-	strncpy(result, left_str, left_len);
-	strcpy(&result[left_len], right_str);
+	memcpy(result->contents, left_str->contents, left_str->length);
+	memcpy(&result->contents[left_str->length], right_str->contents,
+		right_str->length);
 
 	// Add result as a string to the interpreter state
 	left->type = OP_STRING;
-	left->value = index;
+	left->value = state_intern_string(parser->state);
 	return true;
 }
 
@@ -988,7 +1082,8 @@ static bool fold_eq(Parser *parser, TokenType operator, Operand *left,
 		return false;
 	}
 
-	// If their values are equal (used for everything but numbers and strings)
+	// If their values are equal (used for everything but numbers). String
+	// literals are interned, so identical strings always have the same index
 	if (left->value == right.value) {
 		left->type = OP_PRIMITIVE;
 		left->value = (operator == TOKEN_EQ) ? TAG_TRUE : TAG_FALSE;
@@ -998,19 +1093,14 @@ static bool fold_eq(Parser *parser, TokenType operator, Operand *left,
 		return false;
 	}
 
-	// Try special tests for numbers and strings, assuming we're testing for
-	// equality (not inequality)
+	// Try special tests for numbers, assuming we're testing for equality (not
+	// inequality)
 	bool result = false;
 	if (left->type == OP_NUMBER) {
 		// Test if two doubles are equal
 		double left_num = operand_to_num(parser, left);
 		double right_num = operand_to_num(parser, &right);
 		result = (left_num == right_num);
-	} else if (left->type == OP_STRING) {
-		// Test if two strings are equal
-		char *left_str = operand_to_str(parser, left);
-		char *right_str = operand_to_str(parser, &right);
-		result = (strcmp(left_str, right_str) == 0);
 	}
 
 	// Invert the result if we're testing for inequality
@@ -1258,11 +1348,67 @@ static void expr_reduce_jump(Parser *parser, Operand *operand, uint16_t slot,
 }
 
 
+// Returns true if an operand's value doesn't fit into a single 16 bit
+// instruction argument, and so must be loaded into a local first.
+static inline bool operand_is_wide(Operand *operand) {
+	return operand->type >= OP_NUMBER && operand->type <= OP_NATIVE &&
+		operand->type != OP_PRIMITIVE && operand->value > UINT16_MAX;
+}
+
+
+// Emit a wide move instruction to load a constant operand whose value doesn't
+// fit into 16 bits into a local.
+static void expr_load_wide(Parser *parser, uint16_t slot, Operand *operand) {
+	BytecodeOpcode opcode;
+	switch (operand->type) {
+	case OP_NUMBER:
+		opcode = MOV_LN_WIDE;
+		break;
+	case OP_STRING:
+		opcode = MOV_LS_WIDE;
+		break;
+	case OP_FUNCTION:
+		opcode = MOV_LF_WIDE;
+		break;
+	default:
+		opcode = MOV_LV_WIDE;
+		break;
+	}
+
+	fn_emit(parser_fn(parser), opcode, slot, operand->value & 0xffff,
+		operand->value >> 16);
+	operand->type = OP_LOCAL;
+	operand->value = slot;
+}
+
+
+// Load an operand whose value doesn't fit into 16 bits into a new temporary
+// local, so it can be used as an argument to an instruction. Returns true if a
+// temporary local was reserved, which the caller must free.
+static bool operand_narrow(Parser *parser, Operand *operand) {
+	if (!operand_is_wide(operand)) {
+		return false;
+	}
+	expr_load_wide(parser, local_reserve(parser), operand);
+	return true;
+}
+
+
 // Emit bytecode to move an operand of any type into a local, upvalue, top
 // level local, or struct field.
 static void expr_discharge(Parser *parser, BytecodeOpcode base, uint16_t slot,
 		Operand operand, uint16_t arg3) {
-	if (operand.type == OP_LOCAL) {
+	if (operand_is_wide(&operand)) {
+		// Load the operand straight into the destination if it's a local,
+		// otherwise go through a temporary local
+		if (base == MOV_LL) {
+			expr_load_wide(parser, slot, &operand);
+		} else {
+			operand_narrow(parser, &operand);
+			fn_emit(parser_fn(parser), base, slot, operand.value, arg3);
+			local_free(parser);
+		}
+	} else if (operand.type == OP_LOCAL) {
 		// Only emit a move local instruction if this isn't a temporary
 		// local
 		if (base != MOV_LL || (operand.value != slot &&
@@ -1439,29 +1585,47 @@ static void binary_or(Parser *parser, Operand *left, Operand right) {
 // type and no folding is possible.
 static void binary_emit(Parser *parser, uint16_t slot, TokenType operator,
 		Operand *left, Operand right) {
+	// Constants whose indices don't fit into an instruction argument need to
+	// be loaded into temporary locals first
+	uint32_t temps = 0;
+	if (operator != TOKEN_AND && operator != TOKEN_OR) {
+		temps += operand_narrow(parser, left);
+		temps += operand_narrow(parser, &right);
+	}
+
 	switch (operator) {
 	case TOKEN_ADD:
 	case TOKEN_SUB:
 	case TOKEN_MUL:
 	case TOKEN_DIV:
 	case TOKEN_MOD:
-		return binary_arith(parser, slot, operator, left, right);
+		binary_arith(parser, slot, operator, left, right);
+		break;
 	case TOKEN_CONCAT:
-		return binary_concat(parser, slot, left, right);
+		binary_concat(parser, slot, left, right);
+		break;
 	case TOKEN_EQ:
 	case TOKEN_NEQ:
 	case TOKEN_LT:
 	case TOKEN_LE:
 	case TOKEN_GT:
 	case TOKEN_GE:
-		return binary_comp(parser, slot, operator, left, right);
+		binary_comp(parser, slot, operator, left, right);
+		break;
 	case TOKEN_AND:
-		return binary_and(parser, left, right);
+		binary_and(parser, left, right);
+		break;
 	case TOKEN_OR:
-		return binary_or(parser, left, right);
+		binary_or(parser, left, right);
+		break;
 	default:
 		// Invalid operator (shouldn't happen)
-		return;
+		break;
+	}
+
+	// Free the temporary locals
+	for (uint32_t i = 0; i < temps; i++) {
+		local_free(parser);
 	}
 }
 
@@ -1568,6 +1732,29 @@ static void expr_unary(Parser *parser, uint16_t slot, Token *op,
 //  Postfix Expression Bytecode Emission
 //
 
+// Return the index of the field named by the current token on the lexer, if
+// `operand` was just retrieved from `self` inside a method and the field is
+// defined on the method's struct. Otherwise return NOT_FOUND.
+static Index postfix_self_field(Parser *parser, Operand *operand) {
+	Index struct_index = parser->scope->struct_index;
+	Function *fn = parser_fn(parser);
+	if (struct_index == NOT_FOUND || operand->type != OP_LOCAL ||
+			vec_len(fn->instructions) == 0) {
+		return NOT_FOUND;
+	}
+
+	// The last instruction must have stored `self` into the operand
+	Instruction last = vec_last(fn->instructions);
+	if (ins_arg(last, 0) != MOV_SELF || ins_arg(last, 1) != operand->value) {
+		return NOT_FOUND;
+	}
+
+	StructDefinition *def = &vec_at(parser->state->structs, struct_index);
+	Token *name = &parser->lexer.token;
+	return struct_field_find(def, name->start, name->length);
+}
+
+
 // Emit bytecode for a struct field access as a postfix operator. Stores the
 // resulting field in `slot`.
 static void postfix_field_access(Parser *parser, uint16_t slot,
@@ -1586,6 +1773,26 @@ static void postfix_field_access(Parser *parser, uint16_t slot,
 		err_fatal(parser, &dot, "Attempt to index non-local");
 	}
 
+	// Strings must be moved into a local before we can index them
+	if (operand->type == OP_STRING) {
+		expr_discharge(parser, MOV_LL, slot, *operand, 0);
+		operand->type = OP_LOCAL;
+		operand->value = slot;
+	}
+
+	// Fields on `self` inside a method can be resolved at compile time
+	Index self_field = postfix_self_field(parser, operand);
+	if (self_field != NOT_FOUND) {
+		// Replace the instruction that retrieved `self`
+		vec_len(parser_fn(parser)->instructions)--;
+		fn_emit(parser_fn(parser), SELF_FIELD, slot, self_field, 0);
+		lexer_next(lexer);
+
+		operand->type = OP_LOCAL;
+		operand->value = slot;
+		return;
+	}
+
 	// Add the field to the state's field list
 	Identifier ident;
 	ident.name = lexer->token.start;
@@ -1602,8 +1809,51 @@ static void postfix_field_access(Parser *parser, uint16_t slot,
 }
 
 
-// Emit bytecode for an array access as a postfix operator. Stores the resulting
-// indexed value in `slot`.
+// Return a nil operand, used for a missing bound in a slice.
+static Operand operand_nil(void) {
+	Operand operand = operand_new();
+	operand.type = OP_PRIMITIVE;
+	operand.value = TAG_NIL;
+	return operand;
+}
+
+
+// Emit bytecode for slicing an array or string with `[start:end]`, after
+// parsing the start into `bounds`. The end is parsed into the slot after it.
+// A missing bound is nil, which means the start or end of the array or string.
+static void postfix_array_slice(Parser *parser, uint16_t slot,
+		Operand *operand, uint16_t bounds, Operand start, Token *open) {
+	Lexer *lexer = &parser->lexer;
+
+	// Skip the `:`
+	lexer_next(lexer);
+
+	// The bounds need to be in consecutive slots
+	expr_discharge(parser, MOV_LL, bounds, start, 0);
+	uint16_t end = local_reserve(parser);
+	if (lexer->token.type == TOKEN_CLOSE_BRACKET) {
+		expr_discharge(parser, MOV_LL, end, operand_nil(), 0);
+	} else {
+		expr_emit(parser, end);
+	}
+
+	// Expect a closing bracket
+	err_expect(parser, TOKEN_CLOSE_BRACKET, open,
+		"Expected `]` to close `[` in slice");
+	lexer_next(lexer);
+
+	local_free(parser);
+	local_free(parser);
+	fn_emit(parser_fn(parser), ARRAY_SLICE, slot, bounds, operand->value);
+
+	// The slice is in `slot`
+	operand->type = OP_LOCAL;
+	operand->value = slot;
+}
+
+
+// Emit bytecode for an array or map access (or a slice) as a postfix operator.
+// Stores the resulting indexed value in `slot`.
 static void postfix_array_access(Parser *parser, uint16_t slot,
 		Operand *operand) {
 	Lexer *lexer = &parser->lexer;
@@ -1613,28 +1863,48 @@ static void postfix_array_access(Parser *parser, uint16_t slot,
 	lexer_next(lexer);
 
 	// Can only index locals
-	if (operand->type != OP_LOCAL) {
+	if (operand->type != OP_LOCAL && operand->type != OP_STRING) {
 		err_fatal(parser, &open, "Attempt to index non-local");
 	}
 
-	// Parse an expression into a temporary slot
+	// Strings must be moved into a local before we can index them
+	if (operand->type == OP_STRING) {
+		expr_discharge(parser, MOV_LL, slot, *operand, 0);
+		operand->type = OP_LOCAL;
+		operand->value = slot;
+	}
+
+	// Parse an expression into a temporary slot, unless this is a slice
+	// without a start
 	uint16_t index_slot = local_reserve(parser);
-	Operand index = parse_expr(parser, index_slot);
-	local_free(parser);
+	Operand index = operand_nil();
+	if (lexer->token.type != TOKEN_COLON) {
+		index = parse_expr(parser, index_slot);
+	}
+
+	// A `:` after the index makes this a slice
+	if (lexer->token.type == TOKEN_COLON) {
+		postfix_array_slice(parser, slot, operand, index_slot, index, &open);
+		return;
+	}
 
 	// Expect a closing bracket
 	err_expect(parser, TOKEN_CLOSE_BRACKET, &open,
 		"Expected `]` to close `[` in array access");
 	lexer_next(lexer);
 
-	// The index must be an integer or local
-	if (index.type != OP_LOCAL && index.type != OP_INTEGER) {
-		err_fatal(parser, &open, "Array index must be an integer");
+	// Emit bytecode for the access. Only maps can be indexed by something
+	// other than a local or an integer, so put the key into the temporary slot
+	// and look it up in the map directly
+	if (index.type == OP_LOCAL || index.type == OP_INTEGER) {
+		local_free(parser);
+		expr_discharge(parser, ARRAY_GET_L, slot, index, operand->value);
+	} else {
+		expr_discharge(parser, MOV_LL, index_slot, index, 0);
+		local_free(parser);
+		fn_emit(parser_fn(parser), MAP_GET, slot, index_slot, operand->value);
 	}
 
-	// Emit bytecode for the access
-	expr_discharge(parser, ARRAY_GET_L, slot, index, operand->value);
-
 	// The field is in `slot`
 	operand->type = OP_LOCAL;
 	operand->value = slot;
@@ -1681,6 +1951,49 @@ static uint16_t parse_call_args(Parser *parser) {
 }
 
 
+// Emit bytecode for a call to a method (or function stored in a field) on an
+// object, where the last emitted instruction is the STRUCT_FIELD that
+// retrieved the method into the slot for `operand`. Store the return value of
+// the call into `return_slot`.
+static void postfix_field_call(Parser *parser, uint16_t return_slot,
+		Operand *operand) {
+	uint32_t locals_count = parser->scope->locals_count;
+
+	// Remove the field access instruction
+	Function *fn = parser_fn(parser);
+	Instruction retrieval = vec_last(fn->instructions);
+	vec_len(fn->instructions)--;
+	uint16_t struct_slot = ins_arg(retrieval, 2);
+	uint16_t field = ins_arg(retrieval, 3);
+
+	// The object must be on the top of the stack, directly before the
+	// arguments to the call
+	uint16_t base = operand->value;
+	if (base != locals_count - 1) {
+		base = local_reserve(parser);
+	}
+	if (base != struct_slot) {
+		fn_emit(fn, MOV_LL, base, struct_slot, 0);
+	}
+
+	// Parse the arguments and emit the call, which stores the return value in
+	// the base slot
+	uint16_t arity = parse_call_args(parser);
+	fn = parser_fn(parser);
+	fn_emit(fn, CALL_FIELD, base, arity, field);
+	if (base != return_slot) {
+		fn_emit(fn, MOV_LL, return_slot, base, 0);
+	}
+
+	// Free allocated locals
+	parser->scope->locals_count = locals_count;
+
+	// Set resulting operand to return value of function
+	operand->type = OP_LOCAL;
+	operand->value = return_slot;
+}
+
+
 // Emit bytecode for a function call as a postfix operator. Store the return
 // value of the function call into `slot`.
 static void postfix_call(Parser *parser, uint16_t return_slot,
@@ -1693,6 +2006,16 @@ static void postfix_call(Parser *parser, uint16_t return_slot,
 	// to bother manipulating the `parser->locals` array
 	uint32_t locals_count = parser->scope->locals_count;
 
+	// Calling a field on an object is handled separately, so we can avoid
+	// creating a bound method
+	Function *fn = parser_fn(parser);
+	if (operand->type == OP_LOCAL && vec_len(fn->instructions) > 0 &&
+			ins_arg(vec_last(fn->instructions), 0) == STRUCT_FIELD &&
+			ins_arg(vec_last(fn->instructions), 1) == operand->value) {
+		postfix_field_call(parser, return_slot, operand);
+		return;
+	}
+
 	// Operand must be a local, function, or native function
 	uint16_t base = 0;
 	if (operand->type == OP_LOCAL &&
@@ -1792,13 +2115,14 @@ static Operand operand_string(Parser *parser) {
 	// Subtract 2 as the token's length includes the two quotes surrounding
 	// the string
 	Index index = state_add_string(parser->state, lexer->token.length - 2);
-	char *string = vec_at(parser->state->strings, index);
-	lexer_extract_string(lexer, &lexer->token, string);
+	String *string = vec_at(parser->state->strings, index);
+	string->length = lexer_extract_string(lexer, &lexer->token,
+		string->contents);
 
-	// Create an operand from it
+	// Create an operand from it, reusing an identical literal if one exists
 	Operand operand = operand_new();
 	operand.type = OP_STRING;
-	operand.value = index;
+	operand.value = state_intern_string(parser->state);
 	lexer_next(lexer);
 	return operand;
 }
@@ -1873,7 +2197,7 @@ static Operand operand_identifier(Parser *parser, uint16_t slot) {
 
 	case RESOLVED_UPVALUE:
 		// Move the upvalue into the slot
-		fn_emit(parser_fn(parser), MOV_UL, slot, local.index, 0);
+		fn_emit(parser_fn(parser), MOV_LU, slot, local.index, 0);
 		result.value = slot;
 		break;
 
@@ -1922,14 +2246,25 @@ static Operand operand_subexpr(Parser *parser, uint16_t slot) {
 
 
 // Parse an anonymous function definition inside an expression.
-static Operand operand_anonymous_fn(Parser *parser) {
+static Operand operand_anonymous_fn(Parser *parser, uint16_t slot) {
 	// Skip the `fn` token
 	lexer_next(&parser->lexer);
 
-	// Parse the function into a new operand
+	// Parse the function
+	Index fn_index = parse_fn_def_body(parser, NOT_FOUND);
+
+	// Create a closure if the function captured any upvalues
+	Function *fn = &vec_at(parser->state->functions, fn_index);
+	if (vec_len(fn->captures) > 0) {
+		fn_emit(parser_fn(parser), CLOSURE_NEW, slot, fn_index & 0xffff,
+			fn_index >> 16);
+		return operand_local(slot);
+	}
+
+	// Otherwise use the function directly
 	Operand operand = operand_new();
 	operand.type = OP_FUNCTION;
-	operand.value = parse_fn_def_body(parser, false);
+	operand.value = fn_index;
 	return operand;
 }
 
@@ -1938,7 +2273,8 @@ static Operand operand_anonymous_fn(Parser *parser) {
 static Operand operand_emit_struct(Parser *parser, uint16_t struct_slot,
 		BytecodeOpcode opcode, Index index, Token *ident) {
 	// Emit bytecode for the instantiation
-	fn_emit(parser_fn(parser), opcode, struct_slot, index, 0);
+	fn_emit(parser_fn(parser), opcode, struct_slot, index & 0xffff,
+		index >> 16);
 
 	// Expect an open parenthesis
 	err_expect(parser, TOKEN_OPEN_PARENTHESIS, ident,
@@ -2021,18 +2357,27 @@ static Operand operand_instantiation(Parser *parser, uint16_t struct_slot) {
 }
 
 
-// Parse the use of the `self` operand in a method.
+// Parse the use of the `self` operand in a method, or in a function nested
+// inside a method.
 static Operand operand_self(Parser *parser, uint16_t slot) {
-	// TODO: Ensure we only use the self argument in a method
 	Lexer *lexer = &parser->lexer;
+	Token token = lexer->token;
 
 	// Skip the `self` token
 	lexer_next(lexer);
 
 	// Emit bytecode to store the self argument into the slot
-	fn_emit(parser_fn(parser), MOV_SELF, slot, 0, 0);
+	if (parser->scope->struct_index != NOT_FOUND) {
+		fn_emit(parser_fn(parser), MOV_SELF, slot, 0, 0);
+		return operand_local(slot);
+	}
 
-	// Create operand
+	// Nested functions capture `self` from the enclosing method
+	Index upvalue = self_resolve(parser, parser->scope);
+	if (upvalue == NOT_FOUND) {
+		err_fatal(parser, &token, "Cannot use `self` outside a method");
+	}
+	fn_emit(parser_fn(parser), MOV_LU, slot, upvalue, 0);
 	return operand_local(slot);
 }
 
@@ -2053,6 +2398,12 @@ static Operand operand_array(Parser *parser, uint16_t slot) {
 	uint16_t count = 0;
 	while (lexer->token.type != TOKEN_EOF &&
 			lexer->token.type != TOKEN_CLOSE_BRACKET) {
+		// The array's length and each element's index must fit into an
+		// instruction's argument
+		if (count == UINT16_MAX) {
+			err_fatal(parser, &open, "Too many elements in array literal");
+		}
+
 		// Parse an expression into a temporary slot
 		uint16_t element_slot = local_reserve(parser);
 		Operand element = parse_expr(parser, element_slot);
@@ -2084,6 +2435,68 @@ static Operand operand_array(Parser *parser, uint16_t slot) {
 }
 
 
+// Parse a map operand.
+static Operand operand_map(Parser *parser, uint16_t slot) {
+	Lexer *lexer = &parser->lexer;
+
+	// Skip the opening brace
+	Token open = lexer->token;
+	lexer_next(lexer);
+
+	// Create a new map
+	Function *fn = parser_fn(parser);
+	Index ins_index = fn_emit(fn, MAP_NEW, slot, 0, 0);
+
+	// Continually parse key value pairs
+	uint16_t count = 0;
+	while (lexer->token.type != TOKEN_EOF &&
+			lexer->token.type != TOKEN_CLOSE_BRACE) {
+		// Parse the key into a temporary slot, since MAP_SET_* instructions
+		// need their key in a local
+		uint16_t key_slot = local_reserve(parser);
+		Operand key = parse_expr(parser, key_slot);
+		if (key.type != OP_LOCAL) {
+			expr_discharge(parser, MOV_LL, key_slot, key, 0);
+			key = operand_local(key_slot);
+		}
+
+		// Expect a colon
+		err_expect(parser, TOKEN_COLON, &lexer->token,
+			"Expected `:` after key in map");
+		lexer_next(lexer);
+
+		// Parse the value into another temporary slot
+		uint16_t value_slot = local_reserve(parser);
+		Operand value = parse_expr(parser, value_slot);
+
+		// Emit bytecode to store the value against the key in the map
+		expr_discharge(parser, MAP_SET_L, key.value, value, slot);
+		local_free(parser);
+		local_free(parser);
+		count++;
+
+		// Expect a comma
+		if (lexer->token.type == TOKEN_COMMA) {
+			lexer_next(lexer);
+		} else {
+			break;
+		}
+	}
+
+	// Expect a closing brace
+	err_expect(parser, TOKEN_CLOSE_BRACE, &open,
+		"Expected `}` to close `{` in map");
+	lexer_next(lexer);
+
+	// Update the MAP_NEW instruction to allocate room for every key in the
+	// literal up front
+	Instruction ins = vec_at(fn->instructions, ins_index);
+	vec_at(fn->instructions, ins_index) = ins_set(ins, 2, count);
+
+	return operand_local(slot);
+}
+
+
 // Parse an operand which can be assigned to (`self` or an identifier).
 static Operand expr_operand_assignable(Parser *parser, uint16_t slot) {
 	switch (parser->lexer.token.type) {
@@ -2116,13 +2529,15 @@ static Operand expr_operand(Parser *parser, uint16_t slot) {
 	case TOKEN_OPEN_PARENTHESIS:
 		return operand_subexpr(parser, slot);
 	case TOKEN_FN:
-		return operand_anonymous_fn(parser);
+		return operand_anonymous_fn(parser, slot);
 	case TOKEN_NEW:
 		return operand_instantiation(parser, slot);
 	case TOKEN_SELF:
 		return operand_self(parser, slot);
 	case TOKEN_OPEN_BRACKET:
 		return operand_array(parser, slot);
+	case TOKEN_OPEN_BRACE:
+		return operand_map(parser, slot);
 	default:
 		err_unexpected(parser, &lexer->token, "Expected operand in expression");
 		return operand_new();
@@ -2165,8 +2580,10 @@ static Operand expr_left(Parser *parser, uint16_t slot) {
 //
 
 // Parse part of an expression, up until we reach an operator with lower
-// predence than `prec`.
-static Operand expr_precedence(Parser *parser, uint16_t slot, Precedence prec) {
+// predence than `prec`, or the operator `stop` (used to end the first bound of
+// a range at the `..`, rather than treating it as a concatenation).
+static Operand expr_precedence(Parser *parser, uint16_t slot, Precedence prec,
+		TokenType stop) {
 	Lexer *lexer = &parser->lexer;
 
 	// Expect left operator to binary operation
@@ -2174,7 +2591,8 @@ static Operand expr_precedence(Parser *parser, uint16_t slot, Precedence prec) {
 
 	// Parse binary operations until we find one with a precedence lower than
 	// the limit
-	while (prec_binary(lexer->token.type) > prec) {
+	while (prec_binary(lexer->token.type) > prec &&
+			lexer->token.type != stop) {
 		// Skip operator
 		Token operator = lexer->token;
 		lexer_next(lexer);
@@ -2186,7 +2604,7 @@ static Operand expr_precedence(Parser *parser, uint16_t slot, Precedence prec) {
 		// Parse the right operand to the operation
 		uint16_t right_slot = local_reserve(parser);
 		Precedence right_prec = prec_binary(operator.type);
-		Operand right = expr_precedence(parser, right_slot, right_prec);
+		Operand right = expr_precedence(parser, right_slot, right_prec, stop);
 		local_free(parser);
 
 		// Emit the operation, where the result of the operation becomes the new
@@ -2203,7 +2621,7 @@ static Operand expr_precedence(Parser *parser, uint16_t slot, Precedence prec) {
 // operand), then no temporary locals may be allocated and `slot` will go
 // unused.
 static Operand parse_expr(Parser *parser, uint16_t slot) {
-	return expr_precedence(parser, slot, PREC_NONE);
+	return expr_precedence(parser, slot, PREC_NONE, TOKEN_EOF);
 }
 
 
@@ -2250,12 +2668,24 @@ static void parse_declaration_local(Parser *parser, char *name,
 }
 
 
-// Parse an expression into a new top level local with the name `name`.
-static void parse_declaration_top_level(Parser *parser, char *name,
+// Add a new top level local to the package being parsed, triggering an error
+// at `token` if there are too many to fit into an instruction's argument.
+static Index top_level_add(Parser *parser, Token *token, char *name,
 		uint32_t length) {
+	Index top_level = pkg_local_add(parser_pkg(parser), name, length,
+		VALUE_NIL);
+	if (top_level > UINT16_MAX) {
+		err_fatal(parser, token, "Too many top level locals in package");
+	}
+	return top_level;
+}
+
+
+// Parse an expression into a new top level local with the name `name`.
+static void parse_declaration_top_level(Parser *parser, Token *name) {
 	// Allocate new top level local
 	Package *pkg = parser_pkg(parser);
-	Index top_level = pkg_local_add(pkg, NULL, 0, VALUE_NIL);
+	Index top_level = top_level_add(parser, name, NULL, 0);
 
 	// Parse expression into top level
 	uint16_t temp = local_reserve(parser);
@@ -2266,8 +2696,8 @@ static void parse_declaration_top_level(Parser *parser, char *name,
 	// Set the name of the top level after we parse the expression, so we can't
 	// actually use the top level inside the expression
 	Identifier *ident = &vec_at(pkg->names, top_level);
-	ident->name = name;
-	ident->length = length;
+	ident->name = name->start;
+	ident->length = name->length;
 }
 
 
@@ -2299,7 +2729,7 @@ static void parse_declaration(Parser *parser) {
 	// Parse expression into top level local if this is the uppermost function
 	// scope
 	if (parser_is_top_level(parser)) {
-		parse_declaration_top_level(parser, name.start, name.length);
+		parse_declaration_top_level(parser, &name);
 	} else {
 		parse_declaration_local(parser, name.start, name.length);
 	}
@@ -2313,21 +2743,34 @@ static void parse_assignment(Parser *parser, Operand operand, uint16_t slot) {
 	Lexer *lexer = &parser->lexer;
 
 	// Skip the assignment token
+	Token assign = lexer->token;
 	lexer_next(lexer);
 
 	// Save the last retrieval instruction, which will need to be converted
 	// into a storage instruction after parsing the expression
 	Instruction retrieval = vec_last(parser_fn(parser)->instructions);
 	BytecodeOpcode opcode = ins_arg(retrieval, 0);
+	if (opcode == ARRAY_SLICE) {
+		err_fatal(parser, &assign, "Cannot assign to a slice");
+	}
 
 	// If the retrieval was a specially emitted storage instruction
 	if (opcode == MOV_LT || opcode == MOV_LU || opcode == STRUCT_FIELD ||
-			opcode == ARRAY_GET_L || opcode == ARRAY_GET_I) {
+			opcode == SELF_FIELD || opcode == ARRAY_GET_L ||
+			opcode == ARRAY_GET_I || opcode == MAP_GET) {
 		// Remove the last retrieval instruction
 		vec_len(parser_fn(parser)->instructions)--;
 
-		// Parse an expression into a temporary local
+		// Parse an expression into a temporary local. The key of an array or
+		// map access might be in a temporary local that's since been freed, so
+		// make sure we don't overwrite it
+		bool keyed = opcode == ARRAY_GET_L || opcode == MAP_GET;
 		uint16_t expr_slot = local_reserve(parser);
+		uint16_t temporaries = 1;
+		while (keyed && expr_slot <= ins_arg(retrieval, 2)) {
+			expr_slot = local_reserve(parser);
+			temporaries++;
+		}
 		Operand result = parse_expr(parser, expr_slot);
 
 		if (opcode == MOV_LT && ins_arg(retrieval, 1) == slot) {
@@ -2344,6 +2787,10 @@ static void parse_assignment(Parser *parser, Operand operand, uint16_t slot) {
 			uint16_t struct_slot = ins_arg(retrieval, 2);
 			uint16_t field = ins_arg(retrieval, 3);
 			expr_discharge(parser, STRUCT_SET_L, field, result, struct_slot);
+		} else if (opcode == SELF_FIELD) {
+			// Field on self
+			uint16_t field = ins_arg(retrieval, 2);
+			expr_discharge(parser, SELF_SET_L, field, result, 0);
 		} else if (opcode == ARRAY_GET_L || opcode == ARRAY_GET_I) {
 			// Array access
 			BytecodeOpcode base = (opcode == ARRAY_GET_L) ? ARRAY_L_SET_L :
@@ -2351,10 +2798,17 @@ static void parse_assignment(Parser *parser, Operand operand, uint16_t slot) {
 			uint16_t array_slot = ins_arg(retrieval, 3);
 			uint16_t index = ins_arg(retrieval, 2);
 			expr_discharge(parser, base, index, result, array_slot);
+		} else if (opcode == MAP_GET) {
+			// Map access
+			uint16_t map_slot = ins_arg(retrieval, 3);
+			uint16_t key = ins_arg(retrieval, 2);
+			expr_discharge(parser, MAP_SET_L, key, result, map_slot);
 		}
 
-		// Free the temporary local we parsed the expression into
-		local_free(parser);
+		// Free the temporary locals we parsed the expression into
+		for (; temporaries > 0; temporaries--) {
+			local_free(parser);
+		}
 	} else {
 		// Parse the expression directly into the local
 		expr_emit(parser, operand.value);
@@ -2437,6 +2891,13 @@ static void parse_braced_block(Parser *parser) {
 
 // Parse the condition of an if branch.
 static Operand parse_conditional_expr(Parser *parser) {
+	// A brace here opens the body of a statement with a missing condition,
+	// rather than a map
+	Lexer *lexer = &parser->lexer;
+	if (lexer->token.type == TOKEN_OPEN_BRACE) {
+		err_unexpected(parser, &lexer->token, "Expected operand in expression");
+	}
+
 	// Parse the condition
 	uint16_t slot = local_reserve(parser);
 	Operand condition = parse_expr(parser, slot);
@@ -2558,6 +3019,7 @@ static void parse_if(Parser *parser) {
 // Push a loop onto the current function's loop linked list.
 static void loop_push(Parser *parser, Loop *loop) {
 	loop->head = NOT_FOUND;
+	loop->actives = parser->scope->actives_count;
 	loop->parent = parser->scope->loop;
 	parser->scope->loop = loop;
 }
@@ -2639,6 +3101,74 @@ static void parse_loop(Parser *parser) {
 }
 
 
+// Parse a for loop, either over the numbers in the range `start..end` (which
+// includes `start` but excludes `end`), or over the elements of an array.
+static void parse_for(Parser *parser) {
+	Lexer *lexer = &parser->lexer;
+
+	// Skip the `for` token
+	Token for_token = lexer->token;
+	lexer_next(lexer);
+
+	// Expect the name of the loop variable
+	err_expect(parser, TOKEN_IDENTIFIER, &for_token,
+		"Expected identifier after `for`");
+	Token name = lexer->token;
+	lexer_next(lexer);
+
+	// Expect `in`
+	err_expect(parser, TOKEN_IN, &name,
+		"Expected `in` after variable name in `for` loop");
+	lexer_next(lexer);
+
+	// The counter and limit (or array and index) live in unnamed locals in a
+	// block around the loop, so the loop's body can't modify them
+	block_new(parser);
+	uint16_t base = local_new(parser);
+	uint16_t limit = local_new(parser);
+
+	// Parse the start of the range (or the array), stopping at any `..`
+	Operand start = expr_precedence(parser, base, PREC_NONE, TOKEN_CONCAT);
+	expr_discharge(parser, MOV_LL, base, start, 0);
+
+	// Parse the end of the range if this is a numeric loop
+	BytecodeOpcode opcode = FOR_ARRAY_PREP;
+	if (lexer->token.type == TOKEN_CONCAT) {
+		lexer_next(lexer);
+		expr_emit(parser, limit);
+		opcode = FOR_PREP;
+	}
+
+	// Add the loop to the function's linked list
+	Loop loop;
+	loop_push(parser, &loop);
+	Function *fn = parser_fn(parser);
+	Index prep = fn_emit(fn, opcode, base, 0, 0);
+
+	// Declare the loop variable in a block of its own around the body, so
+	// closures capture a fresh variable on each iteration
+	block_new(parser);
+	Local *local = local_get(parser, local_new(parser));
+	local->name = name.start;
+	local->length = name.length;
+	parse_braced_block(parser);
+	block_free(parser);
+
+	// Insert the increment and jump back to the start of the body, and point
+	// the initial check to after it
+	fn = parser_fn(parser);
+	uint16_t offset = vec_len(fn->instructions) - (prep + 1);
+	Index end = fn_emit(fn, opcode + (FOR_LOOP - FOR_PREP), base, offset, 0);
+	vec_at(fn->instructions, prep) = ins_set(vec_at(fn->instructions, prep),
+		2, end + 1 - prep);
+
+	// Remove the loop from the linked list and patch break statements
+	loop_pop(parser);
+	jmp_target_all(fn, loop.head, vec_len(fn->instructions));
+	block_free(parser);
+}
+
+
 // Parse a break statement.
 static void parse_break(Parser *parser) {
 	Lexer *lexer = &parser->lexer;
@@ -2652,6 +3182,17 @@ static void parse_break(Parser *parser) {
 	// Skip the break token
 	lexer_next(lexer);
 
+	// Close the upvalues of any locals inside the loop captured by a closure.
+	// Locals are defined afresh on each iteration, so only closures created
+	// before the break can have captured them
+	for (uint32_t i = parser->scope->loop->actives;
+			i < parser->scope->actives_count; i++) {
+		if (local_get(parser, i)->captured) {
+			fn_emit(fn, UPVALUE_CLOSE, i, 0, 0);
+			break;
+		}
+	}
+
 	// Insert an empty jump
 	Index jump = fn_emit(fn, JMP, 0, 0, 0);
 
@@ -2709,11 +3250,12 @@ static uint32_t parse_fn_def_args(Parser *parser) {
 
 
 // Parse the arguments and body of a function definition with the name `name`
-// Return the index of the created function.
-static Index parse_fn_def_body(Parser *parser, bool is_method) {
+// Return the index of the created function. `struct_index` is the struct the
+// function is a method on, or NOT_FOUND if it isn't a method.
+static Index parse_fn_def_body(Parser *parser, Index struct_index) {
 	// Create a new function scope
 	FunctionScope scope = scope_new(parser);
-	scope.is_method = is_method;
+	scope.struct_index = struct_index;
 	Function *child = &vec_at(parser->state->functions, scope.fn_index);
 	scope_push(parser, &scope);
 	child->arity = 0;
@@ -2745,16 +3287,16 @@ static void parse_fn_def(Parser *parser, Token *fn_token) {
 	// Expect the name of the function
 	err_expect(parser, TOKEN_IDENTIFIER, fn_token,
 		"Expected identifier after `fn`");
-	char *name = lexer->token.start;
-	uint32_t length = lexer->token.length;
+	Token name_token = lexer->token;
+	char *name = name_token.start;
+	uint32_t length = name_token.length;
 	lexer_next(lexer);
 
 	// Save as a top level local if necessary
 	uint16_t slot;
 	if (parser_is_top_level(parser)) {
 		// Allocate new top level local
-		Package *pkg = parser_pkg(parser);
-		slot = pkg_local_add(pkg, name, length, VALUE_NIL);
+		slot = top_level_add(parser, &name_token, name, length);
 	} else {
 		// Allocate a new local
 		slot = local_new(parser);
@@ -2764,24 +3306,32 @@ static void parse_fn_def(Parser *parser, Token *fn_token) {
 	}
 
 	// Parse the rest of the function
-	Index fn_index = parse_fn_def_body(parser, false);
+	Index fn_index = parse_fn_def_body(parser, NOT_FOUND);
 
 	// Set the function's name
 	Function *fn = &vec_at(parser->state->functions, fn_index);
 	fn->name = name;
 	fn->length = length;
 
-	// Emit a store instruction
+	// Emit a store instruction, creating a closure if the function captured
+	// any upvalues (which is never the case at the top level)
+	Operand operand = operand_new();
+	operand.type = OP_FUNCTION;
+	operand.value = fn_index;
 	if (parser_is_top_level(parser)) {
-		fn_emit(parser_fn(parser), MOV_TF, slot, fn_index, parser->package);
+		expr_discharge(parser, MOV_TL, slot, operand, parser->package);
+	} else if (vec_len(fn->captures) > 0) {
+		fn_emit(parser_fn(parser), CLOSURE_NEW, slot, fn_index & 0xffff,
+			fn_index >> 16);
 	} else {
-		fn_emit(parser_fn(parser), MOV_LF, slot, fn_index, 0);
+		expr_discharge(parser, MOV_LL, slot, operand, 0);
 	}
 }
 
 
 // Parse the body of a custom constructor.
-static void parse_constructor(Parser *parser, StructDefinition *def) {
+static void parse_constructor(Parser *parser, Index struct_index) {
+	StructDefinition *def = &vec_at(parser->state->structs, struct_index);
 	Lexer *lexer = &parser->lexer;
 
 	// Skip `new` token
@@ -2794,8 +3344,11 @@ static void parse_constructor(Parser *parser, StructDefinition *def) {
 			def->name);
 	}
 
-	// Parse the function body
-	def->constructor = parse_fn_def_body(parser, true);
+	// Parse the function body. Parsing might define new structs, so fetch the
+	// definition again afterwards
+	Index fn_index = parse_fn_def_body(parser, struct_index);
+	def = &vec_at(parser->state->structs, struct_index);
+	def->constructor = fn_index;
 }
 
 
@@ -2829,9 +3382,8 @@ static void parse_method_def(Parser *parser) {
 	lexer_next(lexer);
 
 	// Check if this is a custom constructor
-	StructDefinition *def = &vec_at(parser->state->structs, struct_index);
 	if (lexer->token.type == TOKEN_NEW) {
-		parse_constructor(parser, def);
+		parse_constructor(parser, struct_index);
 		return;
 	}
 
@@ -2842,14 +3394,15 @@ static void parse_method_def(Parser *parser) {
 	lexer_next(lexer);
 
 	// Parse the rest of the function
-	Index fn_index = parse_fn_def_body(parser, true);
+	Index fn_index = parse_fn_def_body(parser, struct_index);
 
 	// Set the function's name
 	Function *fn = &vec_at(parser->state->functions, fn_index);
 	fn->name = name;
 	fn->length = length;
 
-	// Add a field to the struct
+	// Add a method to the struct
+	StructDefinition *def = &vec_at(parser->state->structs, struct_index);
 	struct_method_new(def, name, length, fn_index);
 }
 
@@ -2899,6 +3452,20 @@ static void parse_return(Parser *parser) {
 
 		// Return the parsed operand
 		expr_discharge(parser, RET_L, 0, operand, 0);
+
+		// If we're returning the result of a function call, make it a tail
+		// call so it reuses this function's stack frame
+		Function *fn = parser_fn(parser);
+		uint32_t length = vec_len(fn->instructions);
+		if (length >= 2) {
+			Instruction ret = vec_at(fn->instructions, length - 1);
+			Instruction call = vec_at(fn->instructions, length - 2);
+			if (ins_arg(ret, 0) == RET_L && ins_arg(call, 0) == CALL &&
+					ins_arg(call, 3) == ins_arg(ret, 2)) {
+				vec_at(fn->instructions, length - 2) =
+					ins_set(call, 0, TAIL_CALL);
+			}
+		}
 	} else {
 		// Return nothing
 		fn_emit(parser_fn(parser), RET0, 0, 0, 0);
@@ -3020,6 +3587,10 @@ static void parse_statement(Parser *parser) {
 		parse_loop(parser);
 		break;
 
+	case TOKEN_FOR:
+		parse_for(parser);
+		break;
+
 	case TOKEN_BREAK:
 		parse_break(parser);
 		break;
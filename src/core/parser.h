@@ -23,6 +23,10 @@ typedef struct loop {
 
 	// The head of the jump list for all break statements inside this loop.
 	Index head;
+
+	// The number of named locals in the function when the loop started, so a
+	// break statement knows which locals it takes out of scope.
+	uint32_t actives;
 } Loop;
 
 
@@ -36,8 +40,10 @@ typedef struct function_scope {
 	// list. Bytecode instructions are emitted into this function.
 	Index fn_index;
 
-	// Set to true when this function scope is a method on a struct.
-	bool is_method;
+	// The index of the struct this function is a method (or constructor) on,
+	// or NOT_FOUND if it isn't a method. Lets us resolve the position of
+	// fields on `self` at compile time.
+	Index struct_index;
 
 	// The start and size of all locals used by this function, including
 	// temporary ones.
@@ -69,6 +75,10 @@ typedef struct {
 
 	// The block scope in which the local was defined.
 	uint32_t block;
+
+	// Whether the local has been captured as an upvalue by a closure, in which
+	// case its upvalue must be closed when it goes out of scope.
+	bool captured;
 } Local;
 
 
@@ -9,13 +9,8 @@
 #include "state.h"
 #include "err.h"
 #include "exec.h"
-
-
-// The maximum stack size.
-#define MAX_STACK_SIZE 2048
-
-// The maximum call stack size storing data for function calls.
-#define MAX_CALL_STACK_SIZE 2048
+#include "jmp.h"
+#include "opt.h"
 
 
 // Execute a file by creating a new interpreter state, reading the contents of
@@ -54,12 +49,32 @@ HyState * hy_new(void) {
 	vec_new(state->native_structs, NativeStructDefinition, 4);
 
 	vec_new(state->constants, HyValue, 32);
-	vec_new(state->strings, char *, 16);
+	vec_new(state->strings, String *, 16);
 	vec_new(state->fields, Identifier, 16);
 
-	state->stack = malloc(sizeof(HyValue) * MAX_STACK_SIZE);
-	state->call_stack = malloc(sizeof(Frame) * MAX_CALL_STACK_SIZE);
+	state->interned_capacity = STRING_TABLE_INITIAL_CAPACITY;
+	state->interned = malloc(sizeof(Index) * state->interned_capacity);
+	for (uint32_t i = 0; i < state->interned_capacity; i++) {
+		state->interned[i] = NOT_FOUND;
+	}
+
+	// The garbage collector treats stack slots as roots, so they must never
+	// contain garbage
+	state->stack_capacity = STACK_INITIAL_SIZE;
+	state->stack = malloc(sizeof(HyValue) * state->stack_capacity);
+	for (uint32_t i = 0; i < state->stack_capacity; i++) {
+		state->stack[i] = VALUE_NIL;
+	}
+
+	state->call_stack_capacity = CALL_STACK_INITIAL_SIZE;
+	state->call_stack = malloc(sizeof(Frame) * state->call_stack_capacity);
 	state->call_stack_count = 0;
+	state->call_stack_limit = DEFAULT_CALL_STACK_LIMIT;
+	vec_new(state->upvalues, HyValue, 8);
+
+	gc_new(&state->gc);
+	jit_new(&state->jit);
+	state->optimise = true;
 
 	state->error = NULL;
 	return state;
@@ -68,6 +83,11 @@ HyState * hy_new(void) {
 
 // Release all resources allocated by an interpreter state.
 void hy_free(HyState *state) {
+	// Objects (before native structs, since freeing them can call a native
+	// struct's destructor)
+	gc_free(state, &state->gc);
+	jit_free(&state->jit);
+
 	// Source files
 	for (uint32_t i = 0; i < vec_len(state->sources); i++) {
 		Source *src = &vec_at(state->sources, i);
@@ -115,9 +135,11 @@ void hy_free(HyState *state) {
 	vec_free(state->constants);
 	vec_free(state->strings);
 	vec_free(state->fields);
+	free(state->interned);
 
 	// Runtime stacks
 	free(state->stack);
+	vec_free(state->upvalues);
 	free(state->call_stack);
 
 	// The interpreter state itself
@@ -125,16 +147,40 @@ void hy_free(HyState *state) {
 }
 
 
+// Set the maximum depth of the call stack, after which calling a function
+// triggers a stack overflow error.
+void hy_set_stack_limit(HyState *state, uint32_t depth) {
+	state->call_stack_limit = depth;
+}
+
+
+// Enable or disable the bytecode optimiser, which is enabled by default.
+void hy_set_optimiser(HyState *state, bool enabled) {
+	state->optimise = enabled;
+}
+
+
 // Parse and run some source code.
 HyError * vm_parse_and_run(HyState *state, HyPackage pkg_index, Index source) {
 	Package *pkg = &vec_at(state->packages, pkg_index);
 
 	// Parse the source code
 	Index main_fn = 0;
+	Index first_fn = vec_len(state->functions);
 	HyError *err = pkg_parse(pkg, source, &main_fn);
 
 	// Execute the main function if no error occurred
 	if (err == NULL) {
+		// Prepare every function created while parsing for execution
+		for (Index i = first_fn; i < vec_len(state->functions); i++) {
+			Function *fn = &vec_at(state->functions, i);
+			if (state->optimise) {
+				opt_fn(fn);
+			}
+			jmp_fuse(fn);
+			fn_caches_new(fn);
+			jit_fn_prepare(state, i);
+		}
 		err = exec_fn(state, main_fn);
 	}
 	return err;
@@ -167,6 +213,40 @@ HyError * hy_pkg_run_string(HyState *state, HyPackage pkg, char *source) {
 }
 
 
+// Ensure the call stack has room for at least `frames` frames, and the stack
+// for at least `slots` values, reallocating them if needed. Returns false if
+// either would exceed its limit.
+bool state_grow_stacks(HyState *state, uint32_t frames, uint32_t slots) {
+	if (frames > state->call_stack_limit || slots > MAX_STACK_SIZE) {
+		return false;
+	}
+
+	// Double the capacity of each stack until it's large enough
+	if (frames > state->call_stack_capacity) {
+		while (frames > state->call_stack_capacity) {
+			state->call_stack_capacity *= 2;
+		}
+		state->call_stack = realloc(state->call_stack,
+			sizeof(Frame) * state->call_stack_capacity);
+	}
+
+	if (slots > state->stack_capacity) {
+		uint32_t old = state->stack_capacity;
+		while (slots > state->stack_capacity) {
+			state->stack_capacity *= 2;
+		}
+		state->stack = realloc(state->stack,
+			sizeof(HyValue) * state->stack_capacity);
+
+		// The garbage collector treats stack slots as roots
+		for (uint32_t i = old; i < state->stack_capacity; i++) {
+			state->stack[i] = VALUE_NIL;
+		}
+	}
+	return true;
+}
+
+
 // Add a constant to the interpreter state, returning its index.
 Index state_add_constant(HyState *state, HyValue constant) {
 	vec_inc(state->constants);
@@ -175,14 +255,87 @@ Index state_add_constant(HyState *state, HyValue constant) {
 }
 
 
-// Create a new string constant that is `length` bytes long.
+// Create a new string constant that is `length` bytes long. Its contents must
+// be filled in before it's interned by calling `state_intern_string`.
 Index state_add_string(HyState *state, uint32_t length) {
+	// String constants are permanent, so don't allocate them on the garbage
+	// collector's heap. Leave them marked so a major collection never tries to
+	// trace them
+	String *string = malloc(sizeof(String) + length + 1);
+	string->type = OBJ_STRING;
+	string->mark = true;
+	string->remembered = false;
+	string->next = NULL;
+	string->length = length;
+	string->hash = 0;
+	string->contents[length] = '\0';
+
 	vec_inc(state->strings);
-	vec_last(state->strings) = malloc(length + 1);
+	vec_last(state->strings) = string;
 	return vec_len(state->strings) - 1;
 }
 
 
+// Return a pointer to the bucket in the intern table that either contains
+// a string identical to `string`, or is empty if no such string exists.
+static Index * intern_find(HyState *state, String *string) {
+	uint32_t mask = state->interned_capacity - 1;
+	uint32_t bucket = string_hash_get(string) & mask;
+	while (state->interned[bucket] != NOT_FOUND) {
+		String *match = vec_at(state->strings, state->interned[bucket]);
+		if (string_cmp(string, match)) {
+			break;
+		}
+		bucket = (bucket + 1) & mask;
+	}
+	return &state->interned[bucket];
+}
+
+
+// Double the capacity of the intern table, rehashing every string in it.
+static void intern_grow(HyState *state) {
+	Index *old = state->interned;
+	uint32_t old_capacity = state->interned_capacity;
+
+	state->interned_capacity *= 2;
+	state->interned = malloc(sizeof(Index) * state->interned_capacity);
+	for (uint32_t i = 0; i < state->interned_capacity; i++) {
+		state->interned[i] = NOT_FOUND;
+	}
+
+	for (uint32_t i = 0; i < old_capacity; i++) {
+		if (old[i] != NOT_FOUND) {
+			*intern_find(state, vec_at(state->strings, old[i])) = old[i];
+		}
+	}
+	free(old);
+}
+
+
+// Intern the most recently added string constant. If an identical string
+// already exists, the new one is freed and the existing one's index is
+// returned instead.
+Index state_intern_string(HyState *state) {
+	Index index = vec_len(state->strings) - 1;
+	String *string = vec_at(state->strings, index);
+
+	// Check for an existing string first
+	Index *bucket = intern_find(state, string);
+	if (*bucket != NOT_FOUND) {
+		free(string);
+		vec_len(state->strings)--;
+		return *bucket;
+	}
+
+	// Keep the table at most half full
+	*bucket = index;
+	if (vec_len(state->strings) * 2 > state->interned_capacity) {
+		intern_grow(state);
+	}
+	return index;
+}
+
+
 // Add a field name to the interpreter state's fields list. If a field matching
 // `ident` already exists, then it returns the index of the existing field.
 Index state_add_field(HyState *state, Identifier ident) {
@@ -15,6 +15,28 @@
 #include "struct.h"
 #include "parser.h"
 #include "value.h"
+#include "gc.h"
+#include "jit.h"
+
+
+// The number of values the stack initially has room for. The stack grows as
+// functions are called.
+#define STACK_INITIAL_SIZE 256
+
+// The number of frames the call stack initially has room for.
+#define CALL_STACK_INITIAL_SIZE 64
+
+// The maximum number of values on the stack, after which we trigger a stack
+// overflow error.
+#define MAX_STACK_SIZE (1 << 24)
+
+// The default maximum depth of the call stack, after which we trigger a stack
+// overflow error. Can be changed using `hy_set_stack_limit`.
+#define DEFAULT_CALL_STACK_LIMIT (1 << 18)
+
+// The initial number of buckets in the string literal intern table. Must be a
+// power of 2.
+#define STRING_TABLE_INITIAL_CAPACITY 64
 
 
 // Some source code, either from a file or string.
@@ -34,10 +56,13 @@ typedef struct {
 	// A pointer to the calling function being executed in this frame.
 	Function *fn;
 
-	// A pointer to the `self` argument for methods, or VALUE_NIL if this isn't
-	// a method call.
+	// A pointer to the `self` argument for methods, or VALUE_NIL for any other
+	// function.
 	HyValue self;
 
+	// The closure being called, or VALUE_NIL if the function isn't a closure.
+	HyValue closure;
+
 	// The start of the calling function's locals on the stack (absolute stack
 	// position).
 	uint32_t stack_start;
@@ -48,7 +73,7 @@ typedef struct {
 
 	// The saved instruction pointer for the calling function, pointing to the
 	// call instruction used to execute the called function.
-	Instruction *ip;
+	ThreadedIns *ip;
 } Frame;
 
 
@@ -75,17 +100,49 @@ struct hy_state {
 	//
 	// The constants array holds all number literals and values defined using
 	// `const`. Struct fields are stored as the hash of the field name.
+	//
+	// String literals are interned, so each unique literal is stored once as a
+	// permanent, immutable string object that's loaded onto the stack by
+	// pointer. They live outside the garbage collector's heap and are never
+	// freed until the interpreter state is.
 	Vec(HyValue) constants;
-	Vec(char *) strings;
+	Vec(String *) strings;
 	Vec(Identifier) fields;
 
-	// The interpreter's runtime stack, used to store variables.
+	// An open addressing hash table mapping the contents of a string literal to
+	// its index in the `strings` array, used to intern literals. Empty buckets
+	// are NOT_FOUND. The capacity is always a power of 2.
+	Index *interned;
+	uint32_t interned_capacity;
+
+	// The interpreter's runtime stack, used to store variables. Grows as
+	// functions are called, so pointers into it are invalidated by calls.
 	HyValue *stack;
+	uint32_t stack_capacity;
 
 	// The runtime call frame stack, used to store the stack of functions being
-	// called at any point in time.
+	// called at any point in time, and the maximum number of frames it's
+	// allowed to hold.
 	Frame *call_stack;
 	uint32_t call_stack_count;
+	uint32_t call_stack_capacity;
+	uint32_t call_stack_limit;
+
+	// Every open upvalue (one that still refers to a local on the stack),
+	// sorted by the stack slot it refers to. Closures capturing the same local
+	// share its upvalue, so we need to be able to find it again.
+	Vec(HyValue) upvalues;
+
+	// The garbage collector, which keeps track of every object allocated on
+	// the heap.
+	GarbageCollector gc;
+
+	// The tracing JIT compiler, which compiles hot loops into machine code.
+	Jit jit;
+
+	// Whether to run the bytecode optimiser over each function once it's been
+	// parsed.
+	bool optimise;
 
 	// We use longjmp/setjmp for errors, which requires a jump buffer, which we
 	// store in the interpreter state.
@@ -97,12 +154,23 @@ struct hy_state {
 };
 
 
+// Ensure the call stack has room for at least `frames` frames, and the stack
+// for at least `slots` values, reallocating them if needed. Returns false if
+// either would exceed its limit.
+bool state_grow_stacks(HyState *state, uint32_t frames, uint32_t slots);
+
 // Add a constant to the interpreter state, returning its index.
 Index state_add_constant(HyState *state, HyValue constant);
 
-// Create a new string constant that is `length` bytes long.
+// Create a new string constant that is `length` bytes long. Its contents must
+// be filled in before it's interned by calling `state_intern_string`.
 Index state_add_string(HyState *state, uint32_t length);
 
+// Intern the most recently added string constant. If an identical string
+// already exists, the new one is freed and the existing one's index is
+// returned instead.
+Index state_intern_string(HyState *state);
+
 // Add a field name to the interpreter state's fields list. If a field matching
 // `ident` already exists, then it returns the index of the existing field.
 Index state_add_field(HyState *state, Identifier ident);
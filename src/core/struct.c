@@ -19,7 +19,7 @@ Index struct_new(HyState *state, Index pkg) {
 	def->line = 0;
 	def->constructor = NOT_FOUND;
 	vec_new(def->fields, Identifier, 8);
-	vec_new(def->methods, Index, 8);
+	vec_new(def->methods, MethodDefinition, 8);
 	return vec_len(state->structs) - 1;
 }
 
@@ -45,33 +45,26 @@ Index struct_find(HyState *state, Index pkg, char *name, uint32_t length) {
 }
 
 
-// Create a new field or method on the struct, depending on the value of `fn`.
-Index struct_field_or_method_new(StructDefinition *def, char *name,
-		uint32_t length, Index fn) {
-	// Name of the field
+// Create a new field on the struct. Return the index of the field.
+Index struct_field_new(StructDefinition *def, char *name, uint32_t length) {
 	vec_inc(def->fields);
 	Identifier *ident = &vec_last(def->fields);
 	ident->name = name;
 	ident->length = length;
-
-	// Method index
-	vec_inc(def->methods);
-	vec_last(def->methods) = fn;
 	return vec_len(def->fields) - 1;
 }
 
 
-// Create a new field on the struct. Return the index of the field.
-Index struct_field_new(StructDefinition *def, char *name, uint32_t length) {
-	return struct_field_or_method_new(def, name, length, NOT_FOUND);
-}
-
-
 // Create a new method on the struct with the function defined at `fn`. Return
-// the index of the field the method was created at.
+// the index of the method.
 Index struct_method_new(StructDefinition *def, char *name, uint32_t length,
 		Index fn) {
-	return struct_field_or_method_new(def, name, length, fn);
+	vec_inc(def->methods);
+	MethodDefinition *method = &vec_last(def->methods);
+	method->name = name;
+	method->length = length;
+	method->fn = fn;
+	return vec_len(def->methods) - 1;
 }
 
 
@@ -89,6 +82,20 @@ Index struct_field_find(StructDefinition *def, char *name, uint32_t length) {
 }
 
 
+// Return the index of a method with the name `name`, or NOT_FOUND if one
+// couldn't be found.
+Index struct_method_find(StructDefinition *def, char *name, uint32_t length) {
+	for (uint32_t i = 0; i < vec_len(def->methods); i++) {
+		MethodDefinition *method = &vec_at(def->methods, i);
+		if (length == method->length &&
+				strncmp(name, method->name, length) == 0) {
+			return i;
+		}
+	}
+	return NOT_FOUND;
+}
+
+
 
 //
 //  Native Structs
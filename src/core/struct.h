@@ -11,6 +11,17 @@
 #include <vec.h>
 
 
+// A method defined on a struct.
+typedef struct {
+	// The name of the method.
+	char *name;
+	uint32_t length;
+
+	// The index of the function containing the method's bytecode.
+	Index fn;
+} MethodDefinition;
+
+
 // A struct definition, containing the fields and methods present on a struct.
 typedef struct {
 	// The name of the struct.
@@ -29,12 +40,13 @@ typedef struct {
 	Index constructor;
 
 	// The name of all fields on this struct, in the order they were defined.
+	// Each instance of the struct stores a value for each of these fields.
 	Vec(Identifier) fields;
 
-	// For each field (in the order they appear in the `fields` array), if the
-	// field is a method, then this will be the index of the function containing
-	// the method's bytecode. Otherwise, the value will be NOT_FOUND.
-	Vec(Index) methods;
+	// All methods defined on the struct. Methods are shared between every
+	// instance of the struct, and are only bound to an instance when they're
+	// used as a value.
+	Vec(MethodDefinition) methods;
 } StructDefinition;
 
 
@@ -52,7 +64,7 @@ Index struct_find(HyState *state, Index pkg, char *name, uint32_t length);
 Index struct_field_new(StructDefinition *def, char *name, uint32_t length);
 
 // Create a new method on the struct with the function defined at `fn`. Return
-// the index of the field the method was created at.
+// the index of the method.
 Index struct_method_new(StructDefinition *def, char *name, uint32_t length,
 	Index fn);
 
@@ -60,6 +72,10 @@ Index struct_method_new(StructDefinition *def, char *name, uint32_t length,
 // couldn't be found.
 Index struct_field_find(StructDefinition *def, char *name, uint32_t length);
 
+// Return the index of a method with the name `name`, or NOT_FOUND if one
+// couldn't be found.
+Index struct_method_find(StructDefinition *def, char *name, uint32_t length);
+
 
 // A native method on a native struct. Very similar to a native function, but
 // associated with a struct definition, rather than a package.
@@ -0,0 +1,140 @@
+
+//
+//  Text Scanning
+//
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "text.h"
+
+
+// The number of bytes compared at once.
+#define BLOCK_SIZE 16
+
+
+
+//
+//  Searching
+//
+
+// Return the index of the first occurrence of `needle` in `haystack` at or
+// after `from`, or NOT_FOUND.
+Index text_find(char *haystack, uint32_t length, char *needle,
+		uint32_t needle_length, uint32_t from) {
+	if (from > length || needle_length > length - from) {
+		return NOT_FOUND;
+	} else if (needle_length == 0) {
+		return from;
+	}
+
+	// The last position the needle can start at
+	uint32_t last = length - needle_length;
+	uint32_t i = from;
+
+	// Compare the first and last bytes of the needle against a block of
+	// starting positions at once
+#ifdef __SSE2__
+	if (needle_length > 1) {
+		__m128i first = _mm_set1_epi8(needle[0]);
+		__m128i final = _mm_set1_epi8(needle[needle_length - 1]);
+		for (; i + BLOCK_SIZE - 1 <= last; i += BLOCK_SIZE) {
+			__m128i starts = _mm_loadu_si128((__m128i *) &haystack[i]);
+			__m128i ends = _mm_loadu_si128(
+				(__m128i *) &haystack[i + needle_length - 1]);
+			__m128i both = _mm_and_si128(_mm_cmpeq_epi8(starts, first),
+				_mm_cmpeq_epi8(ends, final));
+
+			uint32_t matches = (uint32_t) _mm_movemask_epi8(both);
+			while (matches != 0) {
+				uint32_t start = i + __builtin_ctz(matches);
+				if (memcmp(&haystack[start + 1], &needle[1],
+						needle_length - 2) == 0) {
+					return start;
+				}
+				matches &= matches - 1;
+			}
+		}
+	}
+#endif
+
+	// Jump between occurrences of the needle's first byte for the rest
+	while (i <= last) {
+		char *start = memchr(&haystack[i], needle[0], last - i + 1);
+		if (start == NULL) {
+			break;
+		}
+
+		i = start - haystack;
+		if (memcmp(start + 1, &needle[1], needle_length - 1) == 0) {
+			return i;
+		}
+		i++;
+	}
+	return NOT_FOUND;
+}
+
+
+// Return the number of non-overlapping occurrences of `needle` in `haystack`.
+// The needle must not be empty.
+uint32_t text_count(char *haystack, uint32_t length, char *needle,
+		uint32_t needle_length) {
+	uint32_t count = 0;
+	Index i = text_find(haystack, length, needle, needle_length, 0);
+	while (i != NOT_FOUND) {
+		count++;
+		i = text_find(haystack, length, needle, needle_length,
+			i + needle_length);
+	}
+	return count;
+}
+
+
+
+//
+//  Case Conversion
+//
+
+// Copy `length` characters from `src` to `dest`, flipping the case of every
+// character between `from` and `from + 25` inclusive (either the uppercase or
+// lowercase ASCII letters).
+static inline void text_flip_case(char *dest, char *src, uint32_t length,
+		char from) {
+	uint32_t i = 0;
+
+#ifdef __SSE2__
+	// Shift the letters to convert down to the lowest signed bytes, so a
+	// single signed comparison finds them
+	__m128i offset = _mm_set1_epi8((char) (-128 - from));
+	__m128i limit = _mm_set1_epi8(-128 + 26);
+	__m128i flip = _mm_set1_epi8(0x20);
+	for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE) {
+		__m128i bytes = _mm_loadu_si128((__m128i *) &src[i]);
+		__m128i letters = _mm_cmplt_epi8(_mm_add_epi8(bytes, offset), limit);
+		bytes = _mm_xor_si128(bytes, _mm_and_si128(letters, flip));
+		_mm_storeu_si128((__m128i *) &dest[i], bytes);
+	}
+#endif
+
+	for (; i < length; i++) {
+		char ch = src[i];
+		dest[i] = (ch >= from && ch <= from + 25) ? (char) (ch ^ 0x20) : ch;
+	}
+}
+
+
+// Copy `length` characters from `src` to `dest`, converting ASCII letters to
+// lowercase.
+void text_lower(char *dest, char *src, uint32_t length) {
+	text_flip_case(dest, src, length, 'A');
+}
+
+
+// Copy `length` characters from `src` to `dest`, converting ASCII letters to
+// uppercase.
+void text_upper(char *dest, char *src, uint32_t length) {
+	text_flip_case(dest, src, length, 'a');
+}
@@ -0,0 +1,50 @@
+
+//
+//  Text Scanning
+//
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <hydrogen.h>
+#include <stdbool.h>
+
+#include "value.h"
+
+// * Searches for a multi-byte needle compare the needle's first and last bytes
+//   against 16 positions in the haystack at once with SSE2 (always available
+//   on x86-64), and only compare the whole needle at positions where both
+//   match, which is rare for most text
+// * Single byte needles are found with `memchr`, which the C library already
+//   vectorises
+// * Case conversion only affects ASCII letters, so converts 16 bytes at a
+//   time with SSE2, leaving any other bytes (including UTF-8 sequences)
+//   untouched
+// * Everything falls back to plain C on other architectures
+
+
+// Return the index of the first occurrence of `needle` in `haystack` at or
+// after `from`, or NOT_FOUND.
+Index text_find(char *haystack, uint32_t length, char *needle,
+	uint32_t needle_length, uint32_t from);
+
+// Return the number of non-overlapping occurrences of `needle` in `haystack`.
+// The needle must not be empty.
+uint32_t text_count(char *haystack, uint32_t length, char *needle,
+	uint32_t needle_length);
+
+// Return true if a character is whitespace.
+static inline bool text_is_space(char ch) {
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' ||
+		ch == '\v' || ch == '\f';
+}
+
+// Copy `length` characters from `src` to `dest`, converting ASCII letters to
+// lowercase.
+void text_lower(char *dest, char *src, uint32_t length);
+
+// Copy `length` characters from `src` to `dest`, converting ASCII letters to
+// uppercase.
+void text_upper(char *dest, char *src, uint32_t length);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "value.h"
 #include "fn.h"
+#include "state.h"
 
 
 // Return a nil value.
@@ -27,12 +28,7 @@ HyValue hy_number(double number) {
 
 // Copy a string into a garbage collected value.
 HyValue hy_string(HyState *state, char *string) {
-	uint32_t length = strlen(string);
-	String *obj = malloc(sizeof(String) + length + 1);
-	obj->type = OBJ_STRING;
-	obj->length = length;
-	strcpy(&obj->contents[0], string);
-	return ptr_to_val(obj);
+	return ptr_to_val(string_copy(state, string));
 }
 
 
@@ -57,6 +53,12 @@ HyType hy_type(HyValue value) {
 			return HY_METHOD;
 		case OBJ_ARRAY:
 			return HY_ARRAY;
+		case OBJ_FLOAT_ARRAY:
+			return HY_FLOAT_ARRAY;
+		case OBJ_MAP:
+			return HY_MAP;
+		case OBJ_CLOSURE:
+			return HY_FUNCTION;
 		default:
 			return HY_NIL;
 		}
@@ -128,6 +130,137 @@ HyArray * hy_expect_array(HyValue value) {
 
 
 
+
+//
+//  Strings
+//
+
+// Create a new string.
+String * string_new(HyState *state, uint32_t length) {
+	String *string = gc_alloc(state, OBJ_STRING, sizeof(String) + length + 1);
+	string->length = length;
+	string->hash = 0;
+	return string;
+}
+
+
+// Allocate a new string as a copy of another.
+String * string_copy(HyState *state, char *original) {
+	// Copy the string across into a new string
+	String *string = string_new(state, strlen(original));
+	strcpy(&string->contents[0], original);
+	return string;
+}
+
+
+// Concatenate two strings.
+String * string_concat(HyState *state, String *left, String *right) {
+	String *result = string_new(state, left->length + right->length);
+	memcpy(result->contents, left->contents, left->length);
+	memcpy(&result->contents[left->length], right->contents, right->length);
+	result->contents[result->length] = '\0';
+	return result;
+}
+
+
+// Create a new string containing the characters from `start` up to (but not
+// including) `end` in another string.
+String * string_slice(HyState *state, String *string, uint32_t start,
+		uint32_t end) {
+	String *result = string_new(state, end - start);
+	memcpy(result->contents, &string->contents[start], end - start);
+	result->contents[result->length] = '\0';
+	return result;
+}
+
+
+// Hash the contents of a string using FNV-1a.
+uint32_t string_hash(char *contents, uint32_t length) {
+	uint32_t hash = 2166136261u;
+	for (uint32_t i = 0; i < length; i++) {
+		hash ^= (uint8_t) contents[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+
+//
+//  Arrays
+//
+
+// Create a new array of `length` elements, all set to nil. Allocates, so must
+// only be called when a garbage collection is safe.
+Array * array_new(HyState *state, uint32_t length) {
+	Array *array = gc_alloc(state, OBJ_ARRAY, sizeof(Array));
+	array->length = length;
+	array->capacity = ceil_power_of_2(length);
+	array->contents = malloc(sizeof(HyValue) * array->capacity);
+	array->source = VALUE_NIL;
+	state->gc.allocated += sizeof(HyValue) * array->capacity;
+	for (uint32_t i = 0; i < length; i++) {
+		array->contents[i] = VALUE_NIL;
+	}
+	return array;
+}
+
+
+// Allocate an array object with a length and contents, but no elements of its
+// own. If the nursery is full the array is allocated in old space, where it
+// might point to young elements without being remembered, so remember it.
+static Array * array_alloc(HyState *state, uint32_t length, HyValue *contents) {
+	Array *array = gc_alloc(state, OBJ_ARRAY, sizeof(Array));
+	array->length = length;
+	array->capacity = 0;
+	array->contents = contents;
+	array->source = VALUE_NIL;
+	if (!gc_in_nursery(&state->gc, array)) {
+		gc_remember(&state->gc, (Object *) array);
+	}
+	return array;
+}
+
+
+// Create a new array containing the elements from `start` up to (but not
+// including) `end` in another array, without copying them. The elements are
+// shared until either array is modified.
+Array * array_slice(HyState *state, Array *array, uint32_t start,
+		uint32_t end) {
+	// The first time an array is sliced, hand its contents over to a hidden
+	// array that's never modified, and turn the array into a slice of the
+	// whole of them
+	if (array->source == VALUE_NIL) {
+		Array *owner = array_alloc(state, array->length, array->contents);
+		owner->capacity = array->capacity;
+		array->capacity = 0;
+		array->source = ptr_to_val(owner);
+		gc_write_barrier(&state->gc, array, array->source);
+	}
+
+	Array *slice = array_alloc(state, end - start, &array->contents[start]);
+	slice->source = array->source;
+	return slice;
+}
+
+
+// Give an array a copy of its contents if it's sharing them with a slice, so
+// it can be modified. Must be called before modifying an array's contents.
+void array_own(HyState *state, Array *array) {
+	if (array->source == VALUE_NIL) {
+		return;
+	}
+
+	HyValue *shared = array->contents;
+	array->capacity = ceil_power_of_2(array->length);
+	array->contents = malloc(sizeof(HyValue) * array->capacity);
+	memcpy(array->contents, shared, sizeof(HyValue) * array->length);
+	array->source = VALUE_NIL;
+	state->gc.allocated += sizeof(HyValue) * array->capacity;
+}
+
+
+
 //
 //  Function Arguments
 //
@@ -13,6 +13,7 @@
 #include <vec.h>
 
 #include "lib.h"
+#include "gc.h"
 
 // * Values during runtime are stored as NaN tagged 64 bit unsigned integers
 // * An IEEE double precision floating point number can represent "not a
@@ -26,7 +27,7 @@
 // * Values are stored as follows:
 //     * Numbers: NaN bits are not all set
 //     * Pointers: sign bit is set, pointer stored in first 48 bits
-//     * Functions: sign bit unset, 17th bit set, index stored in first 16 bits
+//     * Functions: sign bit unset, 33rd bit set, index stored in first 32 bits
 //     * Primitives (nil, false, true): sign bit unset, tag in first 2 bits
 //
 // * Objects are stored as pointers to heap allocated structs
@@ -59,9 +60,9 @@
 #define VALUE_TRUE  (QUIET_NAN | TAG_TRUE)
 
 // Mask used to indicate a value is a function. Index of function is stored in
-// first 16 bits, so set the first bit above this (the 17th).
-#define TAG_FN 0x10000
-#define TAG_NATIVE 0x20000
+// first 32 bits, so set the first bit above this (the 33rd).
+#define TAG_FN ((uint64_t) 1 << 32)
+#define TAG_NATIVE ((uint64_t) 1 << 33)
 
 
 
@@ -69,35 +70,6 @@
 //  Garbage Collected Objects
 //
 
-// The type of an object stored on the heap.
-typedef enum {
-	OBJ_STRING,
-	OBJ_STRUCT,
-	OBJ_NATIVE_STRUCT,
-	OBJ_METHOD,
-	OBJ_NATIVE_METHOD,
-	OBJ_ARRAY,
-} ObjType;
-
-
-// Objects are stored in values as pointers to heap allocated blocks of memory
-// Since these pointers don't contain any type information about what the object
-// is (ie. string, struct, etc), each object must have a header containing that
-// information.
-//
-// This only acts as a header for other, type specific objects, which all
-// require this general information to be accessible in a consistent manner
-#define ObjHeader \
-	ObjType type;
-
-
-// Since we require a general pointer to objects (ignoring specific types),
-// create a struct containing common information between objects.
-typedef struct {
-	ObjHeader;
-} Object;
-
-
 // A string stored as a heap allocated object. The size of the string object
 // depends on the string's length, as we use the C struct hack to store its
 // contents. This is where we allocate more memory than the size of the struct
@@ -112,8 +84,9 @@ typedef struct {
 	// the string.
 	uint32_t length;
 
-	// All methods defined on the string.
-	HyValue methods[STRING_CORE_METHODS_COUNT];
+	// A hash of the string's contents, or 0 if it hasn't been computed yet.
+	// Only computed when first needed (by `string_hash_get`), then cached.
+	uint32_t hash;
 
 	// The contents of the string, NULL terminated.
 	char contents[0];
@@ -157,13 +130,19 @@ typedef struct {
 } Struct;
 
 
-// A native method on a native struct instance.
+// A native method bound to an object. Methods on native structs are created
+// when the struct is constructed, while methods on core types (like strings and
+// arrays) are looked up in a table shared by every instance of the type, and
+// only bound to an object when they're accessed.
 typedef struct {
 	// The object header.
 	ObjHeader;
 
-	// A pointer to the user data to pass to native method calls.
-	void *data;
+	// The object this method is bound to. The data pointer passed to the
+	// native method is derived from this when the method is called (rather
+	// than being stored here), since the garbage collector may move the
+	// object.
+	HyValue parent;
 
 	// The number of arguments this method requires.
 	uint32_t arity;
@@ -201,11 +180,88 @@ typedef struct hy_array {
 	uint32_t length, capacity;
 	HyValue *contents;
 
-	// All methods defined on the array.
-	HyValue methods[ARRAY_CORE_METHODS_COUNT];
+	// Nil if the array owns its contents. Otherwise the array is a slice, and
+	// `contents` points into a buffer owned by this (hidden) array, which is
+	// kept alive for as long as any slice into it is. A slice copies its
+	// elements into a buffer of its own the first time it's modified.
+	HyValue source;
 } Array;
 
 
+// An array of numbers, stored as raw doubles rather than values so they can be
+// operated on by vectorised kernels (see `numeric.h`).
+typedef struct {
+	// The object header.
+	ObjHeader;
+
+	// The length, capacity, and contents of the array.
+	uint32_t length, capacity;
+	double *contents;
+} FloatArray;
+
+
+// A key and the value stored against it in a map.
+typedef struct {
+	HyValue key;
+	HyValue value;
+} MapEntry;
+
+
+// A Hydrogen map object, an open addressing hash table. Each slot has a
+// metadata byte in `control` (see `map.h`), and the control bytes are stored
+// separately from the entries so a whole group of them can be probed at once.
+typedef struct {
+	// The object header.
+	ObjHeader;
+
+	// The number of keys in the map, the number of slots allocated (0, or a
+	// power of 2 no smaller than a group), and the number of slots left
+	// behind by removed keys.
+	uint32_t length, capacity, tombstones;
+
+	// The control bytes and entries for each slot, allocated as one block.
+	uint8_t *control;
+	MapEntry *entries;
+} Map;
+
+
+// A function along with the upvalues it captured when it was created.
+// Closures are flat: every upvalue the function uses (including ones captured
+// by an enclosing function) is stored directly on the closure, rather than
+// being found through a chain of enclosing environments.
+typedef struct {
+	// The object header.
+	ObjHeader;
+
+	// The index of the function containing the closure's bytecode.
+	Index fn;
+
+	// The upvalue objects captured by the closure.
+	uint32_t upvalues_count;
+	HyValue upvalues[0];
+} Closure;
+
+
+// A local captured by a closure. Only locals that are actually captured are
+// given an upvalue. While the local is in scope the upvalue is open, and
+// refers to the local's stack slot, so the function defining the local and
+// every closure capturing it see the same value. Once the local goes out of
+// scope the upvalue is closed, and the value is moved into the upvalue.
+typedef struct {
+	// The object header.
+	ObjHeader;
+
+	// Whether the upvalue is open, and the absolute position on the stack of
+	// the local it refers to if it is. We use a position rather than a
+	// pointer since the stack is reallocated when it grows.
+	bool open;
+	uint32_t slot;
+
+	// The value of the upvalue once it's been closed.
+	HyValue value;
+} Upvalue;
+
+
 
 //
 //  Bitwise Type Conversion
@@ -311,6 +367,22 @@ static inline bool val_is_fn(HyValue val, uint64_t tag) {
 
 
 
+//
+//  Write Barrier
+//
+
+// Must be called every time a value is stored into an object, so that the
+// garbage collector can find old objects that reference the nursery.
+static inline void gc_write_barrier(GarbageCollector *gc, void *obj,
+		HyValue value) {
+	if (val_is_ptr(value) && gc_in_nursery(gc, val_to_ptr(value)) &&
+			!gc_in_nursery(gc, obj)) {
+		gc_remember(gc, obj);
+	}
+}
+
+
+
 //
 //  Value Manipulation
 //
@@ -322,13 +394,13 @@ static inline HyValue prim_to_val(uint16_t tag) {
 
 
 // Create a function from an index.
-static inline HyValue fn_to_val(uint16_t index, uint64_t tag) {
+static inline HyValue fn_to_val(Index index, uint64_t tag) {
 	return QUIET_NAN | tag | index;
 }
 
 
 // Return the index of a function from its value.
-static inline uint16_t val_to_fn(HyValue val, uint64_t tag) {
+static inline Index val_to_fn(HyValue val, uint64_t tag) {
 	return val & ~(QUIET_NAN | tag);
 }
 
@@ -348,70 +420,72 @@ static inline uint32_t ceil_power_of_2(uint32_t value) {
 //  Strings
 //
 
-// Allocate methods on a string instance.
-static inline void string_add_methods(String *string) {
-	for (uint32_t i = 0; i < STRING_CORE_METHODS_COUNT; i++) {
-		CoreMethod *def = &string_core_methods[i];
-		NativeMethod *method = malloc(sizeof(NativeMethod));
-		method->type = OBJ_NATIVE_METHOD;
-		method->data = string;
-		method->arity = def->arity;
-		method->fn = def->fn;
-		string->methods[i] = ptr_to_val(method);
-	}
-}
-
-
 // Create a new string.
-static inline String * string_new(uint32_t length) {
-	String *string = malloc(sizeof(String) + length + 1);
-	string->type = OBJ_STRING;
-	string->length = length;
-	string_add_methods(string);
-	return string;
-}
-
+String * string_new(HyState *state, uint32_t length);
 
 // Allocate a new string as a copy of another.
-static inline String * string_copy(char *original) {
-	// Copy the string across into a new string
-	String *string = string_new(strlen(original));
-	strcpy(&string->contents[0], original);
-	return string;
-}
+String * string_copy(HyState *state, char *original);
 
+// Concatenate two strings.
+String * string_concat(HyState *state, String *left, String *right);
 
-// Concatenate two raw strings, and place the result in `result`.
-static inline void string_concat_raw(char *result, char *left,
-		uint32_t left_length, char *right) {
-	strncpy(result, left, left_length);
-	strcpy(&result[left_length], right);
-}
+// Create a new string containing the characters from `start` up to (but not
+// including) `end` in another string.
+String * string_slice(HyState *state, String *string, uint32_t start,
+	uint32_t end);
 
+// Hash the contents of a string using FNV-1a.
+uint32_t string_hash(char *contents, uint32_t length);
 
-// Concatenate two strings.
-static inline String * string_concat(String *left, String *right) {
-	String *result = string_new(left->length + right->length);
-	string_concat_raw(result->contents, left->contents, left->length,
-		right->contents);
-	return result;
+// Return the hash of a string's contents, computing and caching it the first
+// time it's needed. A string's contents can't change once it's been hashed.
+static inline uint32_t string_hash_get(String *string) {
+	if (string->hash == 0) {
+		string->hash = string_hash(string->contents, string->length);
+	}
+	return string->hash;
 }
 
 
-// Concatenate two strings, where the left one is a `char *`.
-static inline String * string_concat_left(char *left, String *right) {
-	uint32_t left_length = strlen(left);
-	String *result = string_new(left_length + right->length);
-	string_concat_raw(result->contents, left, left_length, right->contents);
-	return result;
-}
 
+//
+//  Arrays
+//
+
+// Create a new array of `length` elements, all set to nil. Allocates, so must
+// only be called when a garbage collection is safe.
+Array * array_new(HyState *state, uint32_t length);
+
+// Create a new array containing the elements from `start` up to (but not
+// including) `end` in another array, without copying them. The elements are
+// shared until either array is modified.
+Array * array_slice(HyState *state, Array *array, uint32_t start,
+	uint32_t end);
+
+// Give an array a copy of its contents if it's sharing them with a slice, so
+// it can be modified. Must be called before modifying an array's contents.
+void array_own(HyState *state, Array *array);
+
+// Convert one of the bounds of a slice of an array or string with `length`
+// elements into an index, where nil stands for `missing`. Returns false if the
+// bound isn't nil or an integer between 0 and `length` inclusive (which
+// includes NaN).
+static inline bool slice_bound(HyValue bound, uint32_t missing,
+		uint32_t length, uint32_t *index) {
+	if (bound == VALUE_NIL) {
+		*index = missing;
+		return true;
+	} else if (!val_is_num(bound)) {
+		return false;
+	}
 
-// Concatenate two strings, where the right one is a `char *`.
-static inline String * string_concat_right(String *left, char *right) {
-	String *result = string_new(left->length + strlen(right));
-	string_concat_raw(result->contents, left->contents, left->length, right);
-	return result;
+	double number = val_to_num(bound);
+	if (!(number >= 0 && number <= length) ||
+			number != (double) (uint32_t) number) {
+		return false;
+	}
+	*index = (uint32_t) number;
+	return true;
 }
 
 
@@ -424,15 +498,15 @@ static inline String * string_concat_right(String *left, char *right) {
 static inline bool val_cmp(HyValue left, HyValue right);
 
 
-// Compare two strings for equality.
+// Compare two strings for equality. Interned string literals are shared, so
+// check if both are the same object first. Strings with different lengths or
+// hashes can't be equal, so we only compare the contents of strings that
+// match on both, which rejects most unequal strings without touching their
+// contents once they've been hashed.
 static inline bool string_cmp(String *left, String *right) {
-	return strcmp(left->contents, right->contents) == 0;
-}
-
-
-// Compare two strings for equality, where the right value is a `char *`.
-static inline bool string_cmp_right(String *left, char *right) {
-	return strcmp(left->contents, right) == 0;
+	return left == right || (left->length == right->length &&
+		string_hash_get(left) == string_hash_get(right) &&
+		memcmp(left->contents, right->contents, left->length) == 0);
 }
 
 
@@ -34,6 +34,8 @@ static uint32_t io_print_value(HyValue value) {
 		return printf("%s", hy_expect_string(value));
 	case HY_STRUCT:
 		return printf("struct");
+	case HY_MAP:
+		return printf("map");
 	case HY_FUNCTION:
 		return printf("fn");
 	default:
@@ -18,6 +18,8 @@ Function mock_fn(uint32_t count, uint16_t *bytecode) {
 	fn.line = 0;
 	fn.arity = 0;
 	fn.frame_size = 0;
+	vec_new(fn.captures, Capture, 4);
+	fn.locals_captured = false;
 
 	// Copy across the bytecode instruction
 	vec_new(fn.instructions, Instruction, count / 4);
@@ -34,5 +36,6 @@ Function mock_fn(uint32_t count, uint16_t *bytecode) {
 
 // Free a mock function.
 void mock_fn_free(Function *fn) {
+	vec_free(fn->captures);
 	vec_free(fn->instructions);
 }
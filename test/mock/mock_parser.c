@@ -47,6 +47,24 @@ void mock_parser_free(MockParser *parser) {
 }
 
 
+// Parses some code which should fail to compile, returning the error.
+HyError * mock_parser_err(char *code) {
+	HyState *state = hy_new();
+	Index pkg_index = pkg_new(state);
+	Index source = state_add_source_string(state, code);
+	Package *pkg = &vec_at(state->packages, pkg_index);
+
+	Index fn;
+	HyError *err = pkg_parse(pkg, source, &fn);
+	if (err == NULL) {
+		printf("Expected compilation error!\n");
+		trigger();
+	}
+	hy_free(state);
+	return err;
+}
+
+
 // Switch to testing a different function.
 void switch_fn(MockParser *parser, Index fn) {
 	parser->fn = fn;
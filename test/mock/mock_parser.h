@@ -32,6 +32,9 @@ MockParser mock_parser(char *code);
 // Frees a mock parser
 void mock_parser_free(MockParser *parser);
 
+// Parses some code which should fail to compile, returning the error
+HyError * mock_parser_err(char *code);
+
 // Switch to testing a different function.
 void switch_fn(MockParser *parser, Index fn);
 
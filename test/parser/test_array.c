@@ -3,6 +3,9 @@
 //  Array Tests
 //
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <mock_parser.h>
 #include <test.h>
 
@@ -175,6 +178,37 @@ void test_nested_asssignment(void) {
 }
 
 
+
+// Generates source code defining an array literal with `count` elements.
+static char * generate_array(uint32_t count) {
+	char *source = malloc(count * 3 + 16);
+	strcpy(source, "let a = [");
+	char *cursor = source + strlen(source);
+	for (uint32_t i = 0; i < count; i++) {
+		strcpy(cursor, "0, ");
+		cursor += 3;
+	}
+	strcpy(cursor, "]");
+	return source;
+}
+
+
+// Tests array literals can't have more elements than instructions can index
+void test_too_many_elements(void) {
+	char *source = generate_array(UINT16_MAX);
+	MockParser p = mock_parser(source);
+	ins(&p, ARRAY_NEW, 0, UINT16_MAX, 0);
+	mock_parser_free(&p);
+	free(source);
+
+	source = generate_array(UINT16_MAX + 1);
+	HyError *err = mock_parser_err(source);
+	eq_str(err->description, "Too many elements in array literal");
+	hy_err_free(err);
+	free(source);
+}
+
+
 int main(int argc, char *argv[]) {
 	test_pass("Definition", test_definition);
 	test_pass("Nested definitions", test_nested_definitions);
@@ -182,5 +216,6 @@ int main(int argc, char *argv[]) {
 	test_pass("Nested element access", test_nested_access);
 	test_pass("Assignment", test_assignment);
 	test_pass("Nested assignment", test_nested_asssignment);
+	test_pass("Too many elements", test_too_many_elements);
 	return test_run(argc, argv);
 }
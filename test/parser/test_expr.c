@@ -7,6 +7,9 @@
 #include <test.h>
 #include <value.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+
 
 // Tests assigning to new locals inside a block scope
 void test_assign(void) {
@@ -259,6 +262,33 @@ void test_negation(void) {
 
 
 
+// Tests constants whose indices don't fit into 16 bits are loaded using the
+// wide move instructions
+void test_wide_constants(void) {
+	// Fill the constants list by assigning a different number to a local many
+	// times
+	uint32_t count = UINT16_MAX + 1;
+	char *code = malloc(count * 16 + 64);
+	char *cursor = code + sprintf(code, "{\nlet a = 0\n");
+	for (uint32_t i = 0; i < count; i++) {
+		cursor += sprintf(cursor, "a = %u.5\n", i);
+	}
+	sprintf(cursor, "a = 1.25\nlet b = a + 2.25\n}\n");
+
+	MockParser p = mock_parser(code);
+	free(code);
+
+	p.ins = count;
+	ins(&p, MOV_LN, 0, UINT16_MAX, 0);
+	ins(&p, MOV_LN_WIDE, 0, 0, 1);
+	ins(&p, MOV_LN_WIDE, 2, 1, 1);
+	ins(&p, ADD_LL, 1, 0, 2);
+	ins(&p, RET0, 0, 0, 0);
+
+	mock_parser_free(&p);
+}
+
+
 // Tests conditional operations when assigning to variables
 void test_conditional(void) {
 	MockParser p = mock_parser(
@@ -641,6 +671,7 @@ int main(int argc, char *argv[]) {
 	test_pass("Operator precedence", test_precedence);
 	test_pass("Parentheses", test_parentheses);
 	test_pass("Negation", test_negation);
+	test_pass("Wide constants", test_wide_constants);
 	test_pass("Conditionals", test_conditional);
 	test_pass("Boolean and", test_and);
 	test_pass("Boolean or", test_or);
@@ -3,6 +3,10 @@
 //  Function Tests
 //
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <mock_parser.h>
 #include <test.h>
 
@@ -323,6 +327,56 @@ void test_nested_calls(void) {
 }
 
 
+// Tests returning the result of a function call emits a tail call
+void test_tail_call(void) {
+	MockParser p = mock_parser(
+		"fn test(arg) {\n"
+		"	return test(arg + 1)\n"
+		"}\n"
+	);
+
+	switch_fn(&p, 0);
+	ins(&p, MOV_TF, 0, 1, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	switch_fn(&p, 1);
+	ins(&p, MOV_LT, 1, 0, 0);
+	ins(&p, ADD_LI, 2, 0, 1);
+	ins(&p, TAIL_CALL, 1, 1, 1);
+	ins(&p, RET_L, 0, 1, 0);
+
+	mock_parser_free(&p);
+}
+
+
+// Tests capturing a local from an enclosing function in a closure
+void test_closure(void) {
+	MockParser p = mock_parser(
+		"fn counter() {\n"
+		"	let count = 0\n"
+		"	return fn() {\n"
+		"		count = count + 1\n"
+		"	}\n"
+		"}\n"
+	);
+
+	switch_fn(&p, 1);
+	ins(&p, MOV_LI, 0, 0, 0);
+	ins(&p, CLOSURE_NEW, 1, 2, 0);
+	ins(&p, RET_L, 0, 1, 0);
+	ins(&p, UPVALUE_CLOSE, 0, 0, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	switch_fn(&p, 2);
+	ins(&p, MOV_LU, 0, 0, 0);
+	ins(&p, ADD_LI, 0, 0, 1);
+	ins(&p, MOV_UL, 0, 0, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	mock_parser_free(&p);
+}
+
+
 // Tests defining and calling an anonymous function
 void test_anonymous_function(void) {
 	MockParser p = mock_parser(
@@ -397,6 +451,35 @@ void test_override_top_level(void) {
 }
 
 
+
+// Generates source code defining `count` top level functions, followed by
+// `last` on the final line.
+static char * generate_top_levels(uint32_t count, char *last) {
+	char *source = malloc(count * 32 + strlen(last) + 1);
+	char *cursor = source;
+	for (uint32_t i = 0; i < count; i++) {
+		cursor += sprintf(cursor, "fn f%u() {}\n", i);
+	}
+	strcpy(cursor, last);
+	return source;
+}
+
+
+// Tests a package can't define more top level locals than instructions can
+// index
+void test_too_many_top_levels(void) {
+	char *lasts[] = {"fn last() {}\n", "let last = 1\n"};
+	for (uint32_t i = 0; i < 2; i++) {
+		char *source = generate_top_levels(UINT16_MAX + 1, lasts[i]);
+		HyError *err = mock_parser_err(source);
+		eq_str(err->description, "Too many top level locals in package");
+		eq_uint(err->line, UINT16_MAX + 2);
+		hy_err_free(err);
+		free(source);
+	}
+}
+
+
 int main(int argc, char *argv[]) {
 	test_pass("Defining", test_definition);
 	test_pass("Single argument", test_single_argument);
@@ -411,8 +494,11 @@ int main(int argc, char *argv[]) {
 	test_pass("Defining multiple functions", test_multiple_definitions);
 	test_pass("Defining on stack", test_stack);
 	test_pass("Nested calls", test_nested_calls);
+	test_pass("Tail call", test_tail_call);
+	test_pass("Closure", test_closure);
 	test_pass("Anonymous function", test_anonymous_function);
 	test_pass("Call anonymous function", test_call_anonymous_function);
 	test_pass("Override top level in arguments", test_override_top_level);
+	test_pass("Too many top level locals", test_too_many_top_levels);
 	return test_run(argc, argv);
 }
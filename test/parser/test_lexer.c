@@ -121,7 +121,7 @@ void test_bitwise(void) {
 
 // Tests all syntax tokens
 void test_syntax(void) {
-	Lexer lexer = mock_lexer("() [] {} ,.");
+	Lexer lexer = mock_lexer("() [] {} ,.:");
 	eq_token(&lexer, TOKEN_OPEN_PARENTHESIS);
 	eq_token(&lexer, TOKEN_CLOSE_PARENTHESIS);
 	eq_token(&lexer, TOKEN_OPEN_BRACKET);
@@ -130,6 +130,7 @@ void test_syntax(void) {
 	eq_token(&lexer, TOKEN_CLOSE_BRACE);
 	eq_token(&lexer, TOKEN_COMMA);
 	eq_token(&lexer, TOKEN_DOT);
+	eq_token(&lexer, TOKEN_COLON);
 	eq_token(&lexer, TOKEN_EOF);
 	mock_lexer_free(&lexer);
 }
@@ -196,7 +197,7 @@ void test_identifiers(void) {
 // Tests keyword parsing
 void test_keywords(void) {
 	Lexer lexer = mock_lexer(
-		"true false nil if else\n\t\r\n if else while for fn"
+		"true false nil if else\n\t\r\n if else while for in fn"
 	);
 
 	eq_token(&lexer, TOKEN_TRUE);
@@ -207,6 +208,7 @@ void test_keywords(void) {
 	eq_token(&lexer, TOKEN_ELSE);
 	eq_token(&lexer, TOKEN_WHILE);
 	eq_token(&lexer, TOKEN_FOR);
+	eq_token(&lexer, TOKEN_IN);
 	eq_token(&lexer, TOKEN_FN);
 	eq_token(&lexer, TOKEN_EOF);
 	mock_lexer_free(&lexer);
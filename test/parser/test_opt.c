@@ -0,0 +1,130 @@
+
+//
+//  Optimiser Tests
+//
+
+#include <mock_fn.h>
+#include <test.h>
+
+#include <opt.h>
+#include <jmp.h>
+
+
+// Assert the opcode and arguments of an instruction in a function.
+#define ins(fn, index, opcode, arg1, arg2, arg3) {           \
+	lt_uint((index), vec_len((fn).instructions));            \
+	Instruction ins = vec_at((fn).instructions, (index));    \
+	eq_int(ins_arg(ins, 0), opcode);                         \
+	eq_int(ins_arg(ins, 1), arg1);                           \
+	eq_int(ins_arg(ins, 2), arg2);                           \
+	eq_int(ins_arg(ins, 3), arg3);                           \
+}
+
+
+// Tests threading jumps that land on other jumps
+void test_thread_jumps(void) {
+	MOCK_FN(fn,
+		JMP, 2, 0, 0,
+		MOV_LI, 0, 1, 0,
+		JMP, 2, 0, 0,
+		MOV_LI, 0, 2, 0,
+		RET_L, 0, 0, 0
+	);
+	opt_fn(&fn);
+
+	eq_uint(vec_len(fn.instructions), 5);
+	ins(fn, 0, JMP, 4, 0, 0);
+	ins(fn, 2, JMP, 2, 0, 0);
+
+	mock_fn_free(&fn);
+}
+
+
+// Tests propagating copies between locals and removing the copies once
+// they're no longer read
+void test_propagate_copies(void) {
+	MOCK_FN(fn,
+		MOV_LL, 1, 0, 0,
+		ADD_LI, 2, 1, 3,
+		RET_L, 0, 2, 0
+	);
+	fn.arity = 1;
+	fn.frame_size = 8;
+	opt_fn(&fn);
+
+	eq_uint(vec_len(fn.instructions), 2);
+	ins(fn, 0, ADD_LI, 2, 0, 3);
+	ins(fn, 1, RET_L, 0, 2, 0);
+	eq_uint(fn.frame_size, 3);
+
+	mock_fn_free(&fn);
+}
+
+
+// Tests writing the result of an instruction straight into the local it's
+// copied into
+void test_coalesce(void) {
+	MOCK_FN(fn,
+		ADD_LL, 2, 0, 1,
+		MOV_LL, 1, 2, 0,
+		JMP, 1, 0, 0,
+		RET_L, 0, 1, 0
+	);
+	opt_fn(&fn);
+
+	eq_uint(vec_len(fn.instructions), 2);
+	ins(fn, 0, ADD_LL, 1, 0, 1);
+	ins(fn, 1, RET_L, 0, 1, 0);
+
+	mock_fn_free(&fn);
+}
+
+
+// Tests jumps following comparisons are kept
+void test_keep_conditional_jumps(void) {
+	MOCK_FN(fn,
+		LT_LL, 0, 1, 0,
+		JMP, 1, 0, 0,
+		RET0, 0, 0, 0
+	);
+	opt_fn(&fn);
+
+	eq_uint(vec_len(fn.instructions), 3);
+	ins(fn, 1, JMP, 1, 0, 0);
+
+	mock_fn_free(&fn);
+}
+
+
+// Tests jump offsets are updated when dead moves are removed
+void test_remove_dead_moves(void) {
+	MOCK_FN(fn,
+		MOV_LI, 0, 0, 0,
+		GE_LI, 0, 10, 0,
+		JMP, 4, 0, 0,
+		MOV_LI, 2, 5, 0,
+		ADD_LI, 0, 0, 1,
+		LOOP, 4, 0, 0,
+		RET_L, 0, 0, 0
+	);
+	opt_fn(&fn);
+
+	eq_uint(vec_len(fn.instructions), 6);
+	ins(fn, 1, GE_LI, 0, 10, 0);
+	ins(fn, 2, JMP, 3, 0, 0);
+	ins(fn, 3, ADD_LI, 0, 0, 1);
+	ins(fn, 4, LOOP, 3, 0, 0);
+	ins(fn, 5, RET_L, 0, 0, 0);
+
+	mock_fn_free(&fn);
+}
+
+
+int main(int argc, char *argv[]) {
+	test_pass("Thread jumps", test_thread_jumps);
+	test_pass("Propagate copies", test_propagate_copies);
+	test_pass("Coalesce", test_coalesce);
+	test_pass("Keep conditional jumps", test_keep_conditional_jumps);
+	test_pass("Remove dead moves", test_remove_dead_moves);
+	return test_run(argc, argv);
+}
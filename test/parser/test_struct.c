@@ -203,8 +203,36 @@ void test_self(void) {
 	ins(&p, RET0, 0, 0, 0);
 
 	switch_fn(&p, 1);
-	ins(&p, MOV_SELF, 0, 0, 0);
-	ins(&p, STRUCT_FIELD, 0, 0, 0);
+	ins(&p, SELF_FIELD, 0, 0, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	mock_parser_free(&p);
+}
+
+
+// Tests setting fields on `self` that are known at compile time.
+void test_self_set(void) {
+	MockParser p = mock_parser(
+		"struct Test {\n"
+		"	field1, field2\n"
+		"}\n"
+		"fn (Test) test(arg) {\n"
+		"	self.field2 = arg\n"
+		"	self.field1 = self.field2 + 3\n"
+		"	self.other = 4\n"
+		"}\n"
+	);
+
+	switch_fn(&p, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	switch_fn(&p, 1);
+	ins(&p, SELF_SET_L, 1, 0, 0);
+	ins(&p, SELF_FIELD, 2, 1, 0);
+	ins(&p, ADD_LI, 2, 2, 3);
+	ins(&p, SELF_SET_L, 0, 2, 0);
+	ins(&p, MOV_SELF, 1, 0, 0);
+	ins(&p, STRUCT_SET_I, 0, 4, 1);
 	ins(&p, RET0, 0, 0, 0);
 
 	mock_parser_free(&p);
@@ -229,13 +257,11 @@ void test_method_call(void) {
 	ins(&p, MOV_TL, 0, 0, 0);
 
 	ins(&p, MOV_LT, 0, 0, 0);
-	ins(&p, STRUCT_FIELD, 0, 0, 0);
-	ins(&p, CALL, 0, 0, 0);
+	ins(&p, CALL_FIELD, 0, 0, 0);
 	ins(&p, MOV_TL, 1, 0, 0);
 
 	ins(&p, MOV_LT, 0, 0, 0);
-	ins(&p, STRUCT_FIELD, 0, 0, 0);
-	ins(&p, CALL, 0, 0, 0);
+	ins(&p, CALL_FIELD, 0, 0, 0);
 	ins(&p, RET0, 0, 0, 0);
 
 	switch_fn(&p, 1);
@@ -246,6 +272,43 @@ void test_method_call(void) {
 }
 
 
+// Tests calling a method with arguments on a struct stored in a local.
+void test_method_call_args(void) {
+	MockParser p = mock_parser(
+		"struct Test\n"
+		"fn (Test) test(a, b) {\n"
+		"}\n"
+		"fn f() {\n"
+		"	let a = new Test()\n"
+		"	let b = a.test(1, 2)\n"
+		"	a.test(3, 4)\n"
+		"}\n"
+	);
+
+	switch_fn(&p, 0);
+	ins(&p, MOV_TF, 0, 2, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	switch_fn(&p, 1);
+	ins(&p, RET0, 0, 0, 0);
+
+	switch_fn(&p, 2);
+	ins(&p, STRUCT_NEW, 0, 0, 0);
+	ins(&p, STRUCT_CALL_CONSTRUCTOR, 0, 1, 0);
+	ins(&p, MOV_LL, 1, 0, 0);
+	ins(&p, MOV_LI, 2, 1, 0);
+	ins(&p, MOV_LI, 3, 2, 0);
+	ins(&p, CALL_FIELD, 1, 2, 0);
+	ins(&p, MOV_LL, 2, 0, 0);
+	ins(&p, MOV_LI, 3, 3, 0);
+	ins(&p, MOV_LI, 4, 4, 0);
+	ins(&p, CALL_FIELD, 2, 2, 0);
+	ins(&p, RET0, 0, 0, 0);
+
+	mock_parser_free(&p);
+}
+
+
 // Tests calling a method on a struct stored as an upvalue.
 void test_upvalue_method_call(void) {
 	MockParser p = mock_parser(
@@ -338,7 +401,9 @@ int main(int argc, char *argv[]) {
 	test_pass("Method definition", test_method_definition);
 	test_pass("Get method", test_get_method);
 	test_pass("Self", test_self);
+	test_pass("Self set", test_self_set);
 	test_pass("Method call", test_method_call);
+	test_pass("Method call with arguments", test_method_call_args);
 	// test_pass("Method call on upvalue", test_upvalue_method_call);
 	test_pass("Custom constructor", test_custom_constructor);
 	test_pass("Call custom constructor", test_call_custom_constructor);